@@ -0,0 +1,46 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Host replacement of the FreeRTOS task functions, a task is a detached std::thread
+ */
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+
+inline BaseType_t xTaskCreate(TaskFunction_t task, const char* /*name*/, uint32_t /*stack_depth*/, void* parameters,
+                              UBaseType_t /*priority*/, TaskHandle_t* created_task)
+{
+    std::thread thread(task, parameters);
+    if (created_task != nullptr)
+    {
+        *created_task = nullptr;
+    }
+    thread.detach();
+    return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
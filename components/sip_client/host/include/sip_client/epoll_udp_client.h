@@ -0,0 +1,376 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_log.h"
+#include "sip_client/buffer.h"
+#include "sip_client/rx_buffer_pool.h"
+
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * SocketT for Linux hosts that moves several datagrams per system call
+ *
+ * Meant for running many clients on one host, e.g. as soak test against a local server.
+ * receive() fetches up to BATCH_SIZE datagrams with one recvmmsg() into the free receive buffers
+ * and hands them out one after the other. send_buffered_data() only queues the datagram, the queue is sent with one sendmmsg()
+ * when it is full and before receive() waits. wake() signals an eventfd that epoll watches
+ * together with the socket, so no datagram to the own port is needed.
+ */
+class EpollUdpClient
+{
+public:
+    static constexpr uint32_t RECEIVE_FOREVER = UINT32_MAX;
+    static constexpr size_t BATCH_SIZE = 16;
+
+    EpollUdpClient(const std::string& server_ip, const std::string& server_port, uint16_t local_port)
+    : m_server_port(server_port)
+    , m_server_ip(server_ip)
+    , m_local_port(local_port)
+    , m_socket(INVALID_SOCKET)
+    , m_epoll(INVALID_SOCKET)
+    , m_wake_event(INVALID_SOCKET)
+    , m_rx_count(0)
+    , m_rx_next(0)
+    , m_tx_count(0)
+    {
+        memset(&m_dest_addr, 0, sizeof(m_dest_addr));
+    }
+
+    ~EpollUdpClient()
+    {
+        deinit();
+    }
+
+    void set_server_ip(const std::string& server_ip)
+    {
+        if (is_initialized())
+        {
+            deinit();
+        }
+        m_server_ip = server_ip;
+    }
+
+    void deinit()
+    {
+        if (is_initialized())
+        {
+            flush();
+        }
+        while (m_rx_next < m_rx_count)
+        {
+            m_rx_pool.release(m_rx_indices[m_rx_next++]);
+        }
+        close_fd(m_socket);
+        close_fd(m_epoll);
+        close_fd(m_wake_event);
+        m_rx_count = 0;
+        m_rx_next = 0;
+        m_tx_count = 0;
+    }
+
+    bool init()
+    {
+        if (m_socket >= 0)
+        {
+            ESP_LOGW(TAG, "Socket already initialized");
+            return false;
+        }
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        struct addrinfo* res;
+        int err = getaddrinfo(m_server_ip.c_str(), m_server_port.c_str(), &hints, &res);
+        if ((err != 0) || (res == nullptr))
+        {
+            ESP_LOGE(TAG, "DNS lookup failed err=%d", err);
+            return false;
+        }
+        memcpy(&m_dest_addr, res->ai_addr, sizeof(m_dest_addr));
+        freeaddrinfo(res);
+
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        m_epoll = epoll_create1(0);
+        m_wake_event = eventfd(0, EFD_NONBLOCK);
+        if ((m_socket < 0) || (m_epoll < 0) || (m_wake_event < 0))
+        {
+            ESP_LOGE(TAG, "Failed to allocate socket, errno=%d", errno);
+            deinit();
+            return false;
+        }
+
+        struct sockaddr_in local_addr;
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sin_family = AF_INET;
+        local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        local_addr.sin_port = htons(m_local_port);
+        if (bind(m_socket, (struct sockaddr*) &local_addr, sizeof(local_addr)) < 0)
+        {
+            ESP_LOGE(TAG, "Failed to bind port %d, errno=%d", m_local_port, errno);
+            deinit();
+            return false;
+        }
+
+        if (!watch(m_socket) || !watch(m_wake_event))
+        {
+            ESP_LOGE(TAG, "Failed to add to epoll, errno=%d", errno);
+            deinit();
+            return false;
+        }
+        return true;
+    }
+
+    bool is_initialized() const
+    {
+        return m_socket >= 0;
+    }
+
+    /**
+     * Wait up to timeout_msec for a datagram, RECEIVE_FOREVER blocks until one arrives
+     *
+     * Queued datagrams are sent first. The datagram borrows a receive buffer until it is released.
+     *
+     * \return an empty datagram on timeout and after wake()
+     */
+    RxDatagram receive(uint32_t timeout_msec)
+    {
+        flush();
+        if (m_rx_next < m_rx_count)
+        {
+            return next_datagram();
+        }
+
+        int timeout = (timeout_msec == RECEIVE_FOREVER) ? -1 : static_cast<int>((timeout_msec > INT_MAX) ? INT_MAX : timeout_msec);
+        struct epoll_event events[2];
+        int ready = epoll_wait(m_epoll, events, 2, timeout);
+        if ((ready < 0) && (errno != EINTR))
+        {
+            ESP_LOGW(TAG, "Epoll error: %d, errno=%d", ready, errno);
+        }
+        bool readable = false;
+        for (int i = 0; i < ready; i++)
+        {
+            if (events[i].data.fd == m_wake_event)
+            {
+                uint64_t wakes;
+                if (read(m_wake_event, &wakes, sizeof(wakes)) < 0)
+                {
+                    ESP_LOGD(TAG, "Failed to read the wake event, errno=%d", errno);
+                }
+            }
+            else
+            {
+                readable = true;
+            }
+        }
+        if (!readable)
+        {
+            return RxDatagram();
+        }
+
+        size_t count = 0;
+        while ((count < BATCH_SIZE) && m_rx_pool.acquire(m_rx_indices[count]))
+        {
+            count++;
+        }
+        if (count == 0)
+        {
+            ESP_LOGW(TAG, "All receive buffers are borrowed");
+            return RxDatagram();
+        }
+        std::array<struct mmsghdr, BATCH_SIZE> headers;
+        std::array<struct iovec, BATCH_SIZE> parts;
+        memset(headers.data(), 0, sizeof(headers));
+        for (size_t i = 0; i < count; i++)
+        {
+            parts[i].iov_base = m_rx_pool.data(m_rx_indices[i]);
+            parts[i].iov_len = m_rx_pool.buffer_size();
+            headers[i].msg_hdr.msg_iov = &parts[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(m_socket, headers.data(), count, MSG_DONTWAIT, nullptr);
+        for (size_t i = (received > 0) ? received : 0; i < count; i++)
+        {
+            m_rx_pool.release(m_rx_indices[i]);
+        }
+        if (received <= 0)
+        {
+            ESP_LOGD(TAG, "Received no data: %d, errno=%d", received, errno);
+            return RxDatagram();
+        }
+        for (int i = 0; i < received; i++)
+        {
+            //a datagram that did not fit is dropped, the parser would reject it anyway
+            m_rx_lengths[i] = (headers[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : headers[i].msg_len;
+        }
+        m_rx_count = received;
+        m_rx_next = 0;
+        ESP_LOGV(TAG, "Received %d datagrams", received);
+        return next_datagram();
+    }
+
+    /**
+     * Make a blocking receive() of another task return
+     *
+     * The counter of the eventfd keeps the wake-up if no receive() is blocking at the moment.
+     */
+    void wake()
+    {
+        if (!is_initialized())
+        {
+            return;
+        }
+        uint64_t wakes = 1;
+        if (write(m_wake_event, &wakes, sizeof(wakes)) < 0)
+        {
+            ESP_LOGW(TAG, "Failed to wake the socket, errno=%d", errno);
+        }
+    }
+
+    TxBufferT& get_new_tx_buf()
+    {
+        if (m_tx_count == BATCH_SIZE)
+        {
+            flush();
+        }
+        TxBufferT& tx_buffer = m_tx_buffers[m_tx_count];
+        tx_buffer.clear();
+        return tx_buffer;
+    }
+
+    /**
+     * Queue the datagram of the last get_new_tx_buf(), it is sent by flush()
+     *
+     * \return false if the message was truncated or the full queue could not be sent
+     */
+    bool send_buffered_data()
+    {
+        TxBufferT& tx_buffer = m_tx_buffers[m_tx_count];
+        if (tx_buffer.is_overflow())
+        {
+            ESP_LOGE(TAG, "Message exceeds %d byte, not sending it", TX_BUFFER_SIZE);
+            return false;
+        }
+        ESP_LOGD(TAG, "Queueing %d byte", (int) tx_buffer.size());
+        ESP_LOGV(TAG, "Sending following data: %s", tx_buffer.data());
+        m_tx_count++;
+        return (m_tx_count < BATCH_SIZE) || flush();
+    }
+
+    /**
+     * Send all queued datagrams with as few system calls as possible
+     *
+     * \return false if a datagram could not be sent, the rest of the queue is dropped then
+     */
+    bool flush()
+    {
+        if (m_tx_count == 0)
+        {
+            return true;
+        }
+        std::array<struct mmsghdr, BATCH_SIZE> headers;
+        std::array<struct iovec, BATCH_SIZE> parts;
+        memset(headers.data(), 0, sizeof(headers));
+        for (size_t i = 0; i < m_tx_count; i++)
+        {
+            parts[i].iov_base = const_cast<char*>(m_tx_buffers[i].data());
+            parts[i].iov_len = m_tx_buffers[i].size();
+            headers[i].msg_hdr.msg_name = &m_dest_addr;
+            headers[i].msg_hdr.msg_namelen = sizeof(m_dest_addr);
+            headers[i].msg_hdr.msg_iov = &parts[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        size_t sent = 0;
+        while (sent < m_tx_count)
+        {
+            int result = sendmmsg(m_socket, headers.data() + sent, m_tx_count - sent, 0);
+            if (result <= 0)
+            {
+                if ((result < 0) && (errno == EINTR))
+                {
+                    continue;
+                }
+                ESP_LOGD(TAG, "Failed to send data %d, errno=%d", result, errno);
+                break;
+            }
+            sent += result;
+        }
+        bool complete = (sent == m_tx_count);
+        m_tx_count = 0;
+        return complete;
+    }
+
+private:
+    RxDatagram next_datagram()
+    {
+        size_t next = m_rx_next++;
+        ESP_LOGD(TAG, "Received %d byte", (int) m_rx_lengths[next]);
+        return m_rx_pool.lend(m_rx_indices[next], m_rx_lengths[next]);
+    }
+
+    bool watch(int fd)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    static void close_fd(int& fd)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = INVALID_SOCKET;
+        }
+    }
+
+    const std::string m_server_port;
+    std::string m_server_ip;
+    const uint16_t m_local_port;
+
+    std::array<TxBufferT, BATCH_SIZE> m_tx_buffers;
+    RxBufferPool<BATCH_SIZE> m_rx_pool;
+    std::array<size_t, BATCH_SIZE> m_rx_indices;    ///< pool buffers of the last recvmmsg()
+    std::array<size_t, BATCH_SIZE> m_rx_lengths;
+    int m_socket;
+    int m_epoll;
+    int m_wake_event;
+    sockaddr_in m_dest_addr;
+    size_t m_rx_count;      ///< datagrams of the last recvmmsg()
+    size_t m_rx_next;       ///< next datagram to hand out
+    size_t m_tx_count;      ///< queued datagrams
+
+    static constexpr const char* TAG = "EpollUdpSocket";
+    static constexpr const int INVALID_SOCKET = -1;
+};
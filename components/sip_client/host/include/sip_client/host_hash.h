@@ -0,0 +1,28 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "host_md5.h"
+#include "host_sha256.h"
+
+/**
+ * HashT of SipClient for a host build, with the interface of MbedtlsHash
+ */
+struct HostHash {
+    using Md5 = HostMd5;
+    using Sha256 = HostSha256;
+};
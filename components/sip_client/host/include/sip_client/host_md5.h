@@ -0,0 +1,164 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "sip_client/string_view.h"
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Self-contained MD5 (RFC 1321) with the interface of MbedtlsMd5
+ */
+class HostMd5
+{
+public:
+    static constexpr size_t SIZE = 16;     ///< length of the digest in byte
+
+    HostMd5()
+    {
+        start();
+    }
+
+    void start()
+    {
+        m_state[0] = 0x67452301;
+        m_state[1] = 0xefcdab89;
+        m_state[2] = 0x98badcfe;
+        m_state[3] = 0x10325476;
+        m_length = 0;
+    }
+
+    void update(const void* input, size_t length)
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(input);
+        size_t used = m_length % 64;
+        m_length += length;
+        while (length > 0)
+        {
+            size_t chunk = ((64 - used) < length) ? (64 - used) : length;
+            memcpy(m_block + used, data, chunk);
+            used += chunk;
+            data += chunk;
+            length -= chunk;
+            if (used == 64)
+            {
+                transform();
+                used = 0;
+            }
+        }
+    }
+
+    void update(StringView input)
+    {
+        update(input.data(), input.size());
+    }
+
+    void finish(unsigned char hash[SIZE])
+    {
+        uint64_t bit_length = m_length * 8;
+        static const uint8_t PADDING[64] = {0x80};
+        size_t used = m_length % 64;
+        update(PADDING, (used < 56) ? (56 - used) : (120 - used));
+        uint8_t length_bytes[8];
+        for (size_t i = 0; i < 8; i++)
+        {
+            length_bytes[i] = static_cast<uint8_t>(bit_length >> (8 * i));
+        }
+        update(length_bytes, sizeof(length_bytes));
+        for (size_t i = 0; i < SIZE; i++)
+        {
+            hash[i] = static_cast<unsigned char>(m_state[i / 4] >> (8 * (i % 4)));
+        }
+    }
+
+private:
+    static uint32_t rotate_left(uint32_t value, uint32_t bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    void transform()
+    {
+        static const uint32_t SHIFTS[64] = {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+        };
+        static const uint32_t SINES[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+        };
+
+        uint32_t words[16];
+        for (size_t i = 0; i < 16; i++)
+        {
+            words[i] = static_cast<uint32_t>(m_block[i * 4]) | (static_cast<uint32_t>(m_block[i * 4 + 1]) << 8)
+                       | (static_cast<uint32_t>(m_block[i * 4 + 2]) << 16) | (static_cast<uint32_t>(m_block[i * 4 + 3]) << 24);
+        }
+
+        uint32_t a = m_state[0];
+        uint32_t b = m_state[1];
+        uint32_t c = m_state[2];
+        uint32_t d = m_state[3];
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            uint32_t f;
+            uint32_t g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            uint32_t rotated = b + rotate_left(a + f + SINES[i] + words[g], SHIFTS[i]);
+            a = d;
+            d = c;
+            c = b;
+            b = rotated;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+    }
+
+    uint32_t m_state[4];
+    uint64_t m_length;
+    uint8_t m_block[64];
+};
@@ -0,0 +1,159 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "sip_client/string_view.h"
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Self-contained SHA-256 (FIPS 180-4) with the interface of MbedtlsSha256
+ */
+class HostSha256
+{
+public:
+    static constexpr size_t SIZE = 32;     ///< length of the digest in byte
+
+    HostSha256()
+    {
+        start();
+    }
+
+    void start()
+    {
+        static const uint32_t INITIAL[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+        memcpy(m_state, INITIAL, sizeof(m_state));
+        m_length = 0;
+    }
+
+    void update(const void* input, size_t length)
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(input);
+        size_t used = m_length % 64;
+        m_length += length;
+        while (length > 0)
+        {
+            size_t chunk = ((64 - used) < length) ? (64 - used) : length;
+            memcpy(m_block + used, data, chunk);
+            used += chunk;
+            data += chunk;
+            length -= chunk;
+            if (used == 64)
+            {
+                transform();
+                used = 0;
+            }
+        }
+    }
+
+    void update(StringView input)
+    {
+        update(input.data(), input.size());
+    }
+
+    void finish(unsigned char hash[SIZE])
+    {
+        uint64_t bit_length = m_length * 8;
+        static const uint8_t PADDING[64] = {0x80};
+        size_t used = m_length % 64;
+        update(PADDING, (used < 56) ? (56 - used) : (120 - used));
+        uint8_t length_bytes[8];
+        for (size_t i = 0; i < 8; i++)
+        {
+            length_bytes[i] = static_cast<uint8_t>(bit_length >> (56 - 8 * i));
+        }
+        update(length_bytes, sizeof(length_bytes));
+        for (size_t i = 0; i < SIZE; i++)
+        {
+            hash[i] = static_cast<unsigned char>(m_state[i / 4] >> (24 - 8 * (i % 4)));
+        }
+    }
+
+private:
+    static uint32_t rotate_right(uint32_t value, uint32_t bits)
+    {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    void transform()
+    {
+        static const uint32_t ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+
+        uint32_t words[64];
+        for (size_t i = 0; i < 16; i++)
+        {
+            words[i] = (static_cast<uint32_t>(m_block[i * 4]) << 24) | (static_cast<uint32_t>(m_block[i * 4 + 1]) << 16)
+                       | (static_cast<uint32_t>(m_block[i * 4 + 2]) << 8) | static_cast<uint32_t>(m_block[i * 4 + 3]);
+        }
+        for (size_t i = 16; i < 64; i++)
+        {
+            uint32_t s0 = rotate_right(words[i - 15], 7) ^ rotate_right(words[i - 15], 18) ^ (words[i - 15] >> 3);
+            uint32_t s1 = rotate_right(words[i - 2], 17) ^ rotate_right(words[i - 2], 19) ^ (words[i - 2] >> 10);
+            words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+        }
+
+        uint32_t a = m_state[0];
+        uint32_t b = m_state[1];
+        uint32_t c = m_state[2];
+        uint32_t d = m_state[3];
+        uint32_t e = m_state[4];
+        uint32_t f = m_state[5];
+        uint32_t g = m_state[6];
+        uint32_t h = m_state[7];
+        for (size_t i = 0; i < 64; i++)
+        {
+            uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + s1 + choice + ROUND_CONSTANTS[i] + words[i];
+            uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+
+    uint32_t m_state[8];
+    uint64_t m_length;
+    uint8_t m_block[64];
+};
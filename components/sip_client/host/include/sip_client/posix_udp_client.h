@@ -0,0 +1,230 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_log.h"
+#include "sip_client/buffer.h"
+#include "sip_client/rx_buffer_pool.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * SocketT for a host build, same interface as LwipUdpClient on top of POSIX sockets
+ */
+class PosixUdpClient
+{
+public:
+    static constexpr uint32_t RECEIVE_FOREVER = UINT32_MAX;
+    static constexpr size_t RX_BUFFER_COUNT = 2;    ///< received datagrams that may be kept at the same time
+
+    PosixUdpClient(const std::string& server_ip, const std::string& server_port, uint16_t local_port)
+    : m_server_port(server_port)
+    , m_server_ip(server_ip)
+    , m_local_port(local_port)
+    , m_socket(INVALID_SOCKET)
+    {
+        memset(&m_dest_addr, 0, sizeof(m_dest_addr));
+    }
+
+    ~PosixUdpClient()
+    {
+        deinit();
+    }
+
+    void set_server_ip(const std::string& server_ip)
+    {
+        if (is_initialized())
+        {
+            deinit();
+        }
+        m_server_ip = server_ip;
+    }
+
+    void deinit()
+    {
+        if (!is_initialized())
+        {
+            return;
+        }
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+
+    bool init()
+    {
+        if (m_socket >= 0)
+        {
+            ESP_LOGW(TAG, "Socket already initialized");
+            return false;
+        }
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        struct addrinfo* res;
+        int err = getaddrinfo(m_server_ip.c_str(), m_server_port.c_str(), &hints, &res);
+        if ((err != 0) || (res == nullptr))
+        {
+            ESP_LOGE(TAG, "DNS lookup failed err=%d", err);
+            return false;
+        }
+        memcpy(&m_dest_addr, res->ai_addr, sizeof(m_dest_addr));
+        freeaddrinfo(res);
+
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0)
+        {
+            ESP_LOGE(TAG, "Failed to allocate socket, errno=%d", errno);
+            return false;
+        }
+
+        struct sockaddr_in local_addr;
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sin_family = AF_INET;
+        local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        local_addr.sin_port = htons(m_local_port);
+        if (bind(m_socket, (struct sockaddr*) &local_addr, sizeof(local_addr)) < 0)
+        {
+            ESP_LOGE(TAG, "Failed to bind port %d, errno=%d", m_local_port, errno);
+            close(m_socket);
+            m_socket = INVALID_SOCKET;
+            return false;
+        }
+        return true;
+    }
+
+    bool is_initialized() const
+    {
+        return m_socket >= 0;
+    }
+
+    /**
+     * Wait up to timeout_msec for a datagram, RECEIVE_FOREVER blocks until one arrives
+     *
+     * The datagram borrows a receive buffer until it is released.
+     *
+     * \return an empty datagram on timeout and after wake()
+     */
+    RxDatagram receive(uint32_t timeout_msec)
+    {
+        fd_set rx_fds;
+        FD_ZERO(&rx_fds);
+        FD_SET(m_socket, &rx_fds);
+
+        struct timeval rx_timeval;
+        rx_timeval.tv_sec = timeout_msec / 1000;
+        rx_timeval.tv_usec = (timeout_msec % 1000) * 1000;
+
+        int readable = select(m_socket + 1, &rx_fds, nullptr, nullptr, (timeout_msec == RECEIVE_FOREVER) ? nullptr : &rx_timeval);
+        if (readable < 0)
+        {
+            ESP_LOGW(TAG, "Select error: %d, errno=%d", readable, errno);
+        }
+        if (readable <= 0)
+        {
+            return RxDatagram();
+        }
+
+        size_t index;
+        if (!m_rx_pool.acquire(index))
+        {
+            ESP_LOGW(TAG, "All receive buffers are borrowed");
+            return RxDatagram();
+        }
+        ssize_t len = recv(m_socket, m_rx_pool.data(index), m_rx_pool.buffer_size(), 0);
+        if (len <= 0)
+        {
+            ESP_LOGD(TAG, "Received no data: %d, errno=%d", (int) len, errno);
+            m_rx_pool.release(index);
+            return RxDatagram();
+        }
+        ESP_LOGD(TAG, "Received %d byte", (int) len);
+        return m_rx_pool.lend(index, len);
+    }
+
+    /**
+     * Make a blocking receive() of another task return
+     *
+     * An empty datagram is sent to the own port over the loopback interface. It is queued
+     * if no receive() is blocking at the moment, so a wake-up is never lost.
+     */
+    void wake()
+    {
+        if (!is_initialized())
+        {
+            return;
+        }
+        struct sockaddr_in loopback_addr;
+        memset(&loopback_addr, 0, sizeof(loopback_addr));
+        loopback_addr.sin_family = AF_INET;
+        loopback_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        loopback_addr.sin_port = htons(m_local_port);
+        static const char WAKE_DATA = 0;
+        if (sendto(m_socket, &WAKE_DATA, 0, 0, (struct sockaddr*) &loopback_addr, sizeof(loopback_addr)) < 0)
+        {
+            ESP_LOGW(TAG, "Failed to wake the socket, errno=%d", errno);
+        }
+    }
+
+    TxBufferT& get_new_tx_buf()
+    {
+        m_tx_buffer.clear();
+        return m_tx_buffer;
+    }
+
+    bool send_buffered_data()
+    {
+        if (m_tx_buffer.is_overflow())
+        {
+            ESP_LOGE(TAG, "Message exceeds %d byte, not sending it", TX_BUFFER_SIZE);
+            return false;
+        }
+        ESP_LOGD(TAG, "Sending %d byte", (int) m_tx_buffer.size());
+        ESP_LOGV(TAG, "Sending following data: %s", m_tx_buffer.data());
+        ssize_t result = sendto(m_socket, m_tx_buffer.data(), m_tx_buffer.size(), 0, (struct sockaddr*) &m_dest_addr, sizeof(m_dest_addr));
+        if (result < 0)
+        {
+            ESP_LOGD(TAG, "Failed to send data %d, errno=%d", (int) result, errno);
+        }
+        return result == static_cast<ssize_t>(m_tx_buffer.size());
+    }
+
+private:
+    const std::string m_server_port;
+    std::string m_server_ip;
+    const uint16_t m_local_port;
+
+    TxBufferT m_tx_buffer;
+    RxBufferPool<RX_BUFFER_COUNT> m_rx_pool;
+    int m_socket;
+    sockaddr_in m_dest_addr;
+
+    static constexpr const char* TAG = "PosixUdpSocket";
+    static constexpr const int INVALID_SOCKET = -1;
+};
@@ -0,0 +1,155 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Checks, timing and heap allocation counting for the host tests and benchmarks
+ *
+ * Each test is a single translation unit, this header replaces the global operator new there.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+
+namespace host_test {
+
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline std::atomic<size_t>& allocations()
+{
+    static std::atomic<size_t> count {0};
+    return count;
+}
+
+inline std::atomic<size_t>& allocated_bytes()
+{
+    static std::atomic<size_t> count {0};
+    return count;
+}
+
+/**
+ * Heap allocations between construction and the call of count()
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter()
+    : m_allocations(allocations().load())
+    , m_bytes(allocated_bytes().load())
+    {}
+
+    size_t count() const
+    {
+        return allocations().load() - m_allocations;
+    }
+
+    size_t bytes() const
+    {
+        return allocated_bytes().load() - m_bytes;
+    }
+
+private:
+    size_t m_allocations;
+    size_t m_bytes;
+};
+
+/**
+ * \return nanoseconds per call of function, averaged over iterations calls
+ */
+template <class FunctionT>
+double measure_ns(size_t iterations, FunctionT function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        function();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+inline std::string read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        fprintf(stderr, "Can not read %s\n", path.c_str());
+        failures()++;
+        return std::string();
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/**
+ * \return the exit code of the test
+ */
+inline int result()
+{
+    if (failures() > 0)
+    {
+        printf("%d checks failed\n", failures());
+        return 1;
+    }
+    printf("passed\n");
+    return 0;
+}
+
+}
+
+#define CHECK(condition)                                                            \
+    do                                                                              \
+    {                                                                               \
+        if (!(condition))                                                           \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);    \
+            host_test::failures()++;                                                \
+        }                                                                           \
+    } while (0)
+
+void* operator new(size_t size)
+{
+    host_test::allocations()++;
+    host_test::allocated_bytes() += size;
+    void* memory = malloc((size > 0) ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
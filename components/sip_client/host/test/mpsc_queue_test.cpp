@@ -0,0 +1,132 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Several producer threads push into a small MpscQueue while one consumer pops
+ *
+ * Built with -fsanitize=thread. Every entry has to arrive exactly once, in the order of its
+ * producer and not torn.
+ *
+ *   mpsc_queue_test [ENTRIES_PER_PRODUCER]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/mpsc_queue.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t PRODUCERS = 4;
+
+struct Entry {
+    uint32_t producer = 0;
+    uint32_t sequence = 0;
+    uint32_t check = 0;         ///< derived from the other fields to detect torn entries
+};
+
+uint32_t check_value(uint32_t producer, uint32_t sequence)
+{
+    return (producer * 2654435761u) ^ (sequence * 40503u) ^ 0x5a5a5a5au;
+}
+
+void check_full()
+{
+    MpscQueue<uint32_t, 4> queue;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(queue.push(uint32_t(i)));
+    }
+    CHECK(!queue.push(uint32_t(4)));
+    uint32_t value = 0;
+    CHECK(queue.pop(value) && (value == 0));
+    CHECK(queue.push(uint32_t(4)));
+    for (uint32_t i = 1; i <= 4; i++)
+    {
+        CHECK(queue.pop(value) && (value == i));
+    }
+    CHECK(!queue.pop(value));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t entries = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100000;
+    check_full();
+
+    //small, so the producers contend for slots and often find the queue full
+    MpscQueue<Entry, 16> queue;
+    std::atomic<uint32_t> rejected {0};
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t producer = 0; producer < PRODUCERS; producer++)
+    {
+        producers.emplace_back([&queue, &rejected, producer, entries]() {
+            for (uint32_t sequence = 0; sequence < entries; sequence++)
+            {
+                Entry entry;
+                entry.producer = producer;
+                entry.sequence = sequence;
+                entry.check = check_value(producer, sequence);
+                while (!queue.push(std::move(entry)))
+                {
+                    rejected++;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint32_t> next(PRODUCERS, 0);
+    uint32_t received = 0;
+    uint32_t errors = 0;
+    Entry entry;
+    while (received < PRODUCERS * entries)
+    {
+        if (!queue.pop(entry))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        received++;
+        bool valid = (entry.producer < PRODUCERS) && (entry.check == check_value(entry.producer, entry.sequence));
+        if (!valid || (entry.sequence != next[entry.producer]))
+        {
+            //lost, duplicated, reordered or torn
+            errors++;
+            continue;
+        }
+        next[entry.producer]++;
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(errors == 0);
+    CHECK(!queue.pop(entry));
+    for (uint32_t producer = 0; producer < PRODUCERS; producer++)
+    {
+        CHECK(next[producer] == entries);
+    }
+    printf("%u producers, %u entries each, %u pushes rejected as full, %.0f entries/s\n", (unsigned) PRODUCERS,
+           (unsigned) entries, (unsigned) rejected.load(), received / seconds);
+    return host_test::result();
+}
@@ -0,0 +1,147 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Exhaustion and recovery of RxBufferPool, alone and inside the host sockets
+ *
+ * While every buffer is borrowed, receive() returns nothing and the datagrams wait in the
+ * kernel. Once the buffers are returned, also from another thread, all of them arrive in order.
+ *
+ *   rx_buffer_pool_test
+ */
+
+#include "host_test.h"
+
+#include "sip_client/epoll_udp_client.h"
+#include "sip_client/posix_udp_client.h"
+#include "sip_client/rx_buffer_pool.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+void check_pool()
+{
+    RxBufferPool<3, 64> pool;
+    std::vector<RxDatagram> borrowed;
+    size_t index = 0;
+    for (size_t i = 0; i < 3; i++)
+    {
+        CHECK(pool.acquire(index) && (index == i));
+        memcpy(pool.data(index), "abc", 3);
+        borrowed.push_back(pool.lend(index, 3));
+    }
+    CHECK(!pool.acquire(index));
+
+    //moving keeps the buffer borrowed, only the last owner returns it
+    RxDatagram moved(std::move(borrowed[1]));
+    CHECK(borrowed[1].empty());
+    CHECK(!pool.acquire(index));
+    borrowed[1] = std::move(moved);
+    CHECK(!pool.acquire(index));
+    CHECK(borrowed[1].view() == "abc");
+
+    //assigning over a datagram returns its buffer
+    borrowed[0] = RxDatagram();
+    CHECK(pool.acquire(index) && (index == 0));
+    CHECK(pool.lend(index, 0).empty());
+    CHECK(pool.acquire(index) && (index == 0));
+    pool.release(index);
+
+    //the SIP task may hand a datagram to another task, which returns the buffer
+    std::thread other([&borrowed]() { borrowed[2].release(); });
+    other.join();
+    CHECK(pool.acquire(index) && (index == 0));
+    CHECK(pool.acquire(index) && (index == 2));
+    CHECK(!pool.acquire(index));
+}
+
+template<class SocketT>
+void check_socket(const char* name)
+{
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(server, (sockaddr*) &address, sizeof(address)) == 0);
+    socklen_t length = sizeof(address);
+    getsockname(server, (sockaddr*) &address, &length);
+
+    //the client binds its own port, take one that is free
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in client_address = address;
+    client_address.sin_port = 0;
+    bind(probe, (sockaddr*) &client_address, sizeof(client_address));
+    getsockname(probe, (sockaddr*) &client_address, &length);
+    close(probe);
+
+    SocketT client("127.0.0.1", std::to_string(ntohs(address.sin_port)), ntohs(client_address.sin_port));
+    CHECK(client.init());
+
+    const size_t count = 40;
+    for (size_t i = 0; i < count; i++)
+    {
+        std::string data = "datagram " + std::to_string(i);
+        sendto(server, data.data(), data.size(), 0, (sockaddr*) &client_address, sizeof(client_address));
+    }
+
+    std::vector<RxDatagram> held;
+    for (;;)
+    {
+        RxDatagram datagram = client.receive(100);
+        if (datagram.empty())
+        {
+            break;
+        }
+        held.push_back(std::move(datagram));
+    }
+    size_t capacity = held.size();
+    CHECK((capacity > 0) && (capacity < count));
+    for (size_t i = 0; i < held.size(); i++)
+    {
+        CHECK(held[i].view() == ("datagram " + std::to_string(i)).c_str());
+    }
+
+    std::thread other([&held]() { held.clear(); });
+    other.join();
+    size_t received = capacity;
+    for (;;)
+    {
+        RxDatagram datagram = client.receive(100);
+        if (datagram.empty())
+        {
+            break;
+        }
+        CHECK(datagram.view() == ("datagram " + std::to_string(received)).c_str());
+        received++;
+    }
+    CHECK(received == count);
+    printf("%-14s %zu datagrams held at once, %zu of %zu received after returning them\n", name, capacity, received, count);
+    client.deinit();
+    close(server);
+}
+
+}
+
+int main()
+{
+    check_pool();
+    check_socket<PosixUdpClient>("PosixUdpClient");
+    check_socket<EpollUdpClient>("EpollUdpClient");
+    return host_test::result();
+}
@@ -0,0 +1,216 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Digest responses of SipDigest for MD5, SHA-256 and their -sess variants, with qop auth and auth-int
+ *
+ * SipDigest chooses its cnonce itself, so the responses are checked against a plain reference
+ * implementation with the nc and cnonce of each header. The reference reproduces the example of
+ * RFC 7616 section 3.9.1 and the other modes computed with Python's hashlib for the same input.
+ * authorize() must not allocate. Reports authorizations/s for each algorithm.
+ *
+ *   sip_digest_test [ITERATIONS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/host_hash.h"
+#include "sip_client/sip_digest.h"
+
+namespace {
+
+using DigestT = SipDigest<HostHash>;
+using Algorithm = DigestT::Algorithm;
+
+const char* const USER = "Mufasa";
+const char* const PASSWORD = "Circle of Life";
+const char* const REALM = "http-auth@example.org";
+const char* const NONCE = "7ypf/xlj9XXwfDPEoM4URrv/xwf94BcCAzFZH4GiTo0v";
+const char* const RFC_CNONCE = "f2/wE4q74E6zIJEtWaHKaf5wv/H5QzzpXusqGemxURZJ";
+const char* const URI = "/dir/index.html";
+const char* const BODY = "v=0\r\n";
+
+struct Vector {
+    Algorithm algorithm;
+    const char* qop;
+    const char* response;       ///< for GET with nc 00000001 and the cnonce of the RFC
+};
+
+//MD5 and SHA-256 with auth are the examples of RFC 7616 section 3.9.1, the others are from hashlib
+const Vector VECTORS[] = {
+    {Algorithm::MD5, "auth", "8ca523f5e9506fed4657c9700eebdbec"},
+    {Algorithm::MD5, "auth-int", "d1b8e2ac3f6782372de4bf3d8735b406"},
+    {Algorithm::MD5_SESS, "auth", "e783283f46242139c486a698fec7211d"},
+    {Algorithm::MD5_SESS, "auth-int", "4321e8772738f242cc32334079264d8c"},
+    {Algorithm::SHA256, "auth", "753927fa0e85d155564e2e272a28d1802ca10daf4496794697cf8db5856cb6c1"},
+    {Algorithm::SHA256, "auth-int", "385d2de062660ced11876f42d9497c69cacf5caaf3d951dd424aee9f7157d563"},
+    {Algorithm::SHA256_SESS, "auth", "2fd51b3a77ad75bad6afad6003e818d767133c46d9e2749e7f5232ae1ea3efd7"},
+    {Algorithm::SHA256_SESS, "auth-int", "cade7e5b751d9c3c2f066a95f2405c5509ad0171cf93f117e98b7f0ebb212e57"},
+};
+
+template<class HashFunctionT>
+std::string hex_digest(const std::string& input)
+{
+    HashFunctionT hash_function;
+    unsigned char result[HashFunctionT::SIZE];
+    hash_function.start();
+    hash_function.update(input.data(), input.size());
+    hash_function.finish(result);
+    std::string hex;
+    for (unsigned char byte : result)
+    {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", byte);
+        hex += digits;
+    }
+    return hex;
+}
+
+std::string hex_digest(Algorithm algorithm, const std::string& input)
+{
+    bool sha256 = (algorithm == Algorithm::SHA256) || (algorithm == Algorithm::SHA256_SESS);
+    return sha256 ? hex_digest<HostHash::Sha256>(input) : hex_digest<HostHash::Md5>(input);
+}
+
+/**
+ * RFC 7616 section 3.4 written out with strings
+ */
+std::string reference_response(Algorithm algorithm, const std::string& qop, const std::string& method, const std::string& nc,
+                               const std::string& cnonce)
+{
+    std::string ha1 = hex_digest(algorithm, std::string(USER) + ":" + REALM + ":" + PASSWORD);
+    if ((algorithm == Algorithm::MD5_SESS) || (algorithm == Algorithm::SHA256_SESS))
+    {
+        ha1 = hex_digest(algorithm, ha1 + ":" + NONCE + ":" + cnonce);
+    }
+    std::string a2 = method + ":" + URI;
+    if (qop == "auth-int")
+    {
+        a2 += ":" + hex_digest(algorithm, BODY);
+    }
+    return hex_digest(algorithm, ha1 + ":" + NONCE + ":" + nc + ":" + cnonce + ":" + qop + ":" + hex_digest(algorithm, a2));
+}
+
+std::string challenge_message(Algorithm algorithm, const char* qop)
+{
+    StringView name = DigestT::algorithm_name(algorithm);
+    return "SIP/2.0 401 Unauthorized\r\n"
+           "Via: SIP/2.0/UDP 192.168.179.30:5060;branch=z9hG4bK-1;rport\r\n"
+           "From: <sip:620@192.168.179.1>;tag=1\r\n"
+           "To: <sip:620@192.168.179.1>;tag=2\r\n"
+           "Call-ID: 1@192.168.179.30\r\n"
+           "CSeq: 1 REGISTER\r\n"
+           "WWW-Authenticate: Digest realm=\"" + std::string(REALM) + "\", nonce=\"" + NONCE + "\", algorithm="
+           + std::string(name.data(), name.size()) + ", qop=\"" + qop + "\"\r\n"
+           "Content-Length: 0\r\n"
+           "\r\n";
+}
+
+std::string param(StringView header, const char* name)
+{
+    StringView value = SipPacket::get_auth_param(header, name);
+    return std::string(value.data(), value.size());
+}
+
+/**
+ * \return the value of the header line without name and line end
+ */
+StringView header_value(const Buffer<512>& authorization)
+{
+    StringView line = authorization.view();
+    size_t colon = line.find(':');
+    return line.substr(colon + 1, line.size() - colon - 3).trim();
+}
+
+void check_vectors()
+{
+    for (const Vector& vector : VECTORS)
+    {
+        std::string response = reference_response(vector.algorithm, vector.qop, "GET", "00000001", RFC_CNONCE);
+        if (response != vector.response)
+        {
+            StringView name = DigestT::algorithm_name(vector.algorithm);
+            printf("reference %.*s %s: %s\n", (int) name.size(), name.data(), vector.qop, response.c_str());
+            host_test::failures()++;
+        }
+    }
+}
+
+void check_digest(const Vector& vector)
+{
+    std::string challenge = challenge_message(vector.algorithm, vector.qop);
+    SipPacket packet(challenge.data(), challenge.size());
+    CHECK(packet.parse());
+    DigestT digest(USER, PASSWORD);
+    CHECK(digest.on_challenge(packet));
+
+    Buffer<512> authorization;
+    for (const char* nc : {"00000001", "00000002"})
+    {
+        host_test::AllocationCounter counter;
+        CHECK(digest.authorize(SipPacket::Method::REGISTER, URI, BODY, authorization));
+        CHECK(counter.count() == 0);
+        StringView header = header_value(authorization);
+        StringView name = DigestT::algorithm_name(vector.algorithm);
+        CHECK(authorization.view().starts_with("Authorization: Digest "));
+        CHECK(param(header, "username") == USER);
+        CHECK(param(header, "realm") == REALM);
+        CHECK(param(header, "uri") == URI);
+        CHECK(SipPacket::get_auth_param(header, "algorithm") == name);
+        CHECK(param(header, "qop") == vector.qop);
+        CHECK(param(header, "nc") == nc);
+        std::string expected = reference_response(vector.algorithm, vector.qop, "REGISTER", nc, param(header, "cnonce"));
+        if (param(header, "response") != expected)
+        {
+            printf("%.*s %s nc=%s: %.*s\n", (int) name.size(), name.data(), vector.qop, nc, (int) authorization.size(),
+                   authorization.data());
+            host_test::failures()++;
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 50000;
+    check_vectors();
+    for (const Vector& vector : VECTORS)
+    {
+        check_digest(vector);
+    }
+
+    for (const Vector& vector : VECTORS)
+    {
+        std::string challenge = challenge_message(vector.algorithm, vector.qop);
+        SipPacket packet(challenge.data(), challenge.size());
+        packet.parse();
+        DigestT digest(USER, PASSWORD);
+        digest.on_challenge(packet);
+        Buffer<512> authorization;
+        volatile bool authorized = true;
+        host_test::AllocationCounter counter;
+        double ns = host_test::measure_ns(iterations, [&]() {
+            authorized = digest.authorize(SipPacket::Method::INVITE, URI, BODY, authorization) && authorized;
+        });
+        CHECK(authorized);
+        CHECK(counter.count() == 0);
+        StringView name = DigestT::algorithm_name(vector.algorithm);
+        printf("%-12.*s %-8s %7.0f ns/authorization, %6.0f authorizations/s\n", (int) name.size(), name.data(), vector.qop,
+               ns, 1e9 / ns);
+    }
+    return host_test::result();
+}
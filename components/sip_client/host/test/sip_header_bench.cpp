@@ -0,0 +1,166 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Classification of header names by SipPacket::convert_header() against the former strncmp chain
+ *
+ *   sip_header_bench [ITERATIONS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/sip_packet.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Header = SipPacket::Header;
+
+/**
+ * The header lines of an INVITE of a Fritzbox behind a proxy, 20 lines
+ */
+const char* const INVITE_LINES[] = {
+    "Via: SIP/2.0/UDP 192.168.179.1:5060;branch=z9hG4bKAAA",
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bKBBB",
+    "Record-Route: <sip:10.0.0.1;lr>",
+    "Max-Forwards: 69",
+    "From: <sip:**612@fritz.box>;tag=FROMTAG",
+    "To: <sip:620@fritz.box>",
+    "Call-ID: CALLID123@192.168.179.1",
+    "CSeq: 100 INVITE",
+    "Contact: <sip:**612@192.168.179.1:5060>",
+    "User-Agent: FRITZ!OS",
+    "Allow: INVITE, ACK, OPTIONS, CANCEL, BYE, UPDATE, PRACK, INFO, SUBSCRIBE, NOTIFY, REFER, MESSAGE",
+    "Allow-Events: telephone-event",
+    "Supported: replaces, timer",
+    "Session-Expires: 1800;refresher=uac",
+    "Min-SE: 90",
+    "Accept: application/sdp",
+    "Date: Sat, 13 Nov 2010 23:29:00 GMT",
+    "Subject: door",
+    "Content-Type: application/sdp",
+    "Content-Length: 171",
+};
+
+/**
+ * Header parsing before the hash table, only the names the client used to know
+ */
+Header strncmp_chain(const char* line)
+{
+    if ((strncmp("WWW-Authenticate", line, strlen("WWW-Authenticate")) == 0)
+        || (strncmp("Proxy-Authenticate", line, strlen("Proxy-Authenticate")) == 0))
+    {
+        return (line[0] == 'W') ? Header::WWW_AUTHENTICATE : Header::PROXY_AUTHENTICATE;
+    }
+    else if (strncmp("Contact: <", line, strlen("Contact: <")) == 0)
+    {
+        return Header::CONTACT;
+    }
+    else if (strncmp("To: ", line, strlen("To: ")) == 0)
+    {
+        return Header::TO;
+    }
+    else if (strstr(line, "From: ") == line)
+    {
+        return Header::FROM;
+    }
+    else if (strstr(line, "Via: ") == line)
+    {
+        return Header::VIA;
+    }
+    else if (strstr(line, "CSeq: ") == line)
+    {
+        return Header::C_SEQ;
+    }
+    else if (strstr(line, "Call-ID: ") == line)
+    {
+        return Header::CALL_ID;
+    }
+    else if (strstr(line, "Content-Type: ") == line)
+    {
+        return Header::CONTENT_TYPE;
+    }
+    else if (strstr(line, "Content-Length: ") == line)
+    {
+        return Header::CONTENT_LENGTH;
+    }
+    return Header::UNKNOWN;
+}
+
+Header classify(const char* line)
+{
+    StringView view(line);
+    return SipPacket::convert_header(view.substr(0, view.find(':')).trim());
+}
+
+void check_names()
+{
+    CHECK(SipPacket::convert_header("Via") == Header::VIA);
+    CHECK(SipPacket::convert_header("v") == Header::VIA);
+    CHECK(SipPacket::convert_header("V") == Header::VIA);
+    CHECK(SipPacket::convert_header("f") == Header::FROM);
+    CHECK(SipPacket::convert_header("t") == Header::TO);
+    CHECK(SipPacket::convert_header("i") == Header::CALL_ID);
+    CHECK(SipPacket::convert_header("m") == Header::CONTACT);
+    CHECK(SipPacket::convert_header("l") == Header::CONTENT_LENGTH);
+    CHECK(SipPacket::convert_header("c") == Header::CONTENT_TYPE);
+    CHECK(SipPacket::convert_header("call-id") == Header::CALL_ID);
+    CHECK(SipPacket::convert_header("CONTENT-LENGTH") == Header::CONTENT_LENGTH);
+    CHECK(SipPacket::convert_header("www-authenticate") == Header::WWW_AUTHENTICATE);
+    CHECK(SipPacket::convert_header("Proxy-Authenticate") == Header::PROXY_AUTHENTICATE);
+    CHECK(SipPacket::convert_header("X-Fritz-Foo") == Header::UNKNOWN);
+    CHECK(SipPacket::convert_header("Vi") == Header::UNKNOWN);
+    CHECK(SipPacket::convert_header("") == Header::UNKNOWN);
+
+    //both agree on the headers the chain knows
+    for (const char* line : INVITE_LINES)
+    {
+        Header expected = strncmp_chain(line);
+        if (expected != Header::UNKNOWN)
+        {
+            CHECK(classify(line) == expected);
+        }
+        CHECK(classify(line) != Header::UNKNOWN);
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 200000;
+    check_names();
+
+    const size_t lines = sizeof(INVITE_LINES) / sizeof(INVITE_LINES[0]);
+    volatile int sink = 0;
+    double chain_ns = host_test::measure_ns(iterations, [&]() {
+        for (const char* line : INVITE_LINES)
+        {
+            sink = sink + static_cast<int>(strncmp_chain(line));
+        }
+    });
+    double table_ns = host_test::measure_ns(iterations, [&]() {
+        for (const char* line : INVITE_LINES)
+        {
+            sink = sink + static_cast<int>(classify(line));
+        }
+    });
+    printf("%zu header lines: strncmp chain %.1f ns/line, hash table %.1f ns/line (including the search of the colon)\n",
+           lines, chain_ns / lines, table_ns / lines);
+    return host_test::result();
+}
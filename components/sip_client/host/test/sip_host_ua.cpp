@@ -0,0 +1,227 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * The door bell's SIP client on the host, driven by sip_stand_in.py
+ *
+ * Commands are read line by line from stdin, the events of the client are written to stdout:
+ *
+ *   ring NUMBER            request_ring()
+ *   group NUMBER,NUMBER    request_ring_group()
+ *   cancel                 request_cancel()
+ *   hangup                 request_hang_up()
+ *   quit
+ *
+ *   event CALL_START dialog=0 target=0 reason=UNKNOWN status=0
+ */
+
+#include "sip_client/epoll_udp_client.h"
+#include "sip_client/host_hash.h"
+#include "sip_client/posix_udp_client.h"
+#include "sip_client/sip_client.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string server_port = "5060";
+    bool epoll = false;
+    uint32_t expires_sec = 600;
+    uint32_t keep_alive_sec = 0;
+    uint32_t keep_alive_max_lost = 2;
+};
+
+const char* event_name(SipClientEvent::Event event)
+{
+    switch (event)
+    {
+    case SipClientEvent::Event::CALL_START:
+        return "CALL_START";
+    case SipClientEvent::Event::CALL_CANCELLED:
+        return "CALL_CANCELLED";
+    case SipClientEvent::Event::CALL_END:
+        return "CALL_END";
+    case SipClientEvent::Event::BUTTON_PRESS:
+        return "BUTTON_PRESS";
+    case SipClientEvent::Event::REGISTERED:
+        return "REGISTERED";
+    case SipClientEvent::Event::REGISTRATION_FAILED:
+        return "REGISTRATION_FAILED";
+    case SipClientEvent::Event::TARGET_CANCELLED:
+        return "TARGET_CANCELLED";
+    }
+    return "UNKNOWN";
+}
+
+const char* reason_name(SipClientEvent::CancelReason reason)
+{
+    switch (reason)
+    {
+    case SipClientEvent::CancelReason::UNKNOWN:
+        return "UNKNOWN";
+    case SipClientEvent::CancelReason::CALL_DECLINED:
+        return "CALL_DECLINED";
+    case SipClientEvent::CancelReason::TARGET_BUSY:
+        return "TARGET_BUSY";
+    case SipClientEvent::CancelReason::CALL_CANCELLED:
+        return "CALL_CANCELLED";
+    case SipClientEvent::CancelReason::TARGET_UNAVAILABLE:
+        return "TARGET_UNAVAILABLE";
+    case SipClientEvent::CancelReason::MEDIA_NOT_ACCEPTABLE:
+        return "MEDIA_NOT_ACCEPTABLE";
+    case SipClientEvent::CancelReason::ANSWERED_ELSEWHERE:
+        return "ANSWERED_ELSEWHERE";
+    }
+    return "UNKNOWN";
+}
+
+std::vector<std::string> split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(separator, start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        if (end > start)
+        {
+            parts.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+template <class SocketT>
+int run_client(const Options& options)
+{
+    //never destroyed, the threads below run until the process exits
+    auto* client = new SipClient<SocketT, HostHash>{"620", "secret", "127.0.0.1", options.server_port, "127.0.0.1"};
+    if (!client->init())
+    {
+        fprintf(stderr, "Binding the SIP and RTP ports failed\n");
+        return 1;
+    }
+    client->set_registration_timing(options.expires_sec, 0);
+    client->set_keep_alive(SipKeepAlive::Mode::OPTIONS, options.keep_alive_sec, options.keep_alive_max_lost);
+
+    std::thread([client]() {
+        for (;;)
+        {
+            client->run();
+        }
+    }).detach();
+
+    std::thread([client]() {
+        SipClientEvent event;
+        for (;;)
+        {
+            if (!client->wait_event(event, portMAX_DELAY))
+            {
+                continue;
+            }
+            printf("event %s dialog=%d target=%d reason=%s status=%d\n", event_name(event.event), (int) event.dialog,
+                   (int) event.target, reason_name(event.cancel_reason), (int) event.status_code);
+            fflush(stdout);
+        }
+    }).detach();
+
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        std::vector<std::string> words = split(line, ' ');
+        if (words.empty())
+        {
+            continue;
+        }
+        if ((words[0] == "ring") && (words.size() == 2))
+        {
+            client->request_ring(words[1], "door bell");
+        }
+        else if ((words[0] == "group") && (words.size() == 2))
+        {
+            client->request_ring_group(split(words[1], ','), "door bell");
+        }
+        else if (words[0] == "cancel")
+        {
+            client->request_cancel();
+        }
+        else if (words[0] == "hangup")
+        {
+            client->request_hang_up();
+        }
+        else if (words[0] == "quit")
+        {
+            break;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown command: %s\n", line.c_str());
+        }
+    }
+    //the SIP task blocks in run(), the process ends without joining it
+    fflush(stdout);
+    std::_Exit(0);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: sip_host_ua [--epoll] [--expires SEC] [--keep-alive SEC,MAX_LOST] SERVER_PORT\n");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--epoll") == 0)
+        {
+            options.epoll = true;
+        }
+        else if ((strcmp(argv[i], "--expires") == 0) && (i + 1 < argc))
+        {
+            options.expires_sec = strtoul(argv[++i], nullptr, 10);
+        }
+        else if ((strcmp(argv[i], "--keep-alive") == 0) && (i + 1 < argc))
+        {
+            std::vector<std::string> values = split(argv[++i], ',');
+            options.keep_alive_sec = values.empty() ? 0 : strtoul(values[0].c_str(), nullptr, 10);
+            options.keep_alive_max_lost = (values.size() < 2) ? 0 : strtoul(values[1].c_str(), nullptr, 10);
+        }
+        else if (argv[i][0] != '-')
+        {
+            options.server_port = argv[i];
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    return options.epoll ? run_client<EpollUdpClient>(options) : run_client<PosixUdpClient>(options);
+}
@@ -0,0 +1,301 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Construction of REGISTER, INVITE, ACK and CANCEL in ns/message
+ *
+ * Compares the former strlen/strncat/snprintf Buffer, Buffer with its write position and
+ * SipMessageTemplate, which the client uses. All three must produce the same text.
+ *
+ *   sip_message_bench [ITERATIONS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/sip_message_template.h"
+
+#include <random>
+
+namespace {
+
+/**
+ * Buffer before it tracked its write position
+ */
+template<std::size_t SIZE>
+class LegacyBuffer
+{
+public:
+    LegacyBuffer()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_buffer[0] = '\0';
+    }
+
+    LegacyBuffer<SIZE>& operator<<(const char* str)
+    {
+        strncat(m_buffer.data(), str, m_buffer.size() - strlen(m_buffer.data()) - 1);
+        return *this;
+    }
+    LegacyBuffer<SIZE>& operator<<(const std::string& str)
+    {
+        strncat(m_buffer.data(), str.c_str(), m_buffer.size() - strlen(m_buffer.data()) - 1);
+        return *this;
+    }
+    LegacyBuffer<SIZE>& operator<<(uint32_t i)
+    {
+        snprintf(m_buffer.data() + strlen(m_buffer.data()), m_buffer.size() - strlen(m_buffer.data()), "%u", (unsigned) i);
+        return *this;
+    }
+
+    const char* data() const
+    {
+        return m_buffer.data();
+    }
+
+    size_t size() const
+    {
+        return strlen(m_buffer.data());
+    }
+
+private:
+    std::array<char, SIZE> m_buffer;
+};
+
+using TemplateT = SipMessageTemplate<1024>;
+using Slot = TemplateT::Slot;
+
+/**
+ * The values of one call, strings as the client keeps them
+ */
+struct Call {
+    std::string user = "620";
+    std::string server_ip = "192.168.179.1";
+    std::string my_ip = "192.168.179.30";
+    std::string uri = "sip:**611@192.168.179.1";
+    std::string display = "Door bell";
+    std::string call_id = "1804289383@192.168.179.30";
+    std::string remote_tag = "7E4B2A1C9D";
+    std::string authorization = "Authorization: Digest username=\"620\", realm=\"fritz.box\", nonce=\"6A8C2E4F10B3D5A7\", "
+                                "uri=\"sip:**611@192.168.179.1\", response=\"0123456789abcdef0123456789abcdef\", algorithm=MD5\r\n";
+    std::string sdp = "v=0\r\no=- 846930886 846930886 IN IP4 192.168.179.30\r\ns=sip-client/0.0.1\r\nc=IN IP4 192.168.179.30\r\n"
+                      "t=0 0\r\nm=audio 7078 RTP/AVP 0 8 101\r\na=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\n"
+                      "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-15\r\na=ptime:20\r\na=sendrecv\r\n";
+    uint32_t cseq = 1681692777;
+    uint32_t branch = 1714636915;
+    uint32_t tag = 1957747793;
+};
+
+/**
+ * Write the values of slot, the template renders them into the marked positions instead
+ */
+template<class BufferT>
+void slot(BufferT& buffer, Slot slot, const Call& call, const char* method)
+{
+    switch (slot)
+    {
+    case Slot::CSEQ:
+        buffer << call.cseq;
+        break;
+    case Slot::BRANCH:
+        buffer << call.branch;
+        break;
+    case Slot::TAG:
+        buffer << call.tag;
+        break;
+    case Slot::TO_TAG:
+        buffer << ";tag=" << call.remote_tag;
+        break;
+    case Slot::AUTHORIZATION:
+        buffer << call.authorization;
+        break;
+    case Slot::CONTENT_LENGTH:
+        buffer << static_cast<uint32_t>((strcmp(method, "INVITE") == 0) ? call.sdp.size() : 0);
+        break;
+    }
+}
+
+void slot(TemplateT& request, Slot slot, const Call&, const char*)
+{
+    request << slot;
+}
+
+/**
+ * A request like SipClientInt renders it, the same code writes a buffer or a template
+ */
+template<class BufferT>
+void build(BufferT& buffer, const char* method, const Call& call)
+{
+    bool invite = (strcmp(method, "INVITE") == 0);
+    bool ack = (strcmp(method, "ACK") == 0);
+    bool reg = (strcmp(method, "REGISTER") == 0);
+    buffer << method << " ";
+    if (reg)
+    {
+        buffer << "sip:" << call.server_ip;
+    }
+    else
+    {
+        buffer << call.uri;
+    }
+    buffer << " SIP/2.0\r\n";
+    buffer << "CSeq: ";
+    slot(buffer, Slot::CSEQ, call, method);
+    buffer << " " << method << "\r\n";
+    buffer << "Call-ID: " << call.call_id << "\r\n";
+    buffer << "Max-Forwards: 70\r\n";
+    buffer << "User-Agent: sip-client/0.0.1\r\n";
+    buffer << "From: \"" << call.display << "\" <sip:" << call.user << "@" << call.server_ip << ">;tag=";
+    slot(buffer, Slot::TAG, call, method);
+    buffer << "\r\n";
+    buffer << "Via: SIP/2.0/UDP " << call.my_ip << ":" << static_cast<uint32_t>(5060) << ";branch=z9hG4bK-";
+    slot(buffer, Slot::BRANCH, call, method);
+    buffer << ";rport\r\n";
+    buffer << "To: <";
+    if (reg)
+    {
+        buffer << "sip:" << call.user << "@" << call.server_ip;
+    }
+    else
+    {
+        buffer << call.uri;
+    }
+    buffer << ">";
+    if (ack)
+    {
+        slot(buffer, Slot::TO_TAG, call, method);
+    }
+    buffer << "\r\n";
+    if (reg || invite)
+    {
+        buffer << "Contact: \"" << call.user << "\" <sip:" << call.user << "@" << call.my_ip << ":" << static_cast<uint32_t>(5060)
+               << ";transport=udp>\r\n";
+    }
+    if (!ack)
+    {
+        slot(buffer, Slot::AUTHORIZATION, call, method);
+    }
+    if (invite)
+    {
+        buffer << "Content-Type: application/sdp\r\n";
+    }
+    if (reg || invite)
+    {
+        buffer << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n";
+    }
+    if (reg)
+    {
+        buffer << "Expires: " << static_cast<uint32_t>(600) << "\r\n";
+    }
+    buffer << "Content-Length: ";
+    slot(buffer, Slot::CONTENT_LENGTH, call, method);
+    buffer << "\r\n\r\n";
+}
+
+template<class BufferT>
+void build_message(BufferT& buffer, const char* method, const Call& call)
+{
+    buffer.clear();
+    build(buffer, method, call);
+    if (strcmp(method, "INVITE") == 0)
+    {
+        buffer << call.sdp;
+    }
+}
+
+void render_message(TxBufferT& buffer, const TemplateT& request, const char* method, const Call& call)
+{
+    TemplateT::SlotValues values;
+    values.cseq = call.cseq;
+    values.branch = call.branch;
+    values.tag = call.tag;
+    values.to_tag = StringView(call.remote_tag);
+    values.authorization = StringView(call.authorization);
+    bool invite = (strcmp(method, "INVITE") == 0);
+    values.content_length = invite ? call.sdp.size() : 0;
+    buffer.clear();
+    request.render(buffer, values);
+    if (invite)
+    {
+        buffer << call.sdp;
+    }
+}
+
+void check_integers()
+{
+    std::mt19937 random(1);
+    for (size_t i = 0; i < 100000; i++)
+    {
+        uint32_t value = (i < 64) ? ((i < 32) ? (1u << i) - 1 : (1u << (i - 32))) : static_cast<uint32_t>(random() >> (random() % 32));
+        char expected[16];
+        snprintf(expected, sizeof(expected), "%u", (unsigned) value);
+        Buffer<16> buffer;
+        buffer << value;
+        if (buffer.view() != expected)
+        {
+            printf("%u formatted as %s\n", (unsigned) value, buffer.data());
+            host_test::failures()++;
+            return;
+        }
+    }
+    Buffer<16> max;
+    max << UINT32_MAX;
+    CHECK(max.view() == "4294967295");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100000;
+    Call call;
+    check_integers();
+
+    Buffer<256> small;
+    build_message(small, "INVITE", call);
+    CHECK(small.is_overflow());
+
+    const char* const methods[] = {"REGISTER", "INVITE", "ACK", "CANCEL"};
+    for (const char* method : methods)
+    {
+        LegacyBuffer<TX_BUFFER_SIZE> legacy;
+        TxBufferT buffer;
+        TxBufferT rendered;
+        TemplateT request;
+        build(request, method, call);
+        CHECK(!request.is_overflow());
+
+        host_test::AllocationCounter counter;
+        build_message(buffer, method, call);
+        render_message(rendered, request, method, call);
+        size_t allocations = counter.count();
+        build_message(legacy, method, call);
+        CHECK(!buffer.is_overflow());
+        CHECK(buffer.view() == legacy.data());
+        CHECK(rendered.view() == legacy.data());
+        CHECK(allocations == 0);
+
+        double legacy_ns = host_test::measure_ns(iterations, [&]() { build_message(legacy, method, call); });
+        double buffer_ns = host_test::measure_ns(iterations, [&]() { build_message(buffer, method, call); });
+        double template_ns = host_test::measure_ns(iterations, [&]() { render_message(rendered, request, method, call); });
+        printf("%-8s %4zu byte: strncat %7.1f ns, write position %6.1f ns, template %6.1f ns\n", method, buffer.size(),
+               legacy_ns, buffer_ns, template_ns);
+    }
+    return host_test::result();
+}
@@ -0,0 +1,119 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Parses the Fritzbox messages of corpus/ with SipPacket
+ *
+ * Checks that the parser does not allocate and does not modify the input and reports ns/packet.
+ *
+ *   sip_packet_bench CORPUS_DIR [ITERATIONS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/sip_packet.h"
+
+#include <vector>
+
+namespace {
+
+struct CorpusMessage {
+    const char* name;
+    uint16_t status_code;           ///< 0 for a request
+    SipPacket::Method method;       ///< of the request line or the CSeq
+    std::string data;
+};
+
+void check_message(const CorpusMessage& message)
+{
+    std::string copy = message.data;
+    host_test::AllocationCounter counter;
+    SipPacket packet(message.data.data(), message.data.size());
+    bool parsed = packet.parse();
+    size_t allocations = counter.count();
+
+    printf("%-12s %zu byte, %zu allocations\n", message.name, message.data.size(), allocations);
+    CHECK(parsed);
+    CHECK(allocations == 0);
+    CHECK(copy == message.data);
+    CHECK(packet.get_status_code() == message.status_code);
+    CHECK(((message.status_code == 0) ? packet.get_method() : packet.get_cseq_method()) == message.method);
+    CHECK(!packet.get_call_id().empty());
+    CHECK(!packet.get_branch().empty());
+    CHECK(packet.get_body().size() == packet.get_content_length());
+}
+
+void check_to_uint()
+{
+    uint32_t value = 0;
+    CHECK(StringView("4294967295").to_uint(value) && (value == UINT32_MAX));
+    CHECK(!StringView("4294967296").to_uint(value));
+    CHECK(!StringView("99999999999999999999").to_uint(value));
+    CHECK(StringView("0042;x").to_uint(value) && (value == 42));
+
+    //a Content-Length that wraps around must not frame a short body
+    std::string huge = "SIP/2.0 200 OK\r\nCSeq: 1 OPTIONS\r\nContent-Length: 4294967297\r\n\r\nx";
+    SipPacket packet(huge.data(), huge.size());
+    packet.parse();
+    CHECK(packet.get_content_length() != 1);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: sip_packet_bench CORPUS_DIR [ITERATIONS]\n");
+        return 2;
+    }
+    std::string dir = std::string(argv[1]) + "/";
+    size_t iterations = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 20000;
+
+    std::vector<CorpusMessage> corpus = {
+        {"register", 0, SipPacket::Method::REGISTER, ""},
+        {"401", 401, SipPacket::Method::REGISTER, ""},
+        {"200reg", 200, SipPacket::Method::REGISTER, ""},
+        {"407", 407, SipPacket::Method::INVITE, ""},
+        {"183", 183, SipPacket::Method::INVITE, ""},
+        {"200inv", 200, SipPacket::Method::INVITE, ""},
+        {"invite", 0, SipPacket::Method::INVITE, ""},
+        {"bye", 0, SipPacket::Method::BYE, ""},
+        {"info", 0, SipPacket::Method::INFO, ""},
+    };
+    size_t total_size = 0;
+    for (CorpusMessage& message : corpus)
+    {
+        message.data = host_test::read_file(dir + message.name + ".sip");
+        total_size += message.data.size();
+        check_message(message);
+    }
+    check_to_uint();
+
+    host_test::AllocationCounter counter;
+    volatile bool parsed = true;
+    double ns = host_test::measure_ns(iterations, [&]() {
+        for (const CorpusMessage& message : corpus)
+        {
+            SipPacket packet(message.data.data(), message.data.size());
+            parsed = packet.parse() && parsed;
+        }
+    });
+    CHECK(parsed);
+    printf("%zu messages, %.0f byte on average: %.1f ns/packet, %zu byte allocated in %zu iterations\n", corpus.size(),
+           (double) total_size / corpus.size(), ns / corpus.size(), counter.bytes(), iterations);
+    return host_test::result();
+}
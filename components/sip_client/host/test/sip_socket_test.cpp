@@ -0,0 +1,261 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * PosixUdpClient and EpollUdpClient against the interface of sip_socket.h
+ *
+ * Each socket talks to a local UDP server over the loopback interface: send, receive, timeout,
+ * wake() from another thread and before receive(), an oversized message and deinit(). Then the
+ * server echoes batches of datagrams and the round trips per second are reported.
+ *
+ *   sip_socket_test [ROUND_TRIPS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/epoll_udp_client.h"
+#include "sip_client/posix_udp_client.h"
+#include "sip_client/sip_socket.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <sys/time.h>
+
+static_assert(IsSipSocket<PosixUdpClient>::value, "PosixUdpClient does not provide the interface of sip_socket.h");
+static_assert(IsSipSocket<EpollUdpClient>::value, "EpollUdpClient does not provide the interface of sip_socket.h");
+
+namespace {
+
+/**
+ * Everything except wake()
+ */
+struct SleepingSocket {
+    static constexpr uint32_t RECEIVE_FOREVER = UINT32_MAX;
+    SleepingSocket(const std::string&, const std::string&, uint16_t) {}
+    bool init() { return true; }
+    void deinit() {}
+    bool is_initialized() const { return true; }
+    void set_server_ip(const std::string&) {}
+    RxDatagram receive(uint32_t) { return RxDatagram(); }
+    TxBufferT& get_new_tx_buf() { return m_buffer; }
+    bool send_buffered_data() { return true; }
+    TxBufferT m_buffer;
+};
+
+static_assert(!IsSipSocket<SleepingSocket>::value, "a socket without wake() is accepted");
+static_assert(!IsSipSocket<int>::value, "int is accepted as socket");
+
+constexpr size_t BATCH = 16;
+
+/**
+ * Plain UDP socket on 127.0.0.1 with an ephemeral port
+ */
+class LoopbackSocket
+{
+public:
+    LoopbackSocket()
+    : m_socket(socket(AF_INET, SOCK_DGRAM, 0))
+    {
+        sockaddr_in address = loopback(0);
+        CHECK(bind(m_socket, (sockaddr*) &address, sizeof(address)) == 0);
+        socklen_t length = sizeof(address);
+        getsockname(m_socket, (sockaddr*) &address, &length);
+        m_port = ntohs(address.sin_port);
+        set_timeout_msec(1000);
+    }
+
+    ~LoopbackSocket()
+    {
+        close(m_socket);
+    }
+
+    static sockaddr_in loopback(uint16_t port)
+    {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        return address;
+    }
+
+    void set_timeout_msec(uint32_t msec)
+    {
+        timeval timeout;
+        timeout.tv_sec = msec / 1000;
+        timeout.tv_usec = (msec % 1000) * 1000;
+        setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    /**
+     * \return the datagram, empty on timeout
+     */
+    std::string receive(uint16_t* from_port = nullptr)
+    {
+        char data[RX_BUFFER_SIZE];
+        sockaddr_in from;
+        socklen_t length = sizeof(from);
+        ssize_t size = recvfrom(m_socket, data, sizeof(data), 0, (sockaddr*) &from, &length);
+        if (size < 0)
+        {
+            return std::string();
+        }
+        if (from_port != nullptr)
+        {
+            *from_port = ntohs(from.sin_port);
+        }
+        return std::string(data, size);
+    }
+
+    void send(const std::string& data, uint16_t port)
+    {
+        sockaddr_in address = loopback(port);
+        sendto(m_socket, data.data(), data.size(), 0, (sockaddr*) &address, sizeof(address));
+    }
+
+    uint16_t port() const
+    {
+        return m_port;
+    }
+
+private:
+    int m_socket;
+    uint16_t m_port = 0;
+};
+
+/**
+ * \return a local port that was free a moment ago, the sockets bind their port themselves
+ */
+uint16_t free_port()
+{
+    LoopbackSocket probe;
+    return probe.port();
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<class SocketT>
+void send(SocketT& socket, const char* text)
+{
+    TxBufferT& tx_buffer = socket.get_new_tx_buf();
+    tx_buffer << text;
+    CHECK(socket.send_buffered_data());
+}
+
+template<class SocketT>
+void check_socket(const char* name, size_t round_trips)
+{
+    LoopbackSocket server;
+    uint16_t local_port = free_port();
+    SocketT socket("127.0.0.1", std::to_string(server.port()), local_port);
+    CHECK(!socket.is_initialized());
+    CHECK(socket.init());
+    CHECK(socket.is_initialized());
+
+    //a socket may defer sending until the next receive()
+    send(socket, "OPTIONS sip:server SIP/2.0\r\n\r\n");
+    CHECK(socket.receive(0).empty());
+    uint16_t from_port = 0;
+    CHECK(server.receive(&from_port) == "OPTIONS sip:server SIP/2.0\r\n\r\n");
+    CHECK(from_port == local_port);
+
+    server.send("SIP/2.0 200 OK\r\n\r\n", local_port);
+    RxDatagram datagram = socket.receive(1000);
+    CHECK(datagram.view() == "SIP/2.0 200 OK\r\n\r\n");
+    datagram.release();
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK(socket.receive(50).empty());
+    double timeout_ms = elapsed_ms(start);
+    CHECK((timeout_ms >= 45) && (timeout_ms < 500));
+
+    //a wake-up before receive() is kept
+    socket.wake();
+    start = std::chrono::steady_clock::now();
+    CHECK(socket.receive(SocketT::RECEIVE_FOREVER).empty());
+    CHECK(elapsed_ms(start) < 100);
+
+    std::thread waker([&socket]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        socket.wake();
+    });
+    start = std::chrono::steady_clock::now();
+    CHECK(socket.receive(SocketT::RECEIVE_FOREVER).empty());
+    double wake_ms = elapsed_ms(start);
+    waker.join();
+    CHECK((wake_ms >= 45) && (wake_ms < 500));
+
+    TxBufferT& oversized = socket.get_new_tx_buf();
+    oversized << std::string(TX_BUFFER_SIZE + 1, 'x');
+    CHECK(!socket.send_buffered_data());
+    socket.receive(0);
+    server.set_timeout_msec(50);
+    CHECK(server.receive().empty());
+
+    //echo server, each round sends a batch and waits for all answers
+    server.set_timeout_msec(1000);
+    std::thread echo([&server, local_port, round_trips]() {
+        for (size_t i = 0; i < round_trips; i++)
+        {
+            std::string data = server.receive();
+            if (data.empty())
+            {
+                break;
+            }
+            server.send(data, local_port);
+        }
+    });
+    size_t answered = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t sent = 0; sent < round_trips; sent += BATCH)
+    {
+        size_t batch = std::min(BATCH, round_trips - sent);
+        for (size_t i = 0; i < batch; i++)
+        {
+            send(socket, "OPTIONS sip:server SIP/2.0\r\nCSeq: 1 OPTIONS\r\nContent-Length: 0\r\n\r\n");
+        }
+        for (size_t i = 0; i < batch; i++)
+        {
+            RxDatagram answer = socket.receive(1000);
+            if (answer.empty())
+            {
+                break;
+            }
+            answered++;
+        }
+    }
+    double seconds = elapsed_ms(start) / 1000;
+    echo.join();
+    CHECK(answered == round_trips);
+    printf("%-14s timeout %5.1f ms, wake %5.1f ms, %7.0f round trips/s\n", name, timeout_ms, wake_ms, answered / seconds);
+
+    socket.deinit();
+    CHECK(!socket.is_initialized());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t round_trips = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 20000;
+    check_socket<PosixUdpClient>("PosixUdpClient", round_trips);
+    check_socket<EpollUdpClient>("EpollUdpClient", round_trips);
+    return host_test::result();
+}
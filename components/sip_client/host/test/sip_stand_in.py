@@ -0,0 +1,608 @@
+#!/usr/bin/env python3
+#
+#   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+
+"""
+Local stand-in for the Fritzbox: SIP registrar, proxy and the called phones
+
+The stand-in starts sip_host_ua with the port of its own UDP socket, sends commands to its stdin and reads the
+events from its stdout. A scenario is a function that scripts both sides and checks what the client sends and
+when. Messages that a scenario does not wait for are answered like a registrar would (see StandIn.serve()).
+
+    sip_stand_in.py --ua build/sip_host_ua flow
+
+The log of the client is written to SCENARIO.log in the working directory.
+"""
+
+import argparse
+import hashlib
+import queue
+import random
+import re
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+USER = "620"
+PASSWORD = "secret"
+UA_ADDRESS = ("127.0.0.1", 5060)
+
+COMPACT_HEADERS = {
+    "v": "via", "f": "from", "t": "to", "i": "call-id", "m": "contact", "l": "content-length", "c": "content-type",
+}
+
+HASHES = {"MD5": hashlib.md5, "SHA-256": hashlib.sha256}
+
+SDP_ANSWER = ("v=0\r\n"
+              "o=- 1 1 IN IP4 127.0.0.1\r\n"
+              "s=-\r\n"
+              "c=IN IP4 127.0.0.1\r\n"
+              "t=0 0\r\n"
+              "m=audio 7080 RTP/AVP 8 101\r\n"
+              "a=rtpmap:8 PCMA/8000\r\n"
+              "a=rtpmap:101 telephone-event/8000\r\n")
+
+
+class Failure(Exception):
+    pass
+
+
+def check(condition, message):
+    if not condition:
+        raise Failure(message)
+
+
+class Message:
+    """A received SIP message, header names are compared in lower case"""
+
+    def __init__(self, data, received):
+        self.data = data
+        self.time = received
+        text = data.decode("utf-8", "replace")
+        head, _, self.body = text.partition("\r\n\r\n")
+        lines = head.split("\r\n")
+        self.start_line = lines[0]
+        self.headers = []
+        for line in lines[1:]:
+            name, _, value = line.partition(":")
+            name = name.strip().lower()
+            self.headers.append((COMPACT_HEADERS.get(name, name), value.strip()))
+        parts = self.start_line.split(" ", 2)
+        self.is_response = parts[0] == "SIP/2.0"
+        self.status = int(parts[1]) if self.is_response else 0
+        self.method = "" if self.is_response else parts[0]
+        self.uri = "" if self.is_response else parts[1]
+        cseq = self.header("cseq").split()
+        self.cseq = int(cseq[0]) if cseq else 0
+        self.cseq_method = cseq[1] if len(cseq) > 1 else ""
+
+    def header(self, name):
+        for header, value in self.headers:
+            if header == name:
+                return value
+        return ""
+
+    def all(self, name):
+        return [value for header, value in self.headers if header == name]
+
+    def tag(self, name):
+        match = re.search(r";tag=([^;>\s]+)", self.header(name))
+        return match.group(1) if match else ""
+
+    def branch(self):
+        match = re.search(r";branch=([^;\s]+)", self.header("via"))
+        return match.group(1) if match else ""
+
+    def matches(self, what):
+        """what is a method, a status code, or "status method" for a response to a request of that method"""
+        if isinstance(what, int):
+            return self.status == what
+        if " " in what:
+            status, method = what.split(" ", 1)
+            return self.is_response and (self.status == int(status)) and (self.cseq_method == method)
+        return self.method == what
+
+    def __str__(self):
+        return self.start_line + " (CSeq " + self.header("cseq") + ")"
+
+
+def digest_params(value):
+    scheme, _, params = value.partition(" ")
+    check(scheme == "Digest", "not a digest: " + value)
+    return {key: (quoted if quoted else plain)
+            for key, quoted, plain in re.findall(r'([\w-]+)\s*=\s*(?:"([^"]*)"|([^\s,]*))', params)}
+
+
+class StandIn:
+    """One client and its server side, see the module description"""
+
+    def __init__(self, ua, ua_args, name, loss=0.0, seed=1):
+        self.ua_path = ua
+        self.ua_args = ua_args
+        self.name = name
+        self.loss = loss
+        self.random = random.Random(seed)
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.bind(("127.0.0.1", 0))
+        self.port = self.socket.getsockname()[1]
+        self.events = queue.Queue()
+        self.process = None
+        self.log = None
+        self.nonce_count = 0
+        self.nonces = {}                # realm -> (nonce, algorithm, qop)
+        self.registrations = 0
+        self.register_expires = 600
+        self.handlers = {}              # method -> function(message), replaces serve() for that method
+        self.received = []
+        self.sent = []
+        self.sent_time = None           # of the last datagram that was not lost
+        self.start = time.monotonic()
+
+    # client side
+
+    def launch(self, *extra_args):
+        self.log = open(self.name + ".log", "w")
+        self.process = subprocess.Popen([self.ua_path] + list(self.ua_args) + list(extra_args) + [str(self.port)],
+                                        stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=self.log,
+                                        universal_newlines=True, bufsize=1)
+        threading.Thread(target=self._read_events, daemon=True).start()
+
+    def stop(self):
+        if self.process is None:
+            return
+        try:
+            self.process.stdin.write("quit\n")
+            self.process.stdin.flush()
+            self.process.wait(2)
+        except (OSError, subprocess.TimeoutExpired):
+            self.process.kill()
+            self.process.wait()
+        self.log.close()
+
+    def _read_events(self):
+        for line in self.process.stdout:
+            words = line.split()
+            if words and words[0] == "event":
+                fields = dict(word.split("=", 1) for word in words[2:])
+                fields["event"] = words[1]
+                fields["time"] = time.monotonic()
+                self.events.put(fields)
+
+    def command(self, line):
+        """Send a command to the client, returns the time it was sent"""
+        self.process.stdin.write(line + "\n")
+        self.process.stdin.flush()
+        return time.monotonic()
+
+    def expect_event(self, name, timeout=5.0, unexpected=()):
+        """Wait for an event of the client, SIP messages in the meantime are served, the unexpected events fail"""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            try:
+                event = self.events.get_nowait()
+            except queue.Empty:
+                message = self.receive(0.01)
+                if message is not None:
+                    self.serve(message)
+                continue
+            if event["event"] == name:
+                return event
+            if event["event"] in unexpected:
+                raise Failure("event %s before %s" % (event["event"], name))
+            self.note("ignoring event " + event["event"])
+        raise Failure("no event %s within %.1f s" % (name, timeout))
+
+    # network
+
+    def receive(self, timeout):
+        """Next datagram from the client or None, lost datagrams are dropped here"""
+        self.socket.settimeout(max(timeout, 0.001))
+        try:
+            data, _ = self.socket.recvfrom(65536)
+        except socket.timeout:
+            return None
+        if self.lost():
+            self.note("lost " + data.split(b"\r\n", 1)[0].decode())
+            return None
+        if data.strip() == b"":
+            return Message(b"PING * SIP/2.0\r\n\r\n", time.monotonic())
+        message = Message(data, time.monotonic())
+        self.received.append(message)
+        return message
+
+    def lost(self):
+        return (self.loss > 0) and (self.random.random() < self.loss)
+
+    def send(self, text):
+        """Send a datagram to the client, returns False if it was lost"""
+        self.sent.append(text)
+        if self.lost():
+            self.note("lost " + text.split("\r\n", 1)[0])
+            return False
+        self.socket.sendto(text.encode(), UA_ADDRESS)
+        self.sent_time = time.monotonic()
+        return True
+
+    def expect(self, what, timeout=2.0):
+        """Wait for a message, others are served in the meantime"""
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise Failure("no %s within %.1f s" % (what, timeout))
+            message = self.receive(remaining)
+            if message is None:
+                continue
+            if message.matches(what):
+                return message
+            self.serve(message)
+
+    def idle(self, duration):
+        """Serve the client for a while"""
+        deadline = time.monotonic() + duration
+        while time.monotonic() < deadline:
+            message = self.receive(deadline - time.monotonic())
+            if message is not None:
+                self.serve(message)
+
+    def reply(self, request, status, reason, headers=(), body="", tag="stand-in"):
+        to = request.header("to")
+        if (status > 100) and (";tag=" not in to):
+            to += ";tag=" + tag
+        lines = ["SIP/2.0 %d %s" % (status, reason)]
+        lines += ["Via: " + via for via in request.all("via")]
+        lines += ["From: " + request.header("from"), "To: " + to, "Call-ID: " + request.header("call-id"),
+                  "CSeq: " + request.header("cseq")]
+        if (request.method == "INVITE") and (100 < status < 300):
+            lines.append("Contact: <sip:%s@127.0.0.1:%d>" % (request.uri.split(":")[1].split("@")[0], self.port))
+        if body:
+            lines.append("Content-Type: application/sdp")
+        lines += list(headers)
+        lines.append("Content-Length: %d" % len(body.encode()))
+        return self.send("\r\n".join(lines) + "\r\n\r\n" + body)
+
+    def serve(self, message):
+        """Default behaviour of the Fritzbox for messages a scenario does not wait for"""
+        if message.method in self.handlers:
+            self.handlers[message.method](message)
+        elif message.method == "REGISTER":
+            if self.check_authorization(message, "Authorization"):
+                self.registrations += 1
+                self.reply(message, 200, "OK", ["Expires: %d" % self.register_expires])
+            else:
+                self.challenge(message)
+        elif message.method in ("OPTIONS", "BYE", "CANCEL"):
+            self.reply(message, 200, "OK")
+        elif message.method == "PING":
+            self.socket.sendto(b"\r\n", UA_ADDRESS)
+        elif message.method != "ACK":
+            self.note("not served: " + str(message))
+
+    # digest authentication, RFC 8760
+
+    def challenge(self, request, status=401, realm="fritz.box", algorithm="MD5", qop="auth"):
+        nonce = "%08x" % self.random.getrandbits(32)
+        self.nonces[realm] = (nonce, algorithm, qop)
+        header = "WWW-Authenticate" if status == 401 else "Proxy-Authenticate"
+        value = 'Digest realm="%s", nonce="%s", algorithm=%s' % (realm, nonce, algorithm)
+        if qop:
+            value += ', qop="%s"' % qop
+        reason = "Unauthorized" if status == 401 else "Proxy Authentication Required"
+        self.reply(request, status, reason, [header + ": " + value])
+
+    def check_authorization(self, request, header):
+        """True if the request carries valid credentials for a nonce of the stand-in"""
+        value = request.header(header.lower())
+        if not value:
+            return False
+        params = digest_params(value)
+        realm = params.get("realm", "")
+        if realm not in self.nonces:
+            return False
+        nonce, algorithm, qop = self.nonces[realm]
+        check(params.get("nonce") == nonce, "stale nonce in " + str(request))
+        check(params.get("username") == USER, "wrong user in " + str(request))
+        check(params.get("algorithm", "MD5") == algorithm, "wrong algorithm in " + str(request))
+        session = algorithm.endswith("-sess")
+        hash_function = HASHES[algorithm[:-5] if session else algorithm]
+
+        def digest(*parts):
+            return hash_function(":".join(parts).encode()).hexdigest()
+
+        ha1 = digest(USER, realm, PASSWORD)
+        if session:
+            ha1 = digest(ha1, nonce, params["cnonce"])
+        if params.get("qop") == "auth-int":
+            ha2 = digest(request.method, params["uri"], hash_function(request.body.encode()).hexdigest())
+        else:
+            ha2 = digest(request.method, params["uri"])
+        if qop:
+            check(params.get("qop") in qop.split(","), "qop missing in " + str(request))
+            expected = digest(ha1, nonce, params["nc"], params["cnonce"], params["qop"], ha2)
+        else:
+            expected = digest(ha1, nonce, ha2)
+        return params.get("response") == expected
+
+    # output
+
+    def elapsed(self):
+        return time.monotonic() - self.start
+
+    def note(self, text):
+        print("%8.3f  %s" % (self.elapsed(), text))
+
+    def result(self, name, seconds):
+        print("%8.3f  %-40s %8.1f ms" % (self.elapsed(), name, seconds * 1000))
+
+
+def register(stand_in):
+    """REGISTER, 401 challenge, REGISTER with credentials, 200 OK, returns the time it took"""
+    first = stand_in.expect("REGISTER", 5.0)
+    check(not first.header("authorization"), "the first REGISTER carries credentials")
+    stand_in.challenge(first)
+    second = stand_in.expect("REGISTER")
+    check(stand_in.check_authorization(second, "Authorization"), "wrong credentials in the REGISTER")
+    stand_in.reply(second, 200, "OK", ["Expires: %d" % stand_in.register_expires])
+    stand_in.expect_event("REGISTERED")
+    return second.time - first.time
+
+
+def scenario_flow(stand_in):
+    """register -> invite -> ring -> cancel, as the door bell does when nobody picks up"""
+    stand_in.launch()
+    stand_in.result("registration with challenge", register(stand_in))
+
+    sent = stand_in.command("ring **611")
+    invite = stand_in.expect("INVITE")
+    stand_in.result("ring command -> INVITE", invite.time - sent)
+    check(invite.time - sent < 0.1, "the dial command waited for a timer")
+    check(stand_in.check_authorization(invite, "Authorization"), "the INVITE does not reuse the credentials of the REGISTER")
+
+    stand_in.challenge(invite, 407, realm="proxy")
+    stand_in.expect("ACK")
+    invite = stand_in.expect("INVITE")
+    check(stand_in.check_authorization(invite, "Proxy-Authorization"), "wrong Proxy-Authorization in the INVITE")
+    stand_in.reply(invite, 100, "Trying")
+    stand_in.reply(invite, 180, "Ringing")
+    stand_in.idle(0.5)
+
+    sent = stand_in.command("cancel")
+    cancel = stand_in.expect("CANCEL")
+    stand_in.result("cancel command -> CANCEL", cancel.time - sent)
+    check(cancel.time - sent < 0.1, "the cancel command waited for a timer")
+    check(cancel.branch() == invite.branch(), "the CANCEL has another branch than the INVITE")
+    stand_in.reply(cancel, 200, "OK")
+    stand_in.reply(invite, 487, "Request Terminated")
+    ack = stand_in.expect("ACK")
+    check(ack.branch() == invite.branch(), "the ACK of the 487 has another branch than the INVITE")
+    event = stand_in.expect_event("CALL_CANCELLED")
+    check(event["reason"] == "CALL_CANCELLED", "cancelled call reported as " + event["reason"])
+    stand_in.result("INVITE -> CALL_CANCELLED", event["time"] - invite.time)
+
+
+def scenario_crossing(stand_in):
+    """ring group of two phones, the 200 OK of the second crosses the CANCEL sent after the first answered"""
+    stand_in.launch()
+    register(stand_in)
+
+    stand_in.command("group **611,**612")
+    invites = {}
+    while len(invites) < 2:
+        invite = stand_in.expect("INVITE")
+        invites[invite.uri.split(":")[1].split("@")[0]] = invite
+    winner, loser = invites["**611"], invites["**612"]
+    for invite in (winner, loser):
+        stand_in.reply(invite, 180, "Ringing", tag="callee" + invite.uri[-1])
+    stand_in.idle(0.2)
+
+    stand_in.reply(winner, 200, "OK", body=SDP_ANSWER, tag="callee1")
+    ack = stand_in.expect("ACK")
+    check(ack.header("call-id") == winner.header("call-id"), "the first ACK does not belong to the answered call")
+    cancel = stand_in.expect("CANCEL")
+    check(cancel.branch() == loser.branch(), "the CANCEL is not sent to the other target")
+
+    #the crossing 200 OK is the last datagram, nothing else wakes up the client for the BYE
+    stand_in.reply(cancel, 200, "OK")
+    stand_in.idle(0.1)
+    stand_in.reply(loser, 200, "OK", body=SDP_ANSWER, tag="callee2")
+    answered = time.monotonic()
+    ack = stand_in.expect("ACK")
+    check(ack.header("call-id") == loser.header("call-id"), "the crossing 200 OK is not acknowledged")
+    bye = stand_in.expect("BYE")
+    check(bye.header("call-id") == loser.header("call-id"), "the BYE does not end the call answered too late")
+    stand_in.result("crossing 200 OK -> ACK", ack.time - answered)
+    stand_in.result("crossing 200 OK -> BYE", bye.time - answered)
+    check(bye.time - answered < 0.1, "the BYE waited for a timer")
+    stand_in.reply(bye, 200, "OK")
+
+    event = stand_in.expect_event("CALL_START")
+    check(event["target"] == "0", "call started for target " + event["target"])
+    event = stand_in.expect_event("TARGET_CANCELLED")
+    check((event["target"] == "1") and (event["reason"] == "ANSWERED_ELSEWHERE"),
+          "target %s cancelled as %s" % (event["target"], event["reason"]))
+
+
+def scenario_keep_alive(stand_in):
+    """OPTIONS pings every 2 s, the registrar falls silent and the client registers again after 2 lost pings"""
+    stand_in.launch("--keep-alive", "2,2")
+    register(stand_in)
+    registered = stand_in.sent_time
+
+    ping = stand_in.expect("OPTIONS", 8.0)
+    stand_in.result("200 OK of REGISTER -> first OPTIONS", ping.time - registered)
+    check(1.5 < ping.time - registered < 3.0, "the first ping does not follow the interval")
+    stand_in.reply(ping, 200, "OK")
+    ping = stand_in.expect("OPTIONS", 4.0)
+    stand_in.reply(ping, 200, "OK")
+
+    silent = time.monotonic()
+    stand_in.handlers["OPTIONS"] = lambda message: None
+    reregister = stand_in.expect("REGISTER", 15.0)
+    pings = {message.branch() for message in stand_in.received if message.matches("OPTIONS") and message.time > silent}
+    stand_in.result("registrar silent -> REGISTER", reregister.time - silent)
+    stand_in.note("%d pings unanswered" % len(pings))
+    check(len(pings) == 2, "REGISTER after %d lost pings" % len(pings))
+    del stand_in.handlers["OPTIONS"]
+    stand_in.serve(reregister)
+    #REGISTERED is only reported once, the pings resume after the new registration
+    stand_in.reply(stand_in.expect("OPTIONS", 4.0), 200, "OK")
+    check(stand_in.registrations == 1, "the client did not register again")
+
+
+def scenario_auth_in_flight(stand_in):
+    """ring group, the second phone answers while the authenticated INVITE of the first is still unanswered"""
+    stand_in.launch()
+    register(stand_in)
+
+    stand_in.command("group **611,**612")
+    invites = {}
+    while len(invites) < 2:
+        invite = stand_in.expect("INVITE")
+        invites[invite.uri.split(":")[1].split("@")[0]] = invite
+    challenged, answering = invites["**611"], invites["**612"]
+    stand_in.challenge(challenged, 407, realm="proxy")
+    stand_in.expect("ACK")
+    challenged = stand_in.expect("INVITE")
+    check(stand_in.check_authorization(challenged, "Proxy-Authorization"), "wrong Proxy-Authorization in the INVITE")
+
+    stand_in.reply(answering, 180, "Ringing", tag="callee2")
+    stand_in.reply(answering, 200, "OK", body=SDP_ANSWER, tag="callee2")
+    ack = stand_in.expect("ACK")
+    check(ack.header("call-id") == answering.header("call-id"), "the ACK does not belong to the answered call")
+    event = stand_in.expect_event("CALL_START")
+    check(event["target"] == "1", "call started for target " + event["target"])
+
+    #a CANCEL must wait for a provisional response of the authenticated INVITE
+    early = []
+    stand_in.handlers["CANCEL"] = early.append
+    stand_in.idle(0.3)
+    del stand_in.handlers["CANCEL"]
+    check(not early, "CANCEL before a provisional response")
+    stand_in.reply(challenged, 180, "Ringing", tag="callee1")
+    ringing = time.monotonic()
+    cancel = stand_in.expect("CANCEL")
+    stand_in.result("180 of the authenticated INVITE -> CANCEL", cancel.time - ringing)
+    check(cancel.branch() == challenged.branch(), "the CANCEL has another branch than the authenticated INVITE")
+    stand_in.reply(cancel, 200, "OK")
+    stand_in.reply(challenged, 487, "Request Terminated", tag="callee1")
+    ack = stand_in.expect("ACK")
+    check(ack.branch() == challenged.branch(), "the ACK of the 487 has another branch than the INVITE")
+    event = stand_in.expect_event("TARGET_CANCELLED")
+    check((event["target"] == "0") and (event["reason"] == "ANSWERED_ELSEWHERE"),
+          "target %s cancelled as %s" % (event["target"], event["reason"]))
+
+
+def scenario_hang_up_answered(stand_in):
+    """hang up before the phone rings, then the phone answers without a provisional response"""
+    stand_in.launch()
+    register(stand_in)
+
+    stand_in.command("ring **611")
+    invite = stand_in.expect("INVITE")
+    stand_in.command("hangup")
+    #without a provisional response the INVITE cannot be cancelled yet
+    early = []
+    stand_in.handlers["CANCEL"] = early.append
+    stand_in.idle(0.3)
+    del stand_in.handlers["CANCEL"]
+    check(not early, "CANCEL before a provisional response")
+
+    stand_in.reply(invite, 200, "OK", body=SDP_ANSWER, tag="callee")
+    answered = time.monotonic()
+    ack = stand_in.expect("ACK")
+    check(ack.header("call-id") == invite.header("call-id"), "the 200 OK is not acknowledged")
+    bye = stand_in.expect("BYE")
+    check(bye.header("call-id") == invite.header("call-id"), "the BYE does not end the call answered after the hang-up")
+    stand_in.result("200 OK after the hang-up -> BYE", bye.time - answered)
+    check(bye.time - answered < 0.1, "the BYE waited for a timer")
+    stand_in.reply(bye, 200, "OK")
+    stand_in.expect_event("CALL_END", unexpected=("CALL_START",))
+
+
+def scenario_lossy(stand_in):
+    """calls answered at once while datagrams in both directions are lost, the retransmissions must get every call up"""
+    stand_in.launch()
+    register(stand_in)
+
+    tags = {}                           # Call-ID -> To tag, retransmitted INVITEs get the same answer
+    released = {}                       # Call-ID -> time the client frees the dialog of the call
+
+    def answer(invite):
+        call_id = invite.header("call-id")
+        tags.setdefault(call_id, "callee%d" % len(tags))
+        stand_in.reply(invite, 200, "OK", body=SDP_ANSWER, tag=tags[call_id])
+
+    def hang_up(bye):
+        #Timer K keeps the BYE transaction and so the dialog for T4 after the first 200 OK that gets through
+        if stand_in.reply(bye, 200, "OK"):
+            released.setdefault(bye.header("call-id"), time.monotonic() + 5.0)
+
+    def wait_for_dialog():
+        while len([call_id for call_id in tags if released.get(call_id, float("inf")) > time.monotonic()]) >= 4:
+            stand_in.idle(0.1)
+
+    stand_in.handlers["INVITE"] = answer
+    stand_in.handlers["BYE"] = hang_up
+    calls = 8
+    for loss in (0.05, 0.1, 0.2, 0.3):
+        stand_in.loss = loss
+        stand_in.random.seed(int(loss * 100))
+        times = []
+        for _ in range(calls):
+            wait_for_dialog()
+            sent = stand_in.command("ring **611")
+            #every call has to come up, expect_event() fails the scenario otherwise
+            event = stand_in.expect_event("CALL_START", 30.0)
+            times.append(event["time"] - sent)
+            stand_in.command("hangup")
+            stand_in.expect_event("CALL_END", 5.0)
+        stand_in.result("%2d%% loss: ring -> CALL_START, mean" % (loss * 100), sum(times) / len(times))
+        stand_in.result("%2d%% loss: ring -> CALL_START, max" % (loss * 100), max(times))
+
+
+SCENARIOS = {
+    "auth_in_flight": scenario_auth_in_flight,
+    "crossing": scenario_crossing,
+    "flow": scenario_flow,
+    "hang_up_answered": scenario_hang_up_answered,
+    "keep_alive": scenario_keep_alive,
+    "lossy": scenario_lossy,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--ua", required=True, help="path of sip_host_ua")
+    parser.add_argument("--epoll", action="store_true", help="use EpollUdpClient in the client")
+    parser.add_argument("scenario", choices=sorted(SCENARIOS))
+    args = parser.parse_args()
+
+    ua_args = ["--epoll"] if args.epoll else []
+    stand_in = StandIn(args.ua, ua_args, args.scenario)
+    try:
+        SCENARIOS[args.scenario](stand_in)
+    except Failure as failure:
+        stand_in.note("FAILED: %s, see %s.log" % (failure, args.scenario))
+        return 1
+    finally:
+        stand_in.stop()
+    stand_in.note("passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,476 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Events/s of the dialog state machine of sip_states.h against the same table as hand-written switch
+ *
+ * Both drive a recording client through an outgoing call (challenge, ringing, answer, BYE) and an
+ * incoming call, including events that are ignored in the current state. The recorded actions and
+ * states have to be the same.
+ *
+ *   sip_states_bench CORPUS_DIR [ITERATIONS]
+ */
+
+#include "host_test.h"
+
+#include "sip_client/sip_states.h"
+
+namespace {
+
+using State = SipDialog::State;
+
+/**
+ * Records the calls of the state machines in a checksum instead of sending messages
+ */
+struct RecordingClient {
+    uint32_t trace = 0;
+    uint32_t actions = 0;
+
+    void record(uint32_t action)
+    {
+        trace = trace * 31 + action;
+        actions++;
+    }
+
+    void send_invite(SipDialog&, bool authorize) { record(authorize ? 1 : 2); }
+    void send_cancel(SipDialog&) { record(3); }
+    void send_sip_ack(SipDialog&) { record(4); }
+    void send_bye(SipDialog& dialog)
+    {
+        dialog.bye_requested = false;
+        record(5);
+    }
+    void send_update(SipDialog&) { record(6); }
+    void session_refreshed(SipDialog&, const SipPacket&) { record(7); }
+    void refresh_rejected(SipDialog&) { record(8); }
+    void session_expired(SipDialog&) { record(9); }
+    void start_ringing(SipDialog&) { record(10); }
+    void invite_challenged(SipDialog&) { record(11); }
+    void call_start(SipDialog&, const SipPacket&) { record(12); }
+    void call_failed(SipDialog&, const SipPacket&) { record(13); }
+    void call_timeout(SipDialog&) { record(14); }
+    void drop_call(SipDialog&) { record(15); }
+    void call_end(SipDialog&) { record(16); }
+    void alert(SipDialog&) { record(17); }
+    void answer_call(SipDialog&) { record(18); }
+    void caller_cancelled(SipDialog&) { record(19); }
+    void button_press(SipDialog&, const SipPacket&) { record(20); }
+    bool is_session_timer_due(const SipDialog&) const { return false; }
+    bool is_answer_due(const SipDialog&) const { return true; }
+
+    //like SipClientInt, the entry of the initial state is not recorded
+    void set_dialog_state(SipDialog& dialog, State new_state)
+    {
+        if (new_state == dialog.state)
+        {
+            return;
+        }
+        dialog.state = new_state;
+        record(100 + static_cast<uint32_t>(new_state));
+    }
+};
+
+/**
+ * sip_dialog_states as switch on the state, transitions in the order of the table
+ */
+class DialogSwitch
+{
+public:
+    DialogSwitch(RecordingClient& sip, SipDialog& dialog)
+    : m_sip(sip)
+    , m_dialog(dialog)
+    {}
+
+    void process_event(const ev_dial&)
+    {
+        if (m_dialog.state == State::TERMINATED)
+        {
+            enter(State::INVITE_UNAUTH);
+        }
+    }
+
+    void process_event(const ev_accept&)
+    {
+        if (m_dialog.state == State::TERMINATED)
+        {
+            m_sip.alert(m_dialog);
+            enter(State::ALERTING);
+        }
+    }
+
+    void process_event(const ev_rx_cancel&)
+    {
+        if (m_dialog.state == State::ALERTING)
+        {
+            m_sip.caller_cancelled(m_dialog);
+            enter(State::TERMINATED);
+        }
+    }
+
+    void process_event(const ev_rx_ack&)
+    {
+        if (m_dialog.state == State::CALL_START)
+        {
+            enter(State::CALL_IN_PROGRESS);
+        }
+    }
+
+    void process_event(const ev_send&)
+    {
+        switch (m_dialog.state)
+        {
+        case State::ALERTING:
+            if (m_sip.is_answer_due(m_dialog))
+            {
+                m_sip.answer_call(m_dialog);
+                enter(State::CALL_START);
+            }
+            break;
+        case State::INVITE_UNAUTH:
+            m_sip.send_invite(m_dialog, false);
+            enter(State::INVITE_UNAUTH_SENT);
+            break;
+        case State::INVITE_AUTH:
+            if (m_dialog.answered_elsewhere && !m_dialog.invite_transaction.is_pending())
+            {
+                m_sip.drop_call(m_dialog);
+                enter(State::TERMINATED);
+            }
+            else if (!m_dialog.invite_transaction.is_pending())
+            {
+                m_sip.send_invite(m_dialog, true);
+            }
+            break;
+        case State::RINGING:
+            if (m_dialog.cancel_requested)
+            {
+                m_sip.send_cancel(m_dialog);
+                enter(State::CANCELLED);
+            }
+            break;
+        case State::CALL_START:
+            if (m_dialog.outgoing)
+            {
+                m_sip.send_sip_ack(m_dialog);
+                enter(State::CALL_IN_PROGRESS);
+            }
+            break;
+        case State::CALL_IN_PROGRESS:
+            if (m_dialog.bye_requested)
+            {
+                m_sip.send_bye(m_dialog);
+                enter(State::HANGING_UP);
+            }
+            else if (m_sip.is_session_timer_due(m_dialog) && m_dialog.session_refresher && !m_dialog.request_transaction.is_pending())
+            {
+                m_sip.send_update(m_dialog);
+            }
+            else if (m_sip.is_session_timer_due(m_dialog) && !m_dialog.session_refresher)
+            {
+                m_sip.session_expired(m_dialog);
+                enter(State::HANGING_UP);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_rx_provisional& event)
+    {
+        switch (m_dialog.state)
+        {
+        case State::INVITE_UNAUTH_SENT:
+            if (event.packet.get_status() != SipPacket::Status::TRYING_100)
+            {
+                m_sip.start_ringing(m_dialog);
+                enter(State::RINGING);
+            }
+            break;
+        case State::INVITE_AUTH:
+            m_sip.start_ringing(m_dialog);
+            enter(State::RINGING);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_rx_success& event)
+    {
+        bool invite = sip_guards::is_invite_response(event.packet);
+        switch (m_dialog.state)
+        {
+        case State::INVITE_UNAUTH_SENT:
+        case State::INVITE_AUTH:
+            m_sip.call_start(m_dialog, event.packet);
+            enter(State::CALL_START);
+            break;
+        case State::RINGING:
+        case State::CANCELLED:
+            if (invite)
+            {
+                m_sip.call_start(m_dialog, event.packet);
+                enter(State::CALL_START);
+            }
+            break;
+        case State::CALL_IN_PROGRESS:
+            if (event.packet.get_cseq_method() == SipPacket::Method::UPDATE)
+            {
+                m_sip.session_refreshed(m_dialog, event.packet);
+            }
+            break;
+        case State::HANGING_UP:
+            enter(State::TERMINATED);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_rx_failure& event)
+    {
+        bool challenge = sip_guards::is_auth_challenge(event.packet);
+        bool invite = sip_guards::is_invite_response(event.packet);
+        switch (m_dialog.state)
+        {
+        case State::INVITE_UNAUTH_SENT:
+            if (challenge)
+            {
+                m_sip.invite_challenged(m_dialog);
+                enter(State::INVITE_AUTH);
+            }
+            else
+            {
+                m_sip.call_failed(m_dialog, event.packet);
+                enter(State::TERMINATED);
+            }
+            break;
+        case State::INVITE_AUTH:
+            m_sip.call_failed(m_dialog, event.packet);
+            enter(State::TERMINATED);
+            break;
+        case State::RINGING:
+            if (invite && challenge)
+            {
+                m_sip.invite_challenged(m_dialog);
+                enter(State::INVITE_AUTH);
+            }
+            else if (invite)
+            {
+                m_sip.call_failed(m_dialog, event.packet);
+                enter(State::TERMINATED);
+            }
+            break;
+        case State::CALL_IN_PROGRESS:
+            if (event.packet.get_cseq_method() == SipPacket::Method::UPDATE)
+            {
+                if ((event.packet.get_status() == SipPacket::Status::REQUEST_TIMEOUT_408)
+                    || (event.packet.get_status() == SipPacket::Status::CALL_DOES_NOT_EXIST_481))
+                {
+                    m_sip.send_bye(m_dialog);
+                    enter(State::HANGING_UP);
+                }
+                else
+                {
+                    m_sip.refresh_rejected(m_dialog);
+                }
+            }
+            break;
+        case State::HANGING_UP:
+            enter(State::TERMINATED);
+            break;
+        case State::CANCELLED:
+            if (invite)
+            {
+                m_sip.call_failed(m_dialog, event.packet);
+                enter(State::TERMINATED);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_timeout&)
+    {
+        switch (m_dialog.state)
+        {
+        case State::INVITE_UNAUTH_SENT:
+        case State::INVITE_AUTH:
+        case State::RINGING:
+        case State::CANCELLED:
+            m_sip.call_timeout(m_dialog);
+            enter(State::TERMINATED);
+            break;
+        case State::CALL_START:
+            m_sip.call_end(m_dialog);
+            enter(State::TERMINATED);
+            break;
+        case State::CALL_IN_PROGRESS:
+            m_sip.send_bye(m_dialog);
+            enter(State::HANGING_UP);
+            break;
+        case State::HANGING_UP:
+            enter(State::TERMINATED);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_rx_bye&)
+    {
+        switch (m_dialog.state)
+        {
+        case State::CALL_START:
+        case State::CALL_IN_PROGRESS:
+            m_sip.call_end(m_dialog);
+            enter(State::TERMINATED);
+            break;
+        case State::HANGING_UP:
+            enter(State::TERMINATED);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_event(const ev_rx_info& event)
+    {
+        bool call = (m_dialog.state == State::CALL_START) || (m_dialog.state == State::CALL_IN_PROGRESS);
+        if (call && (event.packet.get_content_type() == SipPacket::ContentType::APPLICATION_DTMF_RELAY))
+        {
+            m_sip.button_press(m_dialog, event.packet);
+        }
+    }
+
+private:
+    void enter(State new_state)
+    {
+        m_sip.set_dialog_state(m_dialog, new_state);
+    }
+
+    RecordingClient& m_sip;
+    SipDialog& m_dialog;
+};
+
+struct Packets {
+    const SipPacket& challenge;
+    const SipPacket& ringing;
+    const SipPacket& ok;
+    const SipPacket& bye;
+    const SipPacket& info;
+};
+
+constexpr size_t EVENTS_PER_ITERATION = 18;
+
+/**
+ * An outgoing and an incoming call, the dialog is terminated at the end
+ *
+ * \return false if a state differs from the expected one
+ */
+template<class SmT>
+bool calls(SmT& sm, SipDialog& dialog, const Packets& packets)
+{
+    bool ok = true;
+    dialog.outgoing = true;
+    sm.process_event(ev_dial{});
+    sm.process_event(ev_send{});
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_failure{packets.challenge});
+    ok = ok && (dialog.state == State::INVITE_AUTH);
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_provisional{packets.ringing});
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_success{packets.ok});
+    sm.process_event(ev_send{});
+    ok = ok && (dialog.state == State::CALL_IN_PROGRESS);
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_info{packets.info});
+    dialog.bye_requested = true;
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_success{packets.ok});
+    ok = ok && (dialog.state == State::TERMINATED);
+
+    dialog.outgoing = false;
+    sm.process_event(ev_accept{});
+    sm.process_event(ev_send{});
+    sm.process_event(ev_rx_ack{});
+    sm.process_event(ev_rx_info{packets.info});
+    sm.process_event(ev_rx_bye{packets.bye});
+    ok = ok && (dialog.state == State::TERMINATED);
+    return ok;
+}
+
+SipPacket parse(const std::string& data)
+{
+    SipPacket packet(data.data(), data.size());
+    CHECK(packet.parse());
+    return packet;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: sip_states_bench CORPUS_DIR [ITERATIONS]\n");
+        return 2;
+    }
+    std::string dir = std::string(argv[1]) + "/";
+    size_t iterations = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 200000;
+
+    std::string challenge_data = host_test::read_file(dir + "407.sip");
+    std::string ringing_data = host_test::read_file(dir + "183.sip");
+    std::string ok_data = host_test::read_file(dir + "200inv.sip");
+    std::string bye_data = host_test::read_file(dir + "bye.sip");
+    std::string info_data = host_test::read_file(dir + "info.sip");
+    SipPacket challenge = parse(challenge_data);
+    SipPacket ringing = parse(ringing_data);
+    SipPacket ok = parse(ok_data);
+    SipPacket bye = parse(bye_data);
+    SipPacket info = parse(info_data);
+    Packets packets{challenge, ringing, ok, bye, info};
+
+    RecordingClient sml_client;
+    SipDialog sml_dialog;
+    sml::sm<sip_dialog_states<RecordingClient>> sml_sm{sml_client, sml_dialog};
+    RecordingClient switch_client;
+    SipDialog switch_dialog;
+    DialogSwitch switch_sm{switch_client, switch_dialog};
+
+    host_test::AllocationCounter counter;
+    CHECK(calls(sml_sm, sml_dialog, packets));
+    CHECK(calls(switch_sm, switch_dialog, packets));
+    CHECK(counter.count() == 0);
+    CHECK(sml_client.actions == switch_client.actions);
+    CHECK(sml_client.trace == switch_client.trace);
+
+    volatile bool consistent = true;
+    double sml_ns = host_test::measure_ns(iterations, [&]() { consistent = calls(sml_sm, sml_dialog, packets) && consistent; });
+    double switch_ns = host_test::measure_ns(iterations, [&]() { consistent = calls(switch_sm, switch_dialog, packets) && consistent; });
+    CHECK(consistent);
+    CHECK(sml_client.trace == switch_client.trace);
+
+    sml_ns /= EVENTS_PER_ITERATION;
+    switch_ns /= EVENTS_PER_ITERATION;
+    printf("%zu events per iteration, %u actions each\n", EVENTS_PER_ITERATION, (unsigned) (sml_client.actions / (iterations + 1)));
+    printf("sml:    %6.2f ns/event, %6.1f Mevents/s\n", sml_ns, 1000.0 / sml_ns);
+    printf("switch: %6.2f ns/event, %6.1f Mevents/s\n", switch_ns, 1000.0 / switch_ns);
+    return host_test::result();
+}
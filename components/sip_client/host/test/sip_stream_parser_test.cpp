@@ -0,0 +1,305 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * Property test of SipStreamParser: however the corpus is split into chunks, the framed messages
+ * and their parse results are the same as the ones of the complete messages
+ *
+ *   sip_stream_parser_test CORPUS_DIR
+ */
+
+#include "host_test.h"
+
+#include "sip_client/sip_stream_parser.h"
+
+#include <random>
+#include <vector>
+
+namespace {
+
+const char* const CORPUS[] = {"register", "401", "200reg", "407", "183", "200inv", "invite", "bye", "info"};
+
+bool same_values(SipPacket::Values a, SipPacket::Values b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Compare the parse results of two copies of a message
+ */
+bool same_parse(const std::string& expected, StringView framed)
+{
+    SipPacket a(expected.data(), expected.size());
+    SipPacket b(framed.data(), framed.size());
+    bool parsed = a.parse();
+    return (parsed == b.parse()) && (a.get_status_code() == b.get_status_code()) && (a.get_method() == b.get_method())
+           && (a.get_cseq_method() == b.get_cseq_method()) && (a.get_cseq() == b.get_cseq()) && (a.get_call_id() == b.get_call_id())
+           && (a.get_from_tag() == b.get_from_tag()) && (a.get_to_tag() == b.get_to_tag()) && (a.get_branch() == b.get_branch())
+           && (a.get_contact() == b.get_contact()) && (a.get_content_type() == b.get_content_type())
+           && (a.get_content_length() == b.get_content_length()) && (a.get_body() == b.get_body())
+           && (a.get_dtmf_signal() == b.get_dtmf_signal()) && (a.get_dtmf_duration() == b.get_dtmf_duration())
+           && same_values(a.get_vias(), b.get_vias()) && same_values(a.get_contacts(), b.get_contacts())
+           && same_values(a.get_www_authenticates(), b.get_www_authenticates())
+           && same_values(a.get_proxy_authenticates(), b.get_proxy_authenticates());
+}
+
+/**
+ * Frames a stream chunk by chunk and compares every message with the expected one
+ */
+template <size_t SIZE>
+class StreamCheck
+{
+public:
+    explicit StreamCheck(const std::vector<std::string>& expected)
+    : m_expected(expected)
+    {}
+
+    /**
+     * Receive a chunk through prepare() and commit() like a socket, consume what is complete
+     */
+    bool receive(const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            size_t available = 0;
+            char* dest = m_parser.prepare(available);
+            if (dest == nullptr)
+            {
+                return false;
+            }
+            size_t chunk = std::min(length, available);
+            memcpy(dest, data, chunk);
+            m_parser.commit(chunk);
+            data += chunk;
+            length -= chunk;
+            if (!take_messages())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool is_done() const
+    {
+        return (m_next == m_expected.size()) && !m_parser.is_error();
+    }
+
+private:
+    bool take_messages()
+    {
+        StringView message;
+        while (m_parser.next(message))
+        {
+            if ((m_next >= m_expected.size()) || (message != m_expected[m_next]) || !same_parse(m_expected[m_next], message))
+            {
+                return false;
+            }
+            m_next++;
+            m_parser.consume();
+        }
+        return !m_parser.is_error();
+    }
+
+    SipStreamParser<SIZE> m_parser;
+    const std::vector<std::string>& m_expected;
+    size_t m_next = 0;
+};
+
+/**
+ * Every message split at every byte offset
+ */
+void check_single_splits(const std::vector<std::string>& messages)
+{
+    size_t failed = 0;
+    size_t splits = 0;
+    for (const std::string& message : messages)
+    {
+        std::vector<std::string> expected{message};
+        for (size_t offset = 0; offset <= message.size(); offset++)
+        {
+            StreamCheck<1024> check(expected);
+            bool ok = check.receive(message.data(), offset) && check.receive(message.data() + offset, message.size() - offset);
+            if (!ok || !check.is_done())
+            {
+                failed++;
+            }
+            splits++;
+        }
+    }
+    printf("%zu single splits, %zu failed\n", splits, failed);
+    CHECK(failed == 0);
+}
+
+/**
+ * Each message in three chunks, at every pair of offsets
+ */
+void check_double_splits(const std::vector<std::string>& messages)
+{
+    size_t failed = 0;
+    size_t splits = 0;
+    for (const std::string& message : messages)
+    {
+        std::vector<std::string> expected{message};
+        for (size_t first = 0; first <= message.size(); first++)
+        {
+            for (size_t second = first; second <= message.size(); second++)
+            {
+                StreamCheck<1024> check(expected);
+                bool ok = check.receive(message.data(), first) && check.receive(message.data() + first, second - first)
+                          && check.receive(message.data() + second, message.size() - second);
+                if (!ok || !check.is_done())
+                {
+                    failed++;
+                }
+                splits++;
+            }
+        }
+    }
+    printf("%zu double splits, %zu failed\n", splits, failed);
+    CHECK(failed == 0);
+}
+
+/**
+ * The whole corpus as one stream with keep-alive CRLFs, split at every offset and in random chunks
+ */
+void check_stream(const std::vector<std::string>& messages)
+{
+    std::string stream = "\r\n\r\n";
+    for (const std::string& message : messages)
+    {
+        stream += message + "\r\n";
+    }
+
+    size_t failed = 0;
+    for (size_t offset = 0; offset <= stream.size(); offset++)
+    {
+        StreamCheck<8192> check(messages);
+        bool ok = check.receive(stream.data(), offset) && check.receive(stream.data() + offset, stream.size() - offset);
+        if (!ok || !check.is_done())
+        {
+            failed++;
+        }
+    }
+
+    std::mt19937 random(1);
+    const size_t rounds = 2000;
+    for (size_t round = 0; round < rounds; round++)
+    {
+        //a buffer smaller than the stream, so it is compacted in between
+        StreamCheck<1024> check(messages);
+        size_t position = 0;
+        bool ok = true;
+        while (ok && (position < stream.size()))
+        {
+            size_t chunk = std::min<size_t>(std::uniform_int_distribution<size_t>(1, 300)(random), stream.size() - position);
+            ok = check.receive(stream.data() + position, chunk);
+            position += chunk;
+        }
+        if (!ok || !check.is_done())
+        {
+            failed++;
+        }
+    }
+    printf("stream of %zu byte: %zu splits and %zu random chunkings, %zu failed\n", stream.size(), stream.size() + 1, rounds, failed);
+    CHECK(failed == 0);
+}
+
+/**
+ * A message handed out by next() stays in place while more data is received
+ */
+void check_pending_view(const std::vector<std::string>& messages)
+{
+    const std::string& first = messages[0];
+    const std::string& second = messages[1];
+    SipStreamParser<2048> parser;
+    std::string junk = "\r\n";
+    CHECK(parser.feed(junk.data(), junk.size()));
+    CHECK(parser.feed(first.data(), first.size()));
+    StringView message;
+    CHECK(parser.next(message));
+    CHECK(message == first);
+    CHECK(parser.feed(second.data(), 10));
+    CHECK(message == first);
+    parser.consume();
+
+    //the message moves to the front once the first one is consumed
+    CHECK(parser.feed(second.data() + 10, second.size() - 10));
+    CHECK(parser.next(message));
+    CHECK(message == second);
+    CHECK(!parser.is_error());
+}
+
+void check_framing()
+{
+    //the body is framed by Content-Length, not by the next empty line
+    std::string body = "Signal=1\r\n\r\nDuration=100\r\n";
+    std::string message = "INFO sip:620@1.2.3.4 SIP/2.0\r\nCSeq: 1 INFO\r\nl: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string stream = message + message;
+    SipStreamParser<1024> parser;
+    CHECK(parser.feed(stream.data(), stream.size()));
+    StringView framed;
+    CHECK(parser.next(framed) && (framed == message));
+    parser.consume();
+    CHECK(parser.next(framed) && (framed == message));
+    parser.consume();
+    CHECK(!parser.next(framed));
+
+    std::string invalid = "SIP/2.0 200 OK\r\nContent-Length: 4294967297\r\n\r\n";
+    SipStreamParser<1024> invalid_parser;
+    CHECK(invalid_parser.feed(invalid.data(), invalid.size()));
+    CHECK(!invalid_parser.next(framed));
+    CHECK(invalid_parser.is_error());
+
+    std::string too_long = "INVITE sip:x SIP/2.0\r\nContent-Length: 2000\r\n\r\n" + std::string(2000, 'x');
+    SipStreamParser<1024> small_parser;
+    CHECK(!small_parser.feed(too_long.data(), too_long.size()));
+    CHECK(small_parser.is_error());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: sip_stream_parser_test CORPUS_DIR\n");
+        return 2;
+    }
+    std::vector<std::string> messages;
+    for (const char* name : CORPUS)
+    {
+        messages.push_back(host_test::read_file(std::string(argv[1]) + "/" + name + ".sip"));
+    }
+
+    check_single_splits(messages);
+    check_double_splits(messages);
+    check_stream(messages);
+    check_pending_view(messages);
+    check_framing();
+    return host_test::result();
+}
@@ -29,6 +29,7 @@
 #pragma clang diagnostic ignored "-Wzero-length-array"
 #elif defined(__GNUC__)
 #if !defined(__has_builtin)
+#define __BOOST_SML_DEFINED_HAS_BUILTIN
 #define __has_builtin(...) 0
 #endif
 #define __BOOST_SML_UNUSED __attribute__((unused))
@@ -2268,7 +2269,10 @@ BOOST_SML_NAMESPACE_END
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #elif defined(__GNUC__)
+#if defined(__BOOST_SML_DEFINED_HAS_BUILTIN)
 #undef __has_builtin
+#undef __BOOST_SML_DEFINED_HAS_BUILTIN
+#endif
 #pragma GCC diagnostic pop
 #elif defined(_MSC_VER)
 #undef __has_builtin
@@ -0,0 +1,143 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "string_view.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+static constexpr const int TX_BUFFER_SIZE = 2048;
+
+/**
+ * Fixed capacity buffer to build a message
+ *
+ * The write position is tracked, so appending does not rescan the content. The content is
+ * always null terminated. Data that does not fit is dropped and the buffer is marked as
+ * overflowed, such a truncated message must not be sent.
+ */
+template<std::size_t SIZE>
+class Buffer
+{
+public:
+    Buffer()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_length = 0;
+        m_overflow = false;
+        m_buffer[0] = '\0';
+    }
+
+    Buffer<SIZE>& operator<<(const char* str)
+    {
+        return append(str, strlen(str));
+    }
+    Buffer<SIZE>& operator<<(const std::string& str)
+    {
+        return append(str.data(), str.size());
+    }
+    Buffer<SIZE>& operator<<(StringView str)
+    {
+        return append(str.data(), str.size());
+    }
+    Buffer<SIZE>& operator<<(uint32_t i)
+    {
+        //format two digits per division, from the end of a scratch buffer
+        char digits[10];
+        size_t pos = sizeof(digits);
+        while (i >= 100)
+        {
+            const char* pair = &DIGIT_PAIRS[(i % 100) * 2];
+            i /= 100;
+            digits[--pos] = pair[1];
+            digits[--pos] = pair[0];
+        }
+        if (i >= 10)
+        {
+            digits[--pos] = DIGIT_PAIRS[i * 2 + 1];
+            digits[--pos] = DIGIT_PAIRS[i * 2];
+        }
+        else
+        {
+            digits[--pos] = static_cast<char>('0' + i);
+        }
+        return append(digits + pos, sizeof(digits) - pos);
+    }
+
+    Buffer<SIZE>& append(const char* data, size_t length)
+    {
+        size_t available = SIZE - 1 - m_length;
+        if (length > available)
+        {
+            length = available;
+            m_overflow = true;
+        }
+        memcpy(m_buffer.data() + m_length, data, length);
+        m_length += length;
+        m_buffer[m_length] = '\0';
+        return *this;
+    }
+
+    const char* data() const
+    {
+        return m_buffer.data();
+    }
+
+    size_t size() const
+    {
+        return m_length;
+    }
+
+    StringView view() const
+    {
+        return StringView(m_buffer.data(), m_length);
+    }
+
+    /**
+     * \return true if data was dropped because the capacity was exceeded
+     */
+    bool is_overflow() const
+    {
+        return m_overflow;
+    }
+
+private:
+    static constexpr const char* DIGIT_PAIRS =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    std::array<char, SIZE> m_buffer;
+    size_t m_length;
+    bool m_overflow;
+};
+
+using TxBufferT = Buffer<TX_BUFFER_SIZE>;
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <string>
 #include <cstring>
 
@@ -28,64 +30,16 @@
 
 #include "esp_log.h"
 
-static constexpr const int RX_BUFFER_SIZE = 2048;
-static constexpr const int TX_BUFFER_SIZE = 2048;
+#include "buffer.h"
+#include "rx_buffer_pool.h"
+#include "string_view.h"
 
 
-template<std::size_t SIZE>
-class Buffer
-{
-public:
-    Buffer()
-    {
-        clear();
-    }
-
-    void clear()
-    {
-        m_buffer[0] = '\0';
-    }
-
-    Buffer<SIZE>& operator<<(const char* str)
-    {
-        strncat(m_buffer.data(), str, m_buffer.size() - strlen(m_buffer.data()) - 1);
-        return *this;
-    }
-    Buffer<SIZE>& operator<<(const std::string& str)
-    {
-        strncat(m_buffer.data(), str.c_str(), m_buffer.size() - strlen(m_buffer.data()) - 1);
-        return *this;
-    }
-    Buffer<SIZE>& operator<<(uint16_t i)
-    {
-        snprintf(m_buffer.data() + strlen(m_buffer.data()), m_buffer.size() - strlen(m_buffer.data()), "%d", i);
-        return *this;
-    }
-    Buffer<SIZE>& operator<<(uint32_t i)
-    {
-        snprintf(m_buffer.data() + strlen(m_buffer.data()), m_buffer.size() - strlen(m_buffer.data()), "%d", i);
-        return *this;
-    }
-
-    const char* data() const
-    {
-        return m_buffer.data();
-    }
-
-    size_t size() const
-    {
-        return strlen(m_buffer.data());
-    }
-
-private:
-    std::array<char, SIZE> m_buffer;
-};
-
-using TxBufferT = Buffer<TX_BUFFER_SIZE>;
-
 class LwipUdpClient
 {
 public:
+    static constexpr uint32_t RECEIVE_FOREVER = UINT32_MAX;
+    static constexpr size_t RX_BUFFER_COUNT = 2;    ///< received datagrams that may be kept at the same time
 
     LwipUdpClient(const std::string& server_ip, const std::string& server_port, uint16_t local_port)
     : m_server_port(server_port)
@@ -190,7 +144,14 @@ public:
     }
 
 
-    std::string receive(uint32_t timeout_msec)
+    /**
+     * Wait up to timeout_msec for a datagram, RECEIVE_FOREVER blocks until one arrives
+     *
+     * The datagram borrows a receive buffer until it is released.
+     *
+     * \return an empty datagram on timeout and after wake()
+     */
+    RxDatagram receive(uint32_t timeout_msec)
     {
         FD_ZERO(&m_rx_fds);
         FD_SET(m_socket, &m_rx_fds);
@@ -198,7 +159,7 @@ public:
         m_rx_timeval.tv_sec = timeout_msec / 1000;
         m_rx_timeval.tv_usec = (timeout_msec - (m_rx_timeval.tv_sec * 1000))* 1000;
 
-        int readable = select(m_socket + 1, &m_rx_fds, nullptr, nullptr, &m_rx_timeval);
+        int readable = select(m_socket + 1, &m_rx_fds, nullptr, nullptr, (timeout_msec == RECEIVE_FOREVER) ? nullptr : &m_rx_timeval);
 
         if (readable < 0)
         {
@@ -206,20 +167,51 @@ public:
         }
         if (readable <= 0)
         {
-            return "";
+            return RxDatagram();
         }
 
-        ssize_t len = recv(m_socket, m_rx_buffer.data(), m_rx_buffer.size(), 0);
+        size_t index;
+        if (!m_rx_pool.acquire(index))
+        {
+            ESP_LOGW(TAG, "All receive buffers are borrowed");
+            return RxDatagram();
+        }
+        ssize_t len = recv(m_socket, m_rx_pool.data(index), m_rx_pool.buffer_size(), 0);
         if (len <= 0)
         {
             ESP_LOGD(TAG, "Received no data: %d, errno=%d", len, errno);
-            return "";
+            m_rx_pool.release(index);
+            return RxDatagram();
         }
-        m_rx_buffer[len] = '\0';
         ESP_LOGD(TAG, "Received %d byte", len);
-        ESP_LOGV(TAG, "Received following data: %s", m_rx_buffer.data());
+        ESP_LOGV(TAG, "Received following data: %.*s", (int) len, m_rx_pool.data(index));
+
+        return m_rx_pool.lend(index, len);
+    }
 
-        return std::string(m_rx_buffer.data(), len);
+    /**
+     * Make a blocking receive() of another task return
+     *
+     * An empty datagram is sent to the own port over the loopback interface. It is queued
+     * if no receive() is blocking at the moment, so a wake-up is never lost.
+     */
+    void wake()
+    {
+        if (!is_initialized())
+        {
+            return;
+        }
+        struct sockaddr_in loopback_addr;
+        bzero(&loopback_addr, sizeof(loopback_addr));
+        loopback_addr.sin_family = AF_INET;
+        loopback_addr.sin_len = sizeof(loopback_addr);
+        loopback_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        loopback_addr.sin_port = htons(m_local_port);
+        static const char WAKE_DATA = 0;
+        if (sendto(m_socket, &WAKE_DATA, 0, 0, (struct sockaddr *)&loopback_addr, sizeof(loopback_addr)) < 0)
+        {
+            ESP_LOGW(TAG, "Failed to wake the socket, errno=%d", errno);
+        }
     }
 
     TxBufferT& get_new_tx_buf()
@@ -230,6 +222,11 @@ public:
 
     bool send_buffered_data()
     {
+        if (m_tx_buffer.is_overflow())
+        {
+            ESP_LOGE(TAG, "Message exceeds %d byte, not sending it", TX_BUFFER_SIZE);
+            return false;
+        }
         ESP_LOGD(TAG, "Sending %d byte", m_tx_buffer.size());
         ESP_LOGV(TAG, "Sending following data: %s", m_tx_buffer.data());
         ssize_t result = sendto(m_socket, m_tx_buffer.data(), m_tx_buffer.size(), 0, (struct sockaddr *)&m_dest_addr, sizeof(m_dest_addr));
@@ -247,7 +244,7 @@ private:
     const uint16_t m_local_port;
 
     TxBufferT m_tx_buffer;
-    std::array<char, RX_BUFFER_SIZE> m_rx_buffer;
+    RxBufferPool<RX_BUFFER_COUNT> m_rx_pool;
     int m_socket;
     sockaddr_in m_dest_addr;
 
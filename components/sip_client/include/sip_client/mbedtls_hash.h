@@ -0,0 +1,28 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "mbedtls_md5.h"
+#include "mbedtls_sha256.h"
+
+/**
+ * HashT of SipClient, the hash functions of the digest algorithms (RFC 8760) implemented by mbedtls
+ */
+struct MbedtlsHash {
+    using Md5 = MbedtlsMd5;
+    using Sha256 = MbedtlsSha256;
+};
@@ -18,9 +18,13 @@
 
 #include "mbedtls/md5.h"
 
+#include "string_view.h"
+
 class MbedtlsMd5
 {
 public:
+    static constexpr size_t SIZE = 16;     ///< length of the digest in byte
+
     MbedtlsMd5()
     {
         mbedtls_md5_init(&m_ctx);
@@ -36,12 +40,17 @@ public:
         mbedtls_md5_starts(&m_ctx);
     }
 
-    void update(const std::string& input)
+    void update(const void* data, size_t length)
+    {
+        mbedtls_md5_update(&m_ctx, static_cast<const unsigned char*>(data), length);
+    }
+
+    void update(StringView input)
     {
-        mbedtls_md5_update(&m_ctx, reinterpret_cast<const unsigned char*>(input.c_str()), input.size());
+        update(input.data(), input.size());
     }
 
-    void finish(unsigned char hash[16])
+    void finish(unsigned char hash[SIZE])
     {
         mbedtls_md5_finish(&m_ctx, hash);
     }
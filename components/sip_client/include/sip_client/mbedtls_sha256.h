@@ -0,0 +1,61 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "mbedtls/sha256.h"
+
+#include "string_view.h"
+
+class MbedtlsSha256
+{
+public:
+    static constexpr size_t SIZE = 32;     ///< length of the digest in byte
+
+    MbedtlsSha256()
+    {
+        mbedtls_sha256_init(&m_ctx);
+    }
+
+    ~MbedtlsSha256()
+    {
+        mbedtls_sha256_free(&m_ctx);
+    }
+
+    void start()
+    {
+        //0 selects SHA-256 instead of SHA-224
+        mbedtls_sha256_starts(&m_ctx, 0);
+    }
+
+    void update(const void* data, size_t length)
+    {
+        mbedtls_sha256_update(&m_ctx, static_cast<const unsigned char*>(data), length);
+    }
+
+    void update(StringView input)
+    {
+        update(input.data(), input.size());
+    }
+
+    void finish(unsigned char hash[SIZE])
+    {
+        mbedtls_sha256_finish(&m_ctx, hash);
+    }
+
+private:
+    mbedtls_sha256_context m_ctx;
+};
@@ -0,0 +1,118 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/**
+ * Bounded lock-free queue with several producers and one consumer
+ *
+ * Used to hand commands and events between the SIP task and the tasks of the application.
+ * Every slot has a sequence number that tells whether it is free for the producer of a
+ * position or filled for the consumer. A producer claims a position with a compare and swap
+ * of the write position, moves its entry into the slot and publishes it by advancing the
+ * sequence number, so no entry is lost or torn while several tasks push at the same time.
+ * A full queue rejects the entry instead of overwriting an older one, neither side blocks.
+ *
+ * pop() must only be called from one task.
+ */
+template<class T, std::size_t SIZE>
+class MpscQueue
+{
+    static_assert((SIZE >= 2) && ((SIZE & (SIZE - 1)) == 0), "size must be a power of two");
+
+public:
+    MpscQueue()
+    {
+        for (uint32_t i = 0; i < SIZE; i++)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * Append an entry, may be called from any task
+     *
+     * \return false if the queue is full, the entry is not taken
+     */
+    bool push(T&& entry)
+    {
+        uint32_t pos = m_write_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[pos & MASK];
+            int32_t diff = static_cast<int32_t>(slot.sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0)
+            {
+                if (m_write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.entry = std::move(entry);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                //pos was updated by the failed exchange
+            }
+            else if (diff < 0)
+            {
+                //the consumer did not take the entry of the previous round yet
+                return false;
+            }
+            else
+            {
+                pos = m_write_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest entry, only called from the consuming task
+     *
+     * \return false if the queue is empty
+     */
+    bool pop(T& entry)
+    {
+        Slot& slot = m_slots[m_read_pos & MASK];
+        if (slot.sequence.load(std::memory_order_acquire) != m_read_pos + 1)
+        {
+            return false;
+        }
+        entry = std::move(slot.entry);
+        slot.entry = T();
+        slot.sequence.store(m_read_pos + SIZE, std::memory_order_release);
+        m_read_pos++;
+        return true;
+    }
+
+private:
+    static constexpr uint32_t MASK = SIZE - 1;
+
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T entry;
+    };
+
+    std::array<Slot, SIZE> m_slots;
+    std::atomic<uint32_t> m_write_pos {0};
+    uint32_t m_read_pos = 0;    ///< only accessed by the consumer
+};
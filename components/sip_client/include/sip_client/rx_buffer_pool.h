@@ -0,0 +1,194 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "string_view.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+static constexpr const int RX_BUFFER_SIZE = 2048;
+
+/**
+ * Received datagram, borrowing a buffer of the RxBufferPool of the socket
+ *
+ * The data is not copied out of the receive buffer. The buffer is returned to the pool when the
+ * datagram is destroyed or released, so a datagram must not outlive its socket. It may be moved,
+ * also to another task, but not copied.
+ */
+class RxDatagram
+{
+public:
+    RxDatagram()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_in_use(nullptr)
+    , m_mask(0)
+    {
+    }
+
+    RxDatagram(const char* data, size_t size, std::atomic<uint32_t>* in_use, uint32_t mask)
+    : m_data(data)
+    , m_size(size)
+    , m_in_use(in_use)
+    , m_mask(mask)
+    {
+    }
+
+    RxDatagram(RxDatagram&& other)
+    : m_data(other.m_data)
+    , m_size(other.m_size)
+    , m_in_use(other.m_in_use)
+    , m_mask(other.m_mask)
+    {
+        other.m_in_use = nullptr;
+        other.release();
+    }
+
+    RxDatagram& operator=(RxDatagram&& other)
+    {
+        if (this != &other)
+        {
+            release();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_in_use = other.m_in_use;
+            m_mask = other.m_mask;
+            other.m_in_use = nullptr;
+            other.release();
+        }
+        return *this;
+    }
+
+    RxDatagram(const RxDatagram&) = delete;
+    RxDatagram& operator=(const RxDatagram&) = delete;
+
+    ~RxDatagram()
+    {
+        release();
+    }
+
+    /**
+     * Return the buffer to the pool, the datagram is empty afterwards
+     */
+    void release()
+    {
+        if (m_in_use != nullptr)
+        {
+            m_in_use->fetch_and(~m_mask, std::memory_order_release);
+            m_in_use = nullptr;
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    StringView view() const
+    {
+        return StringView(m_data, m_size);
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    std::atomic<uint32_t>* m_in_use;    ///< bit set of the pool, nullptr if no buffer is borrowed
+    uint32_t m_mask;                    ///< bit of the borrowed buffer
+};
+
+/**
+ * Receive buffers of a socket, each received datagram borrows one until it is released
+ *
+ * Only the task of the socket acquires buffers, any task may return them.
+ */
+template<size_t COUNT, size_t SIZE = RX_BUFFER_SIZE>
+class RxBufferPool
+{
+public:
+    static_assert((COUNT > 0) && (COUNT <= 32), "A pool has 1 to 32 buffers");
+
+    /**
+     * Take a free buffer to receive into
+     *
+     * \return false if all buffers are borrowed
+     */
+    bool acquire(size_t& index)
+    {
+        uint32_t in_use = m_in_use.load(std::memory_order_acquire);
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            if ((in_use & (1u << i)) == 0)
+            {
+                //only this task sets bits, so the buffer can not be taken in between
+                m_in_use.fetch_or(1u << i, std::memory_order_relaxed);
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Return an acquired buffer that was not handed out, e.g. after a timeout
+     */
+    void release(size_t index)
+    {
+        m_in_use.fetch_and(~(1u << index), std::memory_order_release);
+    }
+
+    /**
+     * Hand out the received data of an acquired buffer, an empty datagram returns the buffer at once
+     */
+    RxDatagram lend(size_t index, size_t length)
+    {
+        if (length == 0)
+        {
+            release(index);
+            return RxDatagram();
+        }
+        return RxDatagram(m_buffers[index].data(), length, &m_in_use, 1u << index);
+    }
+
+    char* data(size_t index)
+    {
+        return m_buffers[index].data();
+    }
+
+    size_t buffer_size() const
+    {
+        return SIZE;
+    }
+
+private:
+    std::array<std::array<char, SIZE>, COUNT> m_buffers;
+    std::atomic<uint32_t> m_in_use {0};     ///< one bit per borrowed buffer
+};
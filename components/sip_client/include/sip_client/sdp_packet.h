@@ -0,0 +1,383 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_log.h"
+#include "string_view.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+/**
+ * Result of the media negotiation, stored beyond the lifetime of the received packet
+ */
+struct MediaParameters {
+    enum class Direction {
+        SENDRECV,
+        SENDONLY,
+        RECVONLY,
+        INACTIVE,
+    };
+
+    bool valid = false;
+    std::array<char, 46> remote_address = {};   ///< null terminated, large enough for IPv6
+    uint16_t remote_port = 0;
+    uint8_t payload_type = 0;                   ///< selected audio codec, PCMU or PCMA
+    int16_t telephone_event_payload_type = -1;  ///< -1 if the remote side does not support RFC 4733 events
+    uint16_t ptime = 20;
+    Direction remote_direction = Direction::SENDRECV;
+};
+
+/**
+ * Parser for a SDP body (RFC 4566)
+ *
+ * Only the first audio media description is evaluated. Like SipPacket the body is not
+ * modified and not copied, all values are views into it.
+ */
+class SdpPacket
+{
+public:
+    static constexpr uint8_t PAYLOAD_TYPE_PCMU = 0;
+    static constexpr uint8_t PAYLOAD_TYPE_PCMA = 8;
+    static constexpr uint8_t PAYLOAD_TYPE_TELEPHONE_EVENT = 101;
+    static constexpr size_t MAX_PAYLOAD_TYPES = 16;
+
+    struct RtpMap {
+        uint8_t payload_type = 0;
+        StringView encoding;
+        uint32_t clock_rate = 0;
+        StringView fmtp;
+    };
+
+    explicit SdpPacket(StringView body)
+    : m_body(body)
+    , m_media_port(0)
+    , m_payload_type_count(0)
+    , m_ptime(0)
+    , m_direction(MediaParameters::Direction::SENDRECV)
+    {
+    }
+
+    bool parse()
+    {
+        bool in_audio = false;
+        bool audio_seen = false;
+        size_t position = 0;
+        StringView line;
+        while (next_line(position, line))
+        {
+            if ((line.size() < 2) || (line[1] != '='))
+            {
+                continue;
+            }
+            StringView value = line.substr(2);
+            switch (line[0])
+            {
+            case 'm':
+                //m=<media> <port> <proto> <fmt> ...
+                in_audio = !audio_seen && value.starts_with("audio ");
+                if (in_audio)
+                {
+                    audio_seen = true;
+                    parse_media(value.substr(strlen("audio ")));
+                }
+                break;
+            case 'c':
+                //c=IN IP4 <address>, the media level overrides the session level
+                if (!audio_seen || in_audio)
+                {
+                    parse_connection(value);
+                }
+                break;
+            case 'a':
+                if (!audio_seen || in_audio)
+                {
+                    parse_attribute(value);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (!audio_seen)
+        {
+            ESP_LOGW(TAG, "No audio media description found");
+            return false;
+        }
+        return true;
+    }
+
+    StringView get_connection_address() const
+    {
+        return m_connection_address;
+    }
+
+    uint16_t get_media_port() const
+    {
+        return m_media_port;
+    }
+
+    size_t get_payload_type_count() const
+    {
+        return m_payload_type_count;
+    }
+
+    uint8_t get_payload_type(size_t index) const
+    {
+        return m_payload_types[index];
+    }
+
+    /**
+     * \return nullptr if there is no a=rtpmap line for the payload type
+     */
+    const RtpMap* find_rtpmap(uint8_t payload_type) const
+    {
+        for (size_t i = 0; i < m_payload_type_count; i++)
+        {
+            if ((m_rtpmaps[i].payload_type == payload_type) && !m_rtpmaps[i].encoding.empty())
+            {
+                return &m_rtpmaps[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * \return 0 if no a=ptime line is present
+     */
+    uint16_t get_ptime() const
+    {
+        return m_ptime;
+    }
+
+    MediaParameters::Direction get_direction() const
+    {
+        return m_direction;
+    }
+
+    /**
+     * Select the media parameters against our offer (PCMU, PCMA and telephone-event)
+     *
+     * The first audio payload type of the remote side that we support wins. So as answerer the
+     * preference of the offerer is honoured and as offerer the codec chosen in the answer is used.
+     *
+     * \return false if there is no common audio codec
+     */
+    bool negotiate(MediaParameters& result) const
+    {
+        result = MediaParameters();
+        bool codec_found = false;
+        for (size_t i = 0; i < m_payload_type_count; i++)
+        {
+            uint8_t payload_type = m_payload_types[i];
+            const RtpMap* rtpmap = find_rtpmap(payload_type);
+            if (!codec_found && is_supported_codec(payload_type, rtpmap))
+            {
+                result.payload_type = payload_type;
+                codec_found = true;
+            }
+            else if ((rtpmap != nullptr) && rtpmap->encoding.equals_ignore_case("telephone-event") && (rtpmap->clock_rate == 8000))
+            {
+                result.telephone_event_payload_type = payload_type;
+            }
+        }
+        if (!codec_found || m_connection_address.empty() || (m_media_port == 0))
+        {
+            ESP_LOGW(TAG, "Media negotiation failed");
+            return false;
+        }
+
+        size_t length = std::min(m_connection_address.size(), result.remote_address.size() - 1);
+        memcpy(result.remote_address.data(), m_connection_address.data(), length);
+        result.remote_address[length] = '\0';
+        result.remote_port = m_media_port;
+        result.ptime = (m_ptime != 0) ? m_ptime : 20;
+        result.remote_direction = m_direction;
+        result.valid = true;
+        return true;
+    }
+
+private:
+    static bool is_supported_codec(uint8_t payload_type, const RtpMap* rtpmap)
+    {
+        if (rtpmap == nullptr)
+        {
+            //static payload types do not need a rtpmap
+            return (payload_type == PAYLOAD_TYPE_PCMU) || (payload_type == PAYLOAD_TYPE_PCMA);
+        }
+        if (payload_type == PAYLOAD_TYPE_PCMU)
+        {
+            return rtpmap->encoding.equals_ignore_case("PCMU") && (rtpmap->clock_rate == 8000);
+        }
+        if (payload_type == PAYLOAD_TYPE_PCMA)
+        {
+            return rtpmap->encoding.equals_ignore_case("PCMA") && (rtpmap->clock_rate == 8000);
+        }
+        return false;
+    }
+
+    bool next_line(size_t& position, StringView& line) const
+    {
+        if (position >= m_body.size())
+        {
+            return false;
+        }
+        StringView remaining = m_body.substr(position);
+        size_t end = remaining.find('\n');
+        if (end == StringView::npos)
+        {
+            end = remaining.size();
+        }
+        position += end + 1;
+        line = remaining.substr(0, end).trim();
+        return true;
+    }
+
+    /**
+     * \return the next space separated token of value, value is advanced behind it
+     */
+    static StringView next_token(StringView& value)
+    {
+        value = value.trim();
+        size_t end = value.find(' ');
+        StringView token = value.substr(0, end);
+        value = value.substr(token.size());
+        return token;
+    }
+
+    void parse_media(StringView value)
+    {
+        uint32_t port = 0;
+        next_token(value).to_uint(port);
+        m_media_port = port;
+        next_token(value); //protocol, e.g. RTP/AVP
+
+        m_payload_type_count = 0;
+        for (StringView token = next_token(value); !token.empty(); token = next_token(value))
+        {
+            uint32_t payload_type = 0;
+            if (!token.to_uint(payload_type) || (payload_type > 127))
+            {
+                continue;
+            }
+            if (m_payload_type_count >= MAX_PAYLOAD_TYPES)
+            {
+                ESP_LOGW(TAG, "Too many payload types, ignoring %d", (int) payload_type);
+                continue;
+            }
+            m_payload_types[m_payload_type_count] = payload_type;
+            m_rtpmaps[m_payload_type_count] = RtpMap();
+            m_rtpmaps[m_payload_type_count].payload_type = payload_type;
+            m_payload_type_count++;
+        }
+    }
+
+    void parse_connection(StringView value)
+    {
+        next_token(value); //network type IN
+        next_token(value); //address type IP4 or IP6
+        StringView address = next_token(value);
+        //strip a multicast TTL
+        m_connection_address = address.substr(0, address.find('/'));
+    }
+
+    void parse_attribute(StringView value)
+    {
+        if (value.starts_with("rtpmap:"))
+        {
+            //a=rtpmap:<payload type> <encoding name>/<clock rate>[/<encoding parameters>]
+            value = value.substr(strlen("rtpmap:"));
+            RtpMap* rtpmap = rtpmap_for(next_token(value));
+            if (rtpmap == nullptr)
+            {
+                return;
+            }
+            StringView encoding = next_token(value);
+            size_t slash = encoding.find('/');
+            rtpmap->encoding = encoding.substr(0, slash);
+            if (slash != StringView::npos)
+            {
+                encoding.substr(slash + 1).to_uint(rtpmap->clock_rate);
+            }
+        }
+        else if (value.starts_with("fmtp:"))
+        {
+            //a=fmtp:<payload type> <format specific parameters>
+            value = value.substr(strlen("fmtp:"));
+            RtpMap* rtpmap = rtpmap_for(next_token(value));
+            if (rtpmap != nullptr)
+            {
+                rtpmap->fmtp = value.trim();
+            }
+        }
+        else if (value.starts_with("ptime:"))
+        {
+            uint32_t ptime = 0;
+            if (value.substr(strlen("ptime:")).trim().to_uint(ptime))
+            {
+                m_ptime = ptime;
+            }
+        }
+        else if (value == "sendrecv")
+        {
+            m_direction = MediaParameters::Direction::SENDRECV;
+        }
+        else if (value == "sendonly")
+        {
+            m_direction = MediaParameters::Direction::SENDONLY;
+        }
+        else if (value == "recvonly")
+        {
+            m_direction = MediaParameters::Direction::RECVONLY;
+        }
+        else if (value == "inactive")
+        {
+            m_direction = MediaParameters::Direction::INACTIVE;
+        }
+    }
+
+    RtpMap* rtpmap_for(StringView payload_type_token)
+    {
+        uint32_t payload_type = 0;
+        if (!payload_type_token.to_uint(payload_type))
+        {
+            return nullptr;
+        }
+        for (size_t i = 0; i < m_payload_type_count; i++)
+        {
+            if (m_payload_types[i] == payload_type)
+            {
+                return &m_rtpmaps[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const StringView m_body;
+
+    StringView m_connection_address;
+    uint16_t m_media_port;
+    uint8_t m_payload_types[MAX_PAYLOAD_TYPES];
+    RtpMap m_rtpmaps[MAX_PAYLOAD_TYPES];
+    size_t m_payload_type_count;
+    uint16_t m_ptime;
+    MediaParameters::Direction m_direction;
+
+    static constexpr const char* TAG = "SdpPacket";
+};
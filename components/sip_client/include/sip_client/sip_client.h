@@ -16,22 +16,35 @@
 
 #pragma once
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "mpsc_queue.h"
+#include "sdp_packet.h"
+#include "sip_dialog.h"
+#include "sip_digest.h"
+#include "sip_keep_alive.h"
+#include "sip_message_template.h"
 #include "sip_packet.h"
+#include "sip_registration.h"
+#include "sip_socket.h"
+#include "sip_states.h"
+#include "sip_transaction.h"
 
-#define USE_SML
-
-#ifdef USE_SML
-#include "boost/sml.hpp"
-#endif
-
-#include <functional>
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <memory>
 #include <string>
+#include <vector>
 
 
+template <class SocketT>
 static void rtp_task(void *pvParameters)
 {
-    LwipUdpClient *socket = (LwipUdpClient *) pvParameters;
+    SocketT *socket = (SocketT *) pvParameters;
     for(;;)
     {
         if (!socket->is_initialized())
@@ -40,8 +53,8 @@ static void rtp_task(void *pvParameters)
             continue;
         }
 
-        std::string data = socket->receive(5000);
-        ESP_LOGV("RTP", "Received %d byte", data.size());
+        RxDatagram data = socket->receive(5000);
+        ESP_LOGV("RTP", "Received %d byte", (int) data.size());
     }
 }
 
@@ -49,48 +62,83 @@ static void rtp_task(void *pvParameters)
 struct SipClientEvent {
         enum class Event {
             CALL_START,
-            CALL_CANCELLED,
+            CALL_CANCELLED,         ///< the call failed, for a ring group all targets failed
             CALL_END,
             BUTTON_PRESS,
+            REGISTERED,             ///< the first REGISTER after startup or after a failure succeeded
+            REGISTRATION_FAILED,    ///< a REGISTER failed, it is retried with increasing delay
+            TARGET_CANCELLED,       ///< one target of a ring group failed or was cancelled, others still ring or answered
         };
 
         enum class CancelReason {
             UNKNOWN,
             CALL_DECLINED,
             TARGET_BUSY,
+            CALL_CANCELLED,
+            TARGET_UNAVAILABLE,
+            MEDIA_NOT_ACCEPTABLE,
+            ANSWERED_ELSEWHERE,     ///< another target of the ring group answered first
         };
 
         Event event;
         char button_signal = ' ';
         uint16_t button_duration = 0;
         CancelReason cancel_reason = CancelReason::UNKNOWN;
+        uint16_t status_code = 0;
+        uint8_t dialog = 0;     ///< id of the call, calls may overlap
+        uint8_t target = 0;     ///< index of the called number in request_ring_group()
+};
+
+/**
+ * Counters of the event queue, see SipClientInt::wait_event()
+ */
+struct SipEventStats {
+        uint32_t queued = 0;    ///< events put into the queue since startup
+        uint32_t dropped = 0;   ///< events lost because the application did not take them in time
+};
+
+/**
+ * How incoming calls are answered, see SipClientInt::set_answer_policy()
+ */
+struct SipAnswerPolicy {
+        enum class Alerting {
+            NONE,           ///< no provisional response besides 100 Trying
+            RINGING,        ///< 180 Ringing
+            EARLY_MEDIA,    ///< 183 Session Progress with our SDP answer
+        };
+
+        uint32_t answer_delay_msec = 0;
+        Alerting alerting = Alerting::NONE;
+        std::vector<std::string> allowed_callers;   ///< user part of the From URI, empty allows every caller
 };
 
-template <class SocketT, class Md5T>
+template <class SocketT, class HashT>
 class SipClientInt
 {
+    static_assert(IsSipSocket<SocketT>::value, "SocketT does not provide the interface described in sip_socket.h");
+
 public:
     SipClientInt(const std::string& user, const std::string& pwd, const std::string& server_ip, const std::string& server_port, const std::string& my_ip)
     : m_socket(server_ip, server_port, LOCAL_PORT)
     , m_rtp_socket(server_ip, "7078", LOCAL_RTP_PORT)
+    , m_digest(user, pwd)
     , m_server_ip(server_ip)
     , m_user(user)
-    , m_pwd(pwd)
     , m_my_ip(my_ip)
-    , m_uri("sip:" + server_ip)
-    , m_to_uri("sip:" + user + "@" + server_ip)
     , m_sip_sequence_number(std::rand() % 2147483647)
     , m_call_id(std::rand() % 2147483647)
-    , m_response("")
-    , m_realm("")
-    , m_nonce("")
     , m_tag(std::rand() % 2147483647)
     , m_branch(std::rand() % 2147483647)
-    , m_caller_display(m_user)
-    , m_sdp_session_id(0)
-    , m_command_event_group(xEventGroupCreate())
+    , m_keep_alive_call_id(std::rand() % 2147483647)
+    , m_event_group(xEventGroupCreate())
     {
-        xTaskCreate(&rtp_task, "rtp_task", 4096, &m_rtp_socket, 4, NULL);
+        //the state machines are created here, their actions need the complete type of this class
+        m_registration_states.reset(new RegistrationStatesT{*this});
+        for (SipDialog& dialog : m_dialogs)
+        {
+            m_dialog_states[dialog.id].reset(new DialogStatesT{*this, dialog});
+        }
+        xTaskCreate(&rtp_task<SocketT>, "rtp_task", 4096, &m_rtp_socket, 4, NULL);
     }
 
     ~SipClientInt()
@@ -114,631 +162,1897 @@ public:
         m_server_ip = server_ip;
         m_socket.set_server_ip(server_ip);
         m_rtp_socket.set_server_ip(server_ip);
-        m_uri = "sip:" + server_ip;
-        m_to_uri = "sip:" + m_user + "@" + server_ip;
+        m_digest.clear();
+        m_register_template.clear();
+        m_keep_alive_template.clear();
     }
 
     void set_my_ip(const std::string& my_ip)
     {
         m_my_ip = my_ip;
+        m_register_template.clear();
+        m_keep_alive_template.clear();
     }
 
     void set_credentials(const std::string& user, const std::string& password)
     {
         m_user = user;
-        m_pwd = password;
-        m_to_uri = "sip:" + m_user + "@" + m_server_ip;
+        m_digest.set_credentials(user, password);
+        m_register_template.clear();
+        m_keep_alive_template.clear();
+    }
+
+    /**
+     * \param[in] expires_sec Expiry requested in the REGISTER, the server may grant less
+     * \param[in] max_refresh_interval_sec Upper limit of the time between two REGISTER, 0 for no limit
+     */
+    void set_registration_timing(uint32_t expires_sec, uint32_t max_refresh_interval_sec)
+    {
+        m_registration.set_timing(expires_sec, max_refresh_interval_sec);
+        m_register_template.clear();
+    }
+
+    /**
+     * Check that the registrar is alive while registered, see SipKeepAlive
+     *
+     * \param[in] interval_sec Time between two pings, 0 disables them
+     * \param[in] max_lost Pings lost in a row until the client registers again, 0 never
+     */
+    void set_keep_alive(SipKeepAlive::Mode mode, uint32_t interval_sec, uint32_t max_lost)
+    {
+        m_keep_alive.set_timing(mode, interval_sec, max_lost);
+        if (m_registration.is_registered())
+        {
+            m_keep_alive.start(xTaskGetTickCount());
+        }
+    }
+
+    /**
+     * May be called from any task
+     */
+    SipKeepAliveStats get_keep_alive_stats() const
+    {
+        return m_keep_alive.get_stats();
+    }
+
+    /**
+     * Take the next event, only called from one task of the application
+     *
+     * The SIP task only queues the events, so the application may take its time to handle
+     * them without delaying SIP processing. If the queue is full, newer events are dropped.
+     *
+     * \param[out] event The oldest event
+     * \param[in] ticks_to_wait How long to wait for an event, 0 to only check
+     * \return false if no event arrived, may happen before the time is elapsed
+     */
+    bool wait_event(SipClientEvent& event, TickType_t ticks_to_wait)
+    {
+        if (m_events.pop(event))
+        {
+            return true;
+        }
+        xEventGroupWaitBits(m_event_group, EVENT_QUEUED_BIT, true, false, ticks_to_wait);
+        return m_events.pop(event);
+    }
+
+    SipEventStats get_event_stats() const
+    {
+        SipEventStats stats;
+        stats.queued = m_events_queued.load(std::memory_order_relaxed);
+        stats.dropped = m_events_dropped.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /**
+     * Every incoming INVITE is answered with 100 Trying at once. A caller that is allowed gets
+     * the alerting response and after the answer delay the 200 OK with our SDP answer, other
+     * callers are declined with 603.
+     */
+    void set_answer_policy(const SipAnswerPolicy& policy)
+    {
+        m_answer_policy = policy;
     }
 
-    void set_event_handler(std::function<void(const SipClientEvent&)> handler)
+    /**
+     * Session timer of RFC 4028, requested in our INVITE and offered to callers without one
+     *
+     * The session is refreshed with UPDATE. If the refresh fails, or the other side does not
+     * refresh in time, the call is hung up. So a call is ended on both sides within the
+     * session interval, even if the network is lost.
+     *
+     * \param[in] session_expires_sec Session interval, at least 90 seconds, 0 disables the session timer
+     */
+    void set_session_timer(uint32_t session_expires_sec)
     {
-        m_event_handler = handler;
+        if ((session_expires_sec > 0) && (session_expires_sec < MIN_SESSION_EXPIRES_SEC))
+        {
+            session_expires_sec = MIN_SESSION_EXPIRES_SEC;
+        }
+        m_session_expires_sec = session_expires_sec;
     }
 
     /**
      * Initiate a call async
      *
+     * Each call uses a dialog of its own, so a call can be started while another one is active.
+     *
      * \param[in] local_number A number that is registered locally on the server, e.g. "**610"
      * \param[in] caller_display This string is displayed on the caller's phone
      */
     void request_ring(const std::string& local_number, const std::string& caller_display)
     {
-        if (m_state == SipState::REGISTERED)
+        request_ring_group(std::vector<std::string>{local_number}, caller_display);
+    }
+
+    /**
+     * Call several numbers in parallel async, the first one to answer gets the call
+     *
+     * Every number gets an INVITE of its own at the same time. When one answers, the others
+     * are cancelled and reported as TARGET_CANCELLED with reason ANSWERED_ELSEWHERE. Failed
+     * targets are reported as TARGET_CANCELLED as well, only the failure of the last one is
+     * reported as CALL_CANCELLED. At most MAX_DIALOGS numbers are called.
+     *
+     * \param[in] local_numbers Numbers that are registered locally on the server, e.g. "**610"
+     * \param[in] caller_display This string is displayed on the caller's phones
+     */
+    void request_ring_group(const std::vector<std::string>& local_numbers, const std::string& caller_display)
+    {
+        if (!local_numbers.empty())
         {
-            ESP_LOGI(TAG, "Request to call %s...", local_number.c_str());
-            m_call_id = std::rand() % 2147483647;
-            m_uri = "sip:" + local_number + "@" + m_server_ip;
-            m_to_uri = "sip:" + local_number + "@" +  m_server_ip;
-            m_caller_display = caller_display;
-            xEventGroupSetBits(m_command_event_group, COMMAND_DIAL_BIT);
+            ESP_LOGI(TAG, "Request to call %s%s...", local_numbers[0].c_str(), (local_numbers.size() > 1) ? " and others" : "");
+            Command command;
+            command.type = Command::Type::DIAL;
+            command.numbers = local_numbers;
+            command.display = caller_display;
+            push_command(std::move(command));
         }
     }
 
+    /**
+     * Cancel all outgoing calls that are not answered yet async
+     */
     void request_cancel()
     {
-        if ((m_state == SipState::RINGING) || (m_state == SipState::CALL_IN_PROGRESS))
-        {
-            ESP_LOGI(TAG, "Request to CANCEL call");
-            xEventGroupSetBits(m_command_event_group, COMMAND_CANCEL_BIT);
-        }
+        ESP_LOGI(TAG, "Request to CANCEL call");
+        Command command;
+        command.type = Command::Type::CANCEL;
+        push_command(std::move(command));
+    }
+
+    /**
+     * End all calls async, answered calls get a BYE and outgoing calls that are not answered yet a CANCEL
+     */
+    void request_hang_up()
+    {
+        ESP_LOGI(TAG, "Request to hang up");
+        Command command;
+        command.type = Command::Type::HANG_UP;
+        push_command(std::move(command));
     }
 
+    /**
+     * Process one step of the state machine
+     *
+     * Blocks until a packet arrives, a command is requested or the next timer expires.
+     */
     void run()
     {
+        process_commands();
         tx();
         rx();
+        poll_transactions();
     }
 
-    //empty test function for sml transition
-    void test() const {}
+    static constexpr size_t MAX_DIALOGS = 4;    ///< number of calls that can be active at the same time
 
 private:
+    template<class> friend struct sip_registration_states;
+    template<class> friend struct sip_dialog_states;
+
+    using RequestTemplateT = SipDialog::RequestTemplateT;
+    using RegistrationStatesT = sml::sm<sip_registration_states<SipClientInt>>;
+    using DialogStatesT = sml::sm<sip_dialog_states<SipClientInt>>;
+
     enum class SipState {
         IDLE,
         REGISTER_UNAUTH,
         REGISTER_AUTH,
         REGISTERED,
-        INVITE_UNAUTH,
-        INVITE_UNAUTH_SENT,
-        INVITE_AUTH,
-        RINGING,
-        CALL_START,
-        CALL_IN_PROGRESS,
-        CANCELLED,
         ERROR,
     };
 
+    /**
+     * Request of another task, carried by the command queue
+     */
+    struct Command {
+        enum class Type {
+            DIAL,
+            CANCEL,
+            HANG_UP,
+        };
+
+        Type type = Type::DIAL;
+        std::vector<std::string> numbers;   ///< DIAL only
+        std::string display;                ///< DIAL only
+    };
 
-    void tx()
+    void push_command(Command&& command)
     {
-        switch (m_state)
+        if (!m_commands.push(std::move(command)))
         {
-        case SipState::IDLE:
-            //fall-through
-        case SipState::REGISTER_UNAUTH:
-            //sending REGISTER without auth
-            m_tag = std::rand() % 2147483647;
-            m_branch = std::rand() % 2147483647;
-            send_sip_register();
-            m_tag = std::rand() % 2147483647;
-            m_branch = std::rand() % 2147483647;
-            break;
-        case SipState::REGISTER_AUTH:
-            //sending REGISTER with auth
-            compute_auth_response("REGISTER", "sip:" + m_server_ip);
-            send_sip_register();
-            break;
-        case SipState::REGISTERED:
-            //wait for request
-            break;
-        case SipState::INVITE_UNAUTH:
-            //sending INVITE without auth
-            //m_tag = std::rand() % 2147483647;
-            m_sdp_session_id = std::rand();
-            send_sip_invite();
-            break;
-        case SipState::INVITE_UNAUTH_SENT:
-            break;
-        case SipState::INVITE_AUTH:
-            //sending INVITE with auth
-            m_branch = std::rand() % 2147483647;
-            compute_auth_response("INVITE", m_uri);
-            send_sip_invite();
-            break;
-        case SipState::RINGING:
-            if (xEventGroupWaitBits(m_command_event_group, COMMAND_CANCEL_BIT, true, true, 0))
+            ESP_LOGW(TAG, "Command queue full, request dropped");
+            return;
+        }
+        m_socket.wake();
+    }
+
+    /**
+     * Take over the requests of other tasks, in the order they were made
+     */
+    void process_commands()
+    {
+        Command command;
+        while (m_commands.pop(command))
+        {
+            if (command.type != Command::Type::DIAL)
             {
-                ESP_LOGD(TAG, "Sending cancel request");
-                send_sip_cancel();
+                end_calls(command.type == Command::Type::HANG_UP);
             }
-            break;
-        case SipState::CALL_START:
-            send_sip_ack();
-            break;
-        case SipState::CALL_IN_PROGRESS:
-            if (xEventGroupWaitBits(m_command_event_group, COMMAND_CANCEL_BIT, true, true, 0))
+            else if (m_state == SipState::REGISTERED)
             {
-                ESP_LOGD(TAG, "Sending bye request");
-                //send_sip_bye();
+                start_ring_group(command.numbers, command.display);
+            }
+            else
+            {
+                ESP_LOGW(TAG, "Not registered, call to %s dropped", command.numbers[0].c_str());
             }
-            break;
-        case SipState::CANCELLED:
-            send_sip_ack();
-            m_tag = std::rand() % 2147483647;
-            m_branch = std::rand() % 2147483647;
-            break;
-        case SipState::ERROR:
-            break;
         }
     }
 
-    void rx()
+    void end_calls(bool hang_up)
     {
-        if (m_state == SipState::REGISTERED)
+        for (SipDialog& dialog : m_dialogs)
         {
-            if (xEventGroupWaitBits(m_command_event_group, COMMAND_DIAL_BIT, true, true, 0))
+            bool answered = (dialog.state == SipDialog::State::CALL_START) || (dialog.state == SipDialog::State::CALL_IN_PROGRESS);
+            if (answered && hang_up)
             {
-                m_state = SipState::INVITE_UNAUTH;
-                log_state_transition(SipState::REGISTERED, m_state);
+                //sent once the call is in progress, the ACK of an incoming call is awaited
+                dialog.bye_requested = true;
+            }
+            else if (!answered && dialog.outgoing && (dialog.state != SipDialog::State::TERMINATED))
+            {
+                //sent once the call is ringing, a CANCEL must not be sent before a provisional response
+                dialog.cancel_requested = true;
             }
-            //return;
         }
-        else if (m_state == SipState::ERROR)
+    }
+
+    void tx()
+    {
+        m_registration_states->process_event(ev_send{});
+        for (SipDialog& dialog : m_dialogs)
         {
-            vTaskDelay(2000 / portTICK_RATE_MS);
-            m_sip_sequence_number++;
-            m_state = SipState::IDLE;
-            log_state_transition(SipState::ERROR, m_state);
-            return;
+            //a sent message may queue the next one, e.g. the ACK of a 2xx that crossed our CANCEL
+            //is followed by its BYE; no ev_send transition leads back, so this ends
+            SipDialog::State state;
+            do
+            {
+                state = dialog.state;
+                dialog_states(dialog).process_event(ev_send{});
+            } while (dialog.state != state);
         }
-        else if (m_state == SipState::INVITE_UNAUTH)
+    }
+
+    DialogStatesT& dialog_states(const SipDialog& dialog)
+    {
+        return *m_dialog_states[dialog.id];
+    }
+
+    void rx()
+    {
+        if (m_registration.check_timer(xTaskGetTickCount()))
         {
-            m_state = SipState::INVITE_UNAUTH_SENT;
-            log_state_transition(SipState::INVITE_UNAUTH, m_state);
+            //refresh when registered, retry after an error, the REGISTER is sent by the next tx()
+            m_registration_states->process_event(ev_registration_timer{});
             return;
         }
-        else if (m_state == SipState::CALL_START)
+
+        //commands wake up the socket, so only the timers limit the wait
+        //the datagram is parsed in the receive buffer, which is returned at the end of this function
+        RxDatagram datagram = m_socket.receive(next_timeout_msec());
+
+        if (datagram.empty())
         {
-            m_state = SipState::CALL_IN_PROGRESS;
-            log_state_transition(SipState::CALL_START, m_state);
             return;
         }
-
-        //The timeout is a workaround to be able to end a CANCEL request during ring
-        std::string recv_string = m_socket.receive(SOCKET_RX_TIMEOUT_MSEC);
-
-        if (recv_string.empty())
+        if (handle_keep_alive_packet(datagram.view()))
         {
             return;
         }
-
-        SipPacket packet(recv_string.c_str(), recv_string.size());
+        SipPacket packet(datagram.data(), datagram.size());
         if (!packet.parse())
         {
             ESP_LOGI(TAG, "Parsing the packet failed");
             return;
         }
 
-        SipPacket::Status reply = packet.get_status();
-        ESP_LOGV(TAG, "Parsing the packet ok, reply code=%d", (int) packet.get_status());
+        ESP_LOGV(TAG, "Parsing the packet ok, reply code=%d", packet.get_status_code());
 
-        if (reply == SipPacket::Status::SERVER_ERROR_500)
+        //retransmissions are handled by the transactions and do not reach the state machine
+        bool is_request = (packet.get_method() != SipPacket::Method::UNKNOWN);
+        SipDialog* dialog = nullptr;
+        if (!(is_request ? dispatch_request(packet) : dispatch_response(packet, dialog)))
         {
-            log_state_transition(m_state, SipState::ERROR);
-            m_state = SipState::ERROR;
             return;
         }
-        else if ((reply == SipPacket::Status::UNAUTHORIZED_401) || (reply == SipPacket::Status::PROXY_AUTH_REQ_407))
+
+        if (is_request)
+        {
+            handle_request(packet);
+            m_server_transaction = nullptr;
+        }
+        else if (dialog != nullptr)
         {
-            m_realm = packet.get_realm();
-            m_nonce = packet.get_nonce();
+            handle_dialog_response(*dialog, packet);
         }
-        else if ((reply == SipPacket::Status::UNKNOWN) &&
-                 ((packet.get_method() == SipPacket::Method::NOTIFY) ||
-                  (packet.get_method() == SipPacket::Method::BYE) ||
-                  (packet.get_method() == SipPacket::Method::INFO) ||
-                  (packet.get_method() == SipPacket::Method::INVITE)))
+        else
         {
-            send_sip_ok(packet);
+            handle_response(packet);
         }
+    }
 
-        if (!packet.get_contact().empty())
+    /**
+     * \return the time until the next timer expires, SocketT::RECEIVE_FOREVER if none is running
+     */
+    uint32_t next_timeout_msec() const
+    {
+        TickType_t next_deadline = 0;
+        bool active = m_registration.get_next_deadline(next_deadline);
+        earliest_deadline(m_request_transaction, active, next_deadline);
+        TickType_t keep_alive_deadline;
+        bool keep_alive_running = m_keep_alive.get_next_deadline(keep_alive_deadline);
+        earliest_deadline(keep_alive_running, keep_alive_deadline, active, next_deadline);
+        earliest_deadline(m_keep_alive_transaction, active, next_deadline);
+        for (const SipTransaction& transaction : m_server_transactions)
+        {
+            earliest_deadline(transaction, active, next_deadline);
+        }
+        for (const SipDialog& dialog : m_dialogs)
         {
-            m_to_contact = packet.get_contact();
+            earliest_deadline(dialog.invite_transaction, active, next_deadline);
+            earliest_deadline(dialog.request_transaction, active, next_deadline);
+            earliest_deadline(dialog.state == SipDialog::State::ALERTING, dialog.answer_deadline, active, next_deadline);
+            earliest_deadline((dialog.state == SipDialog::State::CALL_IN_PROGRESS) && (dialog.session_expires_sec != 0), dialog.session_deadline,
+                              active, next_deadline);
         }
+        if (!active)
+        {
+            return SocketT::RECEIVE_FOREVER;
+        }
+        int32_t remaining = static_cast<int32_t>(next_deadline - xTaskGetTickCount());
+        if (remaining <= 0)
+        {
+            return 0;
+        }
+        return remaining * portTICK_RATE_MS;
+    }
 
-        if (!packet.get_to_tag().empty())
+    static void earliest_deadline(const SipTransaction& transaction, bool& active, TickType_t& next_deadline)
+    {
+        TickType_t deadline;
+        bool running = transaction.get_next_deadline(deadline);
+        earliest_deadline(running, deadline, active, next_deadline);
+    }
+
+    static void earliest_deadline(bool running, TickType_t deadline, bool& active, TickType_t& next_deadline)
+    {
+        if (running && (!active || (static_cast<int32_t>(deadline - next_deadline) < 0)))
         {
-            m_to_tag = packet.get_to_tag();
+            next_deadline = deadline;
+            active = true;
         }
+    }
+
+    void start_client_transaction(SipTransaction& transaction, SipPacket::Method method, uint32_t branch_number, uint32_t cseq)
+    {
+        Buffer<32> branch;
+        branch << BRANCH_PREFIX << branch_number;
+        transaction.start_client(method, branch.view(), cseq, xTaskGetTickCount());
+    }
+
+    /**
+     * Match a response to its dialog and client transaction
+     *
+     * \param[out] dialog The dialog of the response, nullptr for a response to the REGISTER
+     * \return true if the response must be handled by the state machine
+     */
+    bool dispatch_response(const SipPacket& packet, SipDialog*& dialog)
+    {
+        //the responses of forked early dialogs differ in the To tag, so it is not compared
+        dialog = m_dialogs.find(packet.get_call_id(), packet.get_from_tag(), StringView());
 
-        SipState old_state = m_state;
-        switch (m_state)
+        SipTransaction* transaction = nullptr;
+        if (dialog != nullptr)
         {
-        case SipState::IDLE:
-            //fall-trough
-        case SipState::REGISTER_UNAUTH:
-            m_state = SipState::REGISTER_AUTH;
-            m_sip_sequence_number++;
-            break;
-        case SipState::REGISTER_AUTH:
-            if (reply == SipPacket::Status::OK_200)
-            {
-                m_sip_sequence_number++;
-                m_nonce = "";
-                m_realm = "";
-                m_response = "";
-                ESP_LOGI(TAG, "OK :)");
-                m_uri = "sip:**613@" + m_server_ip;
-                m_to_uri = "sip:**613@" +  m_server_ip;
-                m_state = SipState::REGISTERED;
-            }
-            else
+            if (dialog->invite_transaction.matches_response(packet))
             {
-                m_state = SipState::ERROR;
+                transaction = &dialog->invite_transaction;
             }
-            break;
-        case SipState::REGISTERED:
-            if (packet.get_method() == SipPacket::Method::INVITE)
+            else if (dialog->request_transaction.matches_response(packet))
             {
-                    //received an invite, answered it already with ok, so new call is established, because someone called us
-                    m_state = SipState::CALL_START;
-                    if (m_event_handler)
-                    {
-                            m_event_handler(SipClientEvent{SipClientEvent::Event::CALL_START});
-                    }
+                transaction = &dialog->request_transaction;
             }
-            break;
-        case SipState::INVITE_UNAUTH_SENT:
-        case SipState::INVITE_UNAUTH:
-            if ((reply == SipPacket::Status::UNAUTHORIZED_401) || (reply == SipPacket::Status::PROXY_AUTH_REQ_407))
+        }
+        else if (m_request_transaction.matches_response(packet))
+        {
+            transaction = &m_request_transaction;
+        }
+        else if (m_keep_alive_transaction.matches_response(packet))
+        {
+            //every final response proves that the registrar is alive, it is not passed on
+            if (m_keep_alive_transaction.on_response(packet, xTaskGetTickCount()) == SipTransaction::Result::PASS)
             {
-                m_state = SipState::INVITE_AUTH;
-                send_sip_ack();
-                m_sip_sequence_number++;
+                m_keep_alive.on_answered(xTaskGetTickCount());
             }
-            else if((reply == SipPacket::Status::OK_200) || (reply == SipPacket::Status::SESSION_PROGRESS_183))
+            return false;
+        }
+
+        if (transaction == nullptr)
+        {
+            if ((dialog != nullptr) && (dialog->state == SipDialog::State::CALL_IN_PROGRESS)
+                && (packet.get_cseq_method() == SipPacket::Method::INVITE) && (packet.get_status_class() == SipPacket::StatusClass::SUCCESS_2XX))
             {
-                m_state = SipState::RINGING;
-                m_nonce = "";
-                m_realm = "";
-                m_response = "";
-                ESP_LOGV(TAG, "Start RINGing...");
+                //the 2xx is retransmitted until our ACK arrives
+                send_sip_ack(*dialog);
             }
-            else if (reply != SipPacket::Status::TRYING_100)
+            else
             {
-                m_state = SipState::ERROR;
+                ESP_LOGD(TAG, "Dropping response %d without transaction", packet.get_status_code());
             }
+            return false;
+        }
+
+        switch (transaction->on_response(packet, xTaskGetTickCount()))
+        {
+        case SipTransaction::Result::PASS:
+            return true;
+        case SipTransaction::Result::RESEND:
+            resend(transaction->get_message());
+            break;
+        case SipTransaction::Result::ABSORB:
             break;
-        case SipState::INVITE_AUTH:
-            if ((reply == SipPacket::Status::UNAUTHORIZED_401) || (reply == SipPacket::Status::PROXY_AUTH_REQ_407))
+        }
+        return false;
+    }
+
+
+    /**
+     * Match a request to its server transaction or create a new one
+     *
+     * \return true if the request must be handled by the state machine
+     */
+    bool dispatch_request(const SipPacket& packet)
+    {
+        SipTransaction* transaction = find_server_transaction(packet);
+        if (transaction != nullptr)
+        {
+            switch (transaction->on_request(packet, xTaskGetTickCount()))
             {
-                m_state = SipState::ERROR;
+            case SipTransaction::Result::PASS:
+                return true;
+            case SipTransaction::Result::RESEND:
+                ESP_LOGD(TAG, "Answering retransmitted request");
+                resend(transaction->get_message());
+                break;
+            case SipTransaction::Result::ABSORB:
+                break;
             }
-            else if((reply == SipPacket::Status::OK_200) || (reply == SipPacket::Status::SESSION_PROGRESS_183) || (reply == SipPacket::Status::TRYING_100))
+            return false;
+        }
+
+        if (packet.get_method() == SipPacket::Method::ACK)
+        {
+            //an ACK without transaction is never answered
+            return true;
+        }
+
+        //prefer a terminated transaction, otherwise replace the oldest one
+        m_server_transaction = &m_server_transactions[m_next_server_transaction];
+        for (SipTransaction& transaction : m_server_transactions)
+        {
+            if (!transaction.is_active())
             {
-                //trying is not yet ringing, but change state to not send invite again
-                m_state = SipState::RINGING;
-                m_nonce = "";
-                m_realm = "";
-                m_response = "";
-                ESP_LOGV(TAG, "Start RINGing...");
+                m_server_transaction = &transaction;
+                break;
             }
-            else
+        }
+        if (m_server_transaction == &m_server_transactions[m_next_server_transaction])
+        {
+            m_next_server_transaction = (m_next_server_transaction + 1) % m_server_transactions.size();
+        }
+        m_server_transaction->start_server(packet);
+        return true;
+    }
+
+    /**
+     * The INVITE transaction of an incoming call is kept in its dialog, the others are in the pool
+     */
+    SipTransaction* find_server_transaction(const SipPacket& packet)
+    {
+        for (SipDialog& dialog : m_dialogs)
+        {
+            if (dialog.invite_transaction.matches_request(packet))
             {
-                m_state = SipState::ERROR;
+                return &dialog.invite_transaction;
             }
-            break;
-        case SipState::RINGING:
-            if (reply == SipPacket::Status::SESSION_PROGRESS_183)
+        }
+        for (SipTransaction& transaction : m_server_transactions)
+        {
+            if (transaction.matches_request(packet))
             {
-                //TODO parse session progress reply and send appropriate answer
-                //m_state = SipState::ERROR;
+                return &transaction;
             }
-            else if (reply == SipPacket::Status::OK_200)
+        }
+        return nullptr;
+    }
+
+    /**
+     * Evaluate the retransmission and timeout timers of all transactions
+     */
+    void poll_transactions()
+    {
+        TickType_t now = xTaskGetTickCount();
+
+        for (SipDialog& dialog : m_dialogs)
+        {
+            switch (dialog.invite_transaction.poll(now))
             {
-                //other side picked up, send an ack
-                m_state = SipState::CALL_START;
-                if (m_event_handler)
+            case SipTransaction::Action::RETRANSMIT:
+                if (dialog.outgoing)
                 {
-                    m_event_handler(SipClientEvent{SipClientEvent::Event::CALL_START});
+                    ESP_LOGD(TAG, "Retransmitting INVITE");
+                    send_sip_invite(dialog);
                 }
-            }
-            else if (reply == SipPacket::Status::REQUEST_CANCELLED_487)
-            {
-                m_state = SipState::CANCELLED;
-                if (m_event_handler)
+                else
                 {
-                    m_event_handler(SipClientEvent{SipClientEvent::Event::CALL_CANCELLED});
+                    ESP_LOGD(TAG, "Retransmitting response to INVITE");
+                    resend(dialog.invite_transaction.get_message());
                 }
+                break;
+            case SipTransaction::Action::TIMEOUT:
+                dialog_states(dialog).process_event(ev_timeout{});
+                break;
+            case SipTransaction::Action::NONE:
+                break;
             }
-            else if (reply == SipPacket::Status::PROXY_AUTH_REQ_407)
-            {
-                send_sip_ack();
-                m_sip_sequence_number++;
-                m_state = SipState::INVITE_AUTH;
-                ESP_LOGV(TAG, "Go back to send invite with auth...");
-            }
-            else if ((reply == SipPacket::Status::DECLINE_603) || (reply == SipPacket::Status::BUSY_HERE_486))
+            switch (dialog.request_transaction.poll(now))
             {
-                send_sip_ack();
-                m_sip_sequence_number++;
-                m_branch = std::rand() % 2147483647;
-                m_state = SipState::REGISTERED;
-                SipClientEvent::CancelReason cancel_reason = SipClientEvent::CancelReason::CALL_DECLINED;
-                if (reply == SipPacket::Status::BUSY_HERE_486)
-                {
-                    cancel_reason = SipClientEvent::CancelReason::TARGET_BUSY;
-                }
-                if (m_event_handler)
-                {
-                    m_event_handler(SipClientEvent{SipClientEvent::Event::CALL_CANCELLED, ' ', 0, cancel_reason});
-                }
+            case SipTransaction::Action::RETRANSMIT:
+                ESP_LOGD(TAG, "Dialog %d: retransmitting request", dialog.id);
+                send_sip_request(dialog);
+                break;
+            case SipTransaction::Action::TIMEOUT:
+                dialog_states(dialog).process_event(ev_timeout{});
+                break;
+            case SipTransaction::Action::NONE:
+                break;
             }
+        }
+
+        switch (m_request_transaction.poll(now))
+        {
+        case SipTransaction::Action::RETRANSMIT:
+            ESP_LOGD(TAG, "Retransmitting REGISTER");
+            send_sip_register();
             break;
-        case SipState::CALL_START:
-            //should not reach this point
+        case SipTransaction::Action::TIMEOUT:
+            ESP_LOGW(TAG, "REGISTER timed out");
+            m_registration_states->process_event(ev_timeout{});
             break;
-        case SipState::CALL_IN_PROGRESS:
-            if (packet.get_method() == SipPacket::Method::BYE)
-            {
-                m_sip_sequence_number++;
-                m_state = SipState::REGISTERED;
-                if (m_event_handler)
-                {
-                    m_event_handler(SipClientEvent{SipClientEvent::Event::CALL_END});
-                }
-            }
-            else if ((packet.get_method() == SipPacket::Method::INFO)
-                     && (packet.get_content_type() == SipPacket::ContentType::APPLICATION_DTMF_RELAY))
-            {
-                if (m_event_handler)
-                {
-                    m_event_handler(SipClientEvent{SipClientEvent::Event::BUTTON_PRESS, packet.get_dtmf_signal(), packet.get_dtmf_duration()});
-                }
-            }
+        case SipTransaction::Action::NONE:
             break;
-        case SipState::CANCELLED:
-            if (reply == SipPacket::Status::OK_200)
-            {
-                m_sip_sequence_number++;
-                m_state = SipState::REGISTERED;
-            }
+        }
+
+        switch (m_keep_alive_transaction.poll(now))
+        {
+        case SipTransaction::Action::RETRANSMIT:
+            send_sip_options();
+            break;
+        case SipTransaction::Action::TIMEOUT:
+            keep_alive_lost();
             break;
-        case SipState::ERROR:
-            m_sip_sequence_number++;
-            m_state = SipState::IDLE;
+        case SipTransaction::Action::NONE:
             break;
         }
+        if (m_keep_alive.check_timer(now))
+        {
+            send_keep_alive();
+        }
 
-        if (old_state != m_state)
+        for (SipTransaction& transaction : m_server_transactions)
         {
-            log_state_transition(old_state, m_state);
+            if (transaction.poll(now) == SipTransaction::Action::RETRANSMIT)
+            {
+                resend(transaction.get_message());
+            }
         }
     }
 
-    void send_sip_register()
+    void handle_request(const SipPacket& packet)
     {
-        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
-        std::string uri = "sip:" + m_server_ip;
-
-        send_sip_header("REGISTER", uri, "sip:" + m_user + "@" + m_server_ip, tx_buffer);
-
-        tx_buffer << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
-
-        if (!m_response.empty())
+        SipDialog* dialog = m_dialogs.find(packet.get_call_id(), packet.get_to_tag(), packet.get_from_tag());
+        switch (packet.get_method())
         {
-            tx_buffer << "Authorization: Digest username=\"" << m_user << "\", realm=\"" << m_realm << "\", nonce=\"" << m_nonce << "\", uri=\"" << uri << "\", algorithm=MD5, response=\"" << m_response << "\"\r\n";
-        }
-        tx_buffer << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n";
-        tx_buffer << "Expires: 3600\r\n";
-        tx_buffer << "Content-Length: 0\r\n";
-        tx_buffer << "\r\n";
+        case SipPacket::Method::ACK:
+            //ACK is never answered, the ACK of our 2xx confirms an incoming call
+            if (dialog != nullptr)
+            {
+                if (packet.get_content_type() == SipPacket::ContentType::APPLICATION_SDP)
+                {
+                    //the INVITE had no offer, the answer to our offer in the 2xx
+                    negotiate_media(*dialog, packet);
+                }
+                dialog_states(*dialog).process_event(ev_rx_ack{});
+            }
+            return;
+        case SipPacket::Method::INVITE:
+            if (packet.get_to_tag().empty())
+            {
+                accept_call(packet);
+                return;
+            }
+            //a re-INVITE refreshes the session like an UPDATE
+            // fall through
+        case SipPacket::Method::UPDATE:
+            if (dialog == nullptr)
+            {
+                send_sip_reply(481, "Call/Transaction Does Not Exist", packet, nullptr);
+                return;
+            }
+            answer_refresh(*dialog, packet);
+            return;
+        case SipPacket::Method::CANCEL:
+            //the CANCEL has no To tag, its dialog is found by the INVITE transaction
+            dialog = find_cancelled_dialog(packet);
+            if (dialog == nullptr)
+            {
+                send_sip_reply(481, "Call/Transaction Does Not Exist", packet, nullptr);
+                return;
+            }
+            send_sip_reply(200, "OK", packet, dialog);
+            break;
+        case SipPacket::Method::BYE:
+        case SipPacket::Method::INFO:
+            if (dialog == nullptr)
+            {
+                send_sip_reply(481, "Call/Transaction Does Not Exist", packet, nullptr);
+                return;
+            }
+            send_sip_reply(200, "OK", packet, dialog);
+            break;
+        case SipPacket::Method::NOTIFY:
+        case SipPacket::Method::OPTIONS:
+            send_sip_reply(200, "OK", packet, dialog);
+            break;
+        default:
+            ESP_LOGI(TAG, "Ignoring unsupported request method %d", (int) packet.get_method());
+            return;
+        }
+
+        if (dialog == nullptr)
+        {
+            return;
+        }
+        if (packet.get_method() == SipPacket::Method::CANCEL)
+        {
+            dialog_states(*dialog).process_event(ev_rx_cancel{});
+        }
+        else if (packet.get_method() == SipPacket::Method::BYE)
+        {
+            dialog_states(*dialog).process_event(ev_rx_bye{packet});
+        }
+        else if (packet.get_method() == SipPacket::Method::INFO)
+        {
+            dialog_states(*dialog).process_event(ev_rx_info{packet});
+        }
+    }
+
+    void call_end(SipDialog& dialog)
+    {
+        //a BYE may arrive before the ACK of our 2xx, the 2xx is not retransmitted anymore
+        dialog.invite_transaction.terminate();
+        report_event(SipClientEvent{SipClientEvent::Event::CALL_END, ' ', 0, SipClientEvent::CancelReason::UNKNOWN, 0, dialog.id, dialog.target});
+    }
+
+    void button_press(SipDialog& dialog, const SipPacket& packet)
+    {
+        report_event(SipClientEvent{SipClientEvent::Event::BUTTON_PRESS, packet.get_dtmf_signal(), packet.get_dtmf_duration(),
+                                    SipClientEvent::CancelReason::UNKNOWN, 0, dialog.id, dialog.target});
+    }
+
+    /**
+     * Create the dialog of an incoming INVITE, or reject the call
+     *
+     * The 100 Trying is sent before anything else. The INVITE transaction moves from the pool to
+     * the dialog, the 2xx is retransmitted by it until the ACK arrives.
+     */
+    void accept_call(const SipPacket& packet)
+    {
+        send_sip_reply(100, "Trying", packet, nullptr);
+
+        if (!is_caller_allowed(packet))
+        {
+            ESP_LOGI(TAG, "Caller %.*s is not allowed, declining the call", (int) SipPacket::get_user(packet.get_from()).size(),
+                     SipPacket::get_user(packet.get_from()).data());
+            send_sip_reply(603, "Decline", packet, nullptr);
+            return;
+        }
+        SipDialog* dialog = m_dialogs.allocate();
+        if (dialog == nullptr)
+        {
+            ESP_LOGW(TAG, "No free dialog, rejecting the call");
+            send_sip_reply(486, "Busy Here", packet, nullptr);
+            return;
+        }
+        dialog->sdp_session_id = std::rand();
+        if (!accept_offer(*dialog, packet))
+        {
+            //the dialog is still free, its state was not changed
+            send_sip_reply(488, "Not Acceptable Here", packet, nullptr);
+            return;
+        }
+        dialog->outgoing = false;
+        dialog->tag = std::rand() % 2147483647;
+        dialog->call_id << packet.get_call_id();
+        dialog->local_tag << dialog->tag;
+        dialog->remote_tag << packet.get_from_tag();
+        dialog->remote_contact = packet.get_contact().to_string();
+        dialog->to_uri = SipPacket::get_uri(packet.get_from()).to_string();
+        dialog->request_cseq = std::rand() % 2147483647;
+        set_route_set(*dialog, packet, false);
+        apply_session_expires(*dialog, packet, false);
+        //the INVITE is gone when the call is answered, so the header lines of the responses are kept
+        render_reply_header(packet, dialog, dialog->response_header);
+
+        dialog->invite_transaction = *m_server_transaction;
+        m_server_transaction->terminate();
+        m_server_transaction = &dialog->invite_transaction;
+
+        dialog_states(*dialog).process_event(ev_accept{});
+    }
+
+    /**
+     * Answer a re-INVITE or UPDATE of the other side, it refreshes the session and may change the media
+     */
+    void answer_refresh(SipDialog& dialog, const SipPacket& packet)
+    {
+        //a re-INVITE without body expects our offer, an UPDATE without body only refreshes
+        bool offer = (packet.get_method() == SipPacket::Method::INVITE) || (packet.get_content_type() == SipPacket::ContentType::APPLICATION_SDP);
+        if (offer && !accept_offer(dialog, packet))
+        {
+            send_sip_reply(488, "Not Acceptable Here", packet, &dialog);
+            return;
+        }
+        apply_session_expires(dialog, packet, false);
+        send_sip_reply(200, "OK", packet, &dialog, offer ? dialog.sdp.view() : StringView());
+        start_session_timer(dialog);
+    }
+
+    bool is_caller_allowed(const SipPacket& packet) const
+    {
+        if (m_answer_policy.allowed_callers.empty())
+        {
+            return true;
+        }
+        StringView caller = SipPacket::get_user(packet.get_from());
+        for (const std::string& allowed : m_answer_policy.allowed_callers)
+        {
+            if (caller == StringView(allowed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Negotiate the offer of an INVITE and render our answer into the SDP of the dialog
+     *
+     * An INVITE without body expects our offer in the 2xx, the answer comes with the ACK.
+     *
+     * \return false if there is no common codec
+     */
+    bool accept_offer(SipDialog& dialog, const SipPacket& packet)
+    {
+        if (packet.get_content_type() != SipPacket::ContentType::APPLICATION_SDP)
+        {
+            render_sdp(dialog, nullptr);
+            return true;
+        }
+        SdpPacket sdp(packet.get_body());
+        MediaParameters media;
+        if (!sdp.parse() || !sdp.negotiate(media))
+        {
+            ESP_LOGW(TAG, "No usable media in the SDP offer");
+            return false;
+        }
+        dialog.media = media;
+        render_sdp(dialog, &dialog.media);
+        return true;
+    }
+
+    SipDialog* find_cancelled_dialog(const SipPacket& packet)
+    {
+        for (SipDialog& dialog : m_dialogs)
+        {
+            if (!dialog.outgoing && dialog.invite_transaction.matches_cancel(packet))
+            {
+                return &dialog;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * An incoming call was accepted, start the answer delay
+     */
+    void alert(SipDialog& dialog)
+    {
+        switch (m_answer_policy.alerting)
+        {
+        case SipAnswerPolicy::Alerting::NONE:
+            break;
+        case SipAnswerPolicy::Alerting::RINGING:
+            send_invite_response(dialog, 180, "Ringing", false);
+            break;
+        case SipAnswerPolicy::Alerting::EARLY_MEDIA:
+            //an offer must not be sent in an unreliable provisional response, so only an answer is added
+            send_invite_response(dialog, 183, "Session Progress", dialog.media.valid);
+            break;
+        }
+        dialog.answer_deadline = xTaskGetTickCount() + m_answer_policy.answer_delay_msec / portTICK_RATE_MS;
+    }
+
+    bool is_answer_due(const SipDialog& dialog) const
+    {
+        return static_cast<int32_t>(xTaskGetTickCount() - dialog.answer_deadline) >= 0;
+    }
+
+    void answer_call(SipDialog& dialog)
+    {
+        send_invite_response(dialog, 200, "OK", true);
+        start_session_timer(dialog);
+        report_event(SipClientEvent{SipClientEvent::Event::CALL_START, ' ', 0, SipClientEvent::CancelReason::UNKNOWN, 0, dialog.id});
+    }
+
+    /**
+     * The caller sent a CANCEL before the call was answered
+     */
+    void caller_cancelled(SipDialog& dialog)
+    {
+        send_invite_response(dialog, 487, "Request Terminated", false);
+        report_call_failed(dialog, SipClientEvent::CancelReason::CALL_CANCELLED, 487);
+    }
+
+    /**
+     * Handle a response to the REGISTER
+     */
+    void handle_response(const SipPacket& packet)
+    {
+        if (sip_guards::is_auth_challenge(packet))
+        {
+            m_digest.on_challenge(packet);
+        }
+        process_response(*m_registration_states, packet);
+    }
+
+    /**
+     * Handle a response to a request of a dialog
+     */
+    void handle_dialog_response(SipDialog& dialog, const SipPacket& packet)
+    {
+        SipPacket::StatusClass reply_class = packet.get_status_class();
+
+        if (!packet.get_contact().empty())
+        {
+            dialog.remote_contact = packet.get_contact().to_string();
+        }
+        if (!packet.get_to_tag().empty())
+        {
+            dialog.remote_tag.clear();
+            dialog.remote_tag << packet.get_to_tag();
+        }
+        if (sip_guards::is_auth_challenge(packet))
+        {
+            m_digest.on_challenge(packet);
+        }
+
+        if ((packet.get_cseq_method() == SipPacket::Method::INVITE)
+            && ((reply_class == SipPacket::StatusClass::PROVISIONAL_1XX) || (reply_class == SipPacket::StatusClass::SUCCESS_2XX))
+            && (packet.get_content_type() == SipPacket::ContentType::APPLICATION_SDP))
+        {
+            //the answer to the offer of the INVITE, a 183 session progress carries an early media answer
+            negotiate_media(dialog, packet);
+        }
+
+        process_response(dialog_states(dialog), packet);
+    }
+
+    void negotiate_media(SipDialog& dialog, const SipPacket& packet)
+    {
+        SdpPacket sdp(packet.get_body());
+        MediaParameters media;
+        if (!sdp.parse() || !sdp.negotiate(media))
+        {
+            ESP_LOGW(TAG, "No usable media in the SDP answer");
+            return;
+        }
+        dialog.media = media;
+        ESP_LOGI(TAG, "Media %s:%d, payload type %d, telephone-event %d, ptime %d", dialog.media.remote_address.data(), dialog.media.remote_port,
+                dialog.media.payload_type, dialog.media.telephone_event_payload_type, dialog.media.ptime);
+    }
+
+    void registered(const SipPacket& packet)
+    {
+        bool was_registered = m_registration.is_registered();
+        Buffer<128> contact_uri;
+        contact_uri << "sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT;
+        m_registration.on_registered(packet, contact_uri.view(), xTaskGetTickCount());
+        m_sip_sequence_number++;
+        m_keep_alive.start(xTaskGetTickCount());
+        ESP_LOGI(TAG, "OK :)");
+        if (!was_registered)
+        {
+            report_event(SipClientEvent{SipClientEvent::Event::REGISTERED});
+        }
+    }
+
+    /**
+     * Entered the error state, a running refresh timer is replaced by the retry
+     */
+    void registration_failed()
+    {
+        m_registration.on_failed(xTaskGetTickCount());
+        m_keep_alive.stop();
+        m_keep_alive_transaction.terminate();
+        report_event(SipClientEvent{SipClientEvent::Event::REGISTRATION_FAILED});
+    }
+
+    /**
+     * Send a new REGISTER, retransmissions are done by the transaction
+     */
+    void send_register(bool auth)
+    {
+        if (!auth)
+        {
+            m_tag = std::rand() % 2147483647;
+        }
+        //once challenged, the REGISTER carries the credentials at once, also the refreshes
+        Buffer<64> uri;
+        uri << "sip:" << m_server_ip;
+        m_digest.authorize(SipPacket::Method::REGISTER, uri.view(), StringView(), m_authorization);
+        m_branch = std::rand() % 2147483647;
+        send_sip_register();
+        start_client_transaction(m_request_transaction, SipPacket::Method::REGISTER, m_branch, m_sip_sequence_number);
+    }
+
+    /**
+     * The ping interval elapsed, the last ping must be answered by now
+     */
+    void send_keep_alive()
+    {
+        TickType_t now = xTaskGetTickCount();
+        if (m_keep_alive.is_pending() && keep_alive_lost())
+        {
+            return;
+        }
+        if ((m_state != SipState::REGISTERED) || m_request_transaction.is_pending())
+        {
+            //the REGISTER checks the registrar itself
+            m_keep_alive.start(now);
+            return;
+        }
+
+        if (m_keep_alive.get_mode() == SipKeepAlive::Mode::CRLF)
+        {
+            TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+            tx_buffer << "\r\n\r\n";
+            m_socket.send_buffered_data();
+        }
+        else
+        {
+            m_keep_alive_cseq++;
+            m_keep_alive_branch = std::rand() % 2147483647;
+            send_sip_options();
+            start_client_transaction(m_keep_alive_transaction, SipPacket::Method::OPTIONS, m_keep_alive_branch, m_keep_alive_cseq);
+        }
+        m_keep_alive.on_sent(now);
+    }
+
+    /**
+     * \return true if the registrar is considered dead, the REGISTER is sent by the next tx()
+     */
+    bool keep_alive_lost()
+    {
+        m_keep_alive_transaction.terminate();
+        if (!m_keep_alive.on_lost())
+        {
+            return false;
+        }
+        ESP_LOGW(TAG, "Registrar does not answer, registering again");
+        m_keep_alive.stop();
+        m_registration.stop_timer();
+        m_registration_states->process_event(ev_registration_timer{});
+        return true;
+    }
+
+    /**
+     * Answer a double CRLF ping of the server, take a single CRLF as pong (RFC 5626 section 4.4.1)
+     *
+     * \return true if the packet was a ping or a pong
+     */
+    bool handle_keep_alive_packet(StringView packet)
+    {
+        if (packet == "\r\n\r\n")
+        {
+            TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+            tx_buffer << "\r\n";
+            m_socket.send_buffered_data();
+            return true;
+        }
+        if (packet == "\r\n")
+        {
+            if (m_keep_alive.get_mode() == SipKeepAlive::Mode::CRLF)
+            {
+                m_keep_alive.on_answered(xTaskGetTickCount());
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Create the dialogs of all targets of a ring group, the INVITEs are sent by tx()
+     */
+    void start_ring_group(const std::vector<std::string>& local_numbers, const std::string& caller_display)
+    {
+        m_ring_group++;
+        if (m_ring_group == 0)
+        {
+            m_ring_group++;
+        }
+
+        size_t started = 0;
+        for (size_t i = 0; i < local_numbers.size(); i++)
+        {
+            if (start_call(local_numbers[i], caller_display, m_ring_group, i))
+            {
+                started++;
+            }
+        }
+        if (started == 0)
+        {
+            report_event(SipClientEvent{SipClientEvent::Event::CALL_CANCELLED});
+        }
+    }
+
+    /**
+     * Create the dialog of an outgoing call
+     *
+     * \return false if all dialogs are in use
+     */
+    bool start_call(const std::string& local_number, const std::string& caller_display, uint8_t group, uint8_t target)
+    {
+        SipDialog* dialog = m_dialogs.allocate();
+        if (dialog == nullptr)
+        {
+            ESP_LOGW(TAG, "No free dialog, not calling %s", local_number.c_str());
+            return false;
+        }
+        dialog->outgoing = true;
+        dialog->group = group;
+        dialog->target = target;
+        dialog->tag = std::rand() % 2147483647;
+        dialog->branch = std::rand() % 2147483647;
+        dialog->cseq = std::rand() % 2147483647;
+        dialog->call_id << static_cast<uint32_t>(std::rand() % 2147483647) << "@" << m_my_ip;
+        dialog->local_tag << dialog->tag;
+        dialog->uri = "sip:" + local_number + "@" + m_server_ip;
+        dialog->to_uri = dialog->uri;
+        dialog->caller_display = caller_display;
+        dialog_states(*dialog).process_event(ev_dial{});
+        return true;
+    }
+
+    /**
+     * Send a new INVITE, retransmissions are done by the transaction
+     */
+    void send_invite(SipDialog& dialog, bool auth)
+    {
+        if (auth)
+        {
+            dialog.branch = std::rand() % 2147483647;
+        }
+        else
+        {
+            dialog.sdp_session_id = std::rand();
+            render_call_templates(dialog);
+        }
+        //with the credentials of the registration the INVITE is usually not challenged again
+        m_digest.authorize(SipPacket::Method::INVITE, dialog.uri, dialog.sdp.view(), dialog.authorization);
+        send_sip_invite(dialog);
+        start_client_transaction(dialog.invite_transaction, SipPacket::Method::INVITE, dialog.branch, dialog.cseq);
+        //later requests of the dialog count on from the CSeq of the INVITE
+        dialog.request_cseq = dialog.cseq;
+    }
+
+    /**
+     * The INVITE was challenged, it is sent again with authorization in the next tx()
+     */
+    void invite_challenged(SipDialog& dialog)
+    {
+        send_sip_ack(dialog);
+        dialog.cseq++;
+    }
+
+    void send_cancel(SipDialog& dialog)
+    {
+        ESP_LOGD(TAG, "Sending cancel request");
+        dialog.cancel_requested = false;
+        //the CANCEL has the CSeq number and the branch of the INVITE, it is matched by its method
+        dialog.request_cseq = dialog.cseq;
+        dialog.request_branch = dialog.branch;
+        send_sip_request(dialog);
+        start_client_transaction(dialog.request_transaction, SipPacket::Method::CANCEL, dialog.request_branch, dialog.request_cseq);
+        dialog.invite_transaction.expect_final_response(xTaskGetTickCount());
+    }
+
+    /**
+     * Hang up an answered call, the end of the call is reported at once
+     */
+    void send_bye(SipDialog& dialog)
+    {
+        ESP_LOGD(TAG, "Sending bye request");
+        dialog.bye_requested = false;
+        //a pending UPDATE is given up
+        dialog.request_transaction.terminate();
+        send_in_dialog_request(dialog, SipPacket::Method::BYE);
+        if (dialog.answered_elsewhere)
+        {
+            //the call was never reported as started
+            report_call_failed(dialog, SipClientEvent::CancelReason::ANSWERED_ELSEWHERE, 0);
+        }
+        else
+        {
+            report_event(SipClientEvent{SipClientEvent::Event::CALL_END, ' ', 0, SipClientEvent::CancelReason::UNKNOWN, 0, dialog.id, dialog.target});
+        }
+    }
+
+    /**
+     * Refresh the session, RFC 4028 section 7.4
+     */
+    void send_update(SipDialog& dialog)
+    {
+        ESP_LOGD(TAG, "Dialog %d: refreshing the session", dialog.id);
+        send_in_dialog_request(dialog, SipPacket::Method::UPDATE);
+    }
+
+    void send_in_dialog_request(SipDialog& dialog, SipPacket::Method method)
+    {
+        dialog.request_cseq++;
+        dialog.request_branch = std::rand() % 2147483647;
+        render_in_dialog_template(dialog, method);
+        send_sip_request(dialog);
+        start_client_transaction(dialog.request_transaction, method, dialog.request_branch, dialog.request_cseq);
+    }
+
+    void session_refreshed(SipDialog& dialog, const SipPacket& packet)
+    {
+        apply_session_expires(dialog, packet, true);
+        start_session_timer(dialog);
+    }
+
+    /**
+     * The UPDATE was rejected, but the dialog still exists, the session ends when it expires
+     */
+    void refresh_rejected(SipDialog& dialog)
+    {
+        ESP_LOGW(TAG, "Dialog %d: session refresh rejected", dialog.id);
+        uint32_t interval = dialog.session_expires_sec;
+        uint32_t margin = std::min<uint32_t>(32, interval / 3);
+        dialog.session_refresher = false;
+        dialog.session_deadline = xTaskGetTickCount() + ((interval / 2 > margin) ? interval / 2 - margin : 0) * 1000 / portTICK_RATE_MS;
+    }
+
+    /**
+     * The other side did not refresh the session in time
+     */
+    void session_expired(SipDialog& dialog)
+    {
+        ESP_LOGW(TAG, "Dialog %d: session expired", dialog.id);
+        send_bye(dialog);
+    }
+
+    /**
+     * Take over the session interval and the refresher of a Session-Expires header (RFC 4028)
+     *
+     * \param[in] local_uac We sent the request of the packet, or the packet is the request of the other side
+     */
+    void apply_session_expires(SipDialog& dialog, const SipPacket& packet, bool local_uac)
+    {
+        uint32_t interval = 0;
+        StringView refresher;
+        if (!packet.get_session_expires(interval, refresher))
+        {
+            if (local_uac || (m_session_expires_sec == 0))
+            {
+                //the other side does not support session timers, or we do not want them
+                dialog.session_expires_sec = 0;
+                return;
+            }
+            //a request without Session-Expires may get one in the response, we are the refresher then
+            interval = m_session_expires_sec;
+            refresher = "uas";
+        }
+        dialog.session_expires_sec = interval;
+        if (local_uac)
+        {
+            dialog.session_refresher = !refresher.equals_ignore_case("uas");
+        }
+        else
+        {
+            dialog.session_refresher = !refresher.equals_ignore_case("uac");
+        }
+    }
+
+    /**
+     * The refresher refreshes at half of the session interval, the other side hangs up shortly before the expiry
+     */
+    void start_session_timer(SipDialog& dialog)
+    {
+        uint32_t interval = dialog.session_expires_sec;
+        if (interval == 0)
+        {
+            return;
+        }
+        uint32_t delay_sec = dialog.session_refresher ? interval / 2 : interval - std::min<uint32_t>(32, interval / 3);
+        dialog.session_deadline = xTaskGetTickCount() + delay_sec * 1000 / portTICK_RATE_MS;
+        ESP_LOGD(TAG, "Dialog %d: session interval %d sec, %s refresh", dialog.id, (int) interval, dialog.session_refresher ? "we" : "they");
+    }
+
+    bool is_session_timer_due(const SipDialog& dialog) const
+    {
+        return (dialog.session_expires_sec != 0) && (static_cast<int32_t>(xTaskGetTickCount() - dialog.session_deadline) >= 0);
+    }
+
+    void start_ringing(SipDialog& dialog)
+    {
+        dialog.authorization.clear();
+        ESP_LOGV(TAG, "Start RINGing...");
+    }
+
+    void call_start(SipDialog& dialog, const SipPacket& packet)
+    {
+        //the route set of the dialog is the Record-Route of the 2xx in reverse order
+        set_route_set(dialog, packet, true);
+        render_dialog_ack_template(dialog);
+        //the ACK of a 2xx is a transaction of its own
+        dialog.branch = std::rand() % 2147483647;
+        dialog.authorization.clear();
+        if (dialog.answered_elsewhere)
+        {
+            //the 2xx crossed our CANCEL, the call is acknowledged and hung up again
+            ESP_LOGW(TAG, "Dialog %d: answered after another target of the ring group", dialog.id);
+            dialog.bye_requested = true;
+            return;
+        }
+        if (dialog.cancel_requested)
+        {
+            //hung up before a provisional response allowed a CANCEL, the answered call is ended instead
+            ESP_LOGW(TAG, "Dialog %d: answered after the hang-up", dialog.id);
+            dialog.cancel_requested = false;
+            dialog.bye_requested = true;
+            return;
+        }
+        apply_session_expires(dialog, packet, true);
+        start_session_timer(dialog);
+        cancel_ring_group(dialog);
+        report_event(SipClientEvent{SipClientEvent::Event::CALL_START, ' ', 0, SipClientEvent::CancelReason::UNKNOWN, 0, dialog.id, dialog.target});
+    }
+
+    /**
+     * Cancel the other targets of the ring group of the answered dialog
+     */
+    void cancel_ring_group(const SipDialog& answered)
+    {
+        if (answered.group == 0)
+        {
+            return;
+        }
+        for (SipDialog& dialog : m_dialogs)
+        {
+            if ((&dialog != &answered) && (dialog.group == answered.group) && (dialog.state != SipDialog::State::TERMINATED))
+            {
+                ESP_LOGI(TAG, "Dialog %d: cancelling, answered elsewhere", dialog.id);
+                dialog.answered_elsewhere = true;
+                dialog.cancel_requested = true;
+                render_cancel_template(dialog);
+            }
+        }
+    }
+
+    /**
+     * Give up a challenged target of a ring group before its authenticated INVITE is sent, another target answered
+     */
+    void drop_call(SipDialog& dialog)
+    {
+        report_call_failed(dialog, SipClientEvent::CancelReason::ANSWERED_ELSEWHERE, 0);
+    }
+
+    /**
+     * \return true if another dialog of the ring group of dialog is ringing or answered
+     */
+    bool is_ring_group_active(const SipDialog& dialog) const
+    {
+        if (dialog.group == 0)
+        {
+            return false;
+        }
+        for (const SipDialog& other : m_dialogs)
+        {
+            if ((&other != &dialog) && (other.group == dialog.group) && (other.state != SipDialog::State::TERMINATED))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        m_socket.send_buffered_data();
+    /**
+     * Hand an event to the application, never blocks the SIP task
+     */
+    void report_event(const SipClientEvent& event)
+    {
+        if (!m_events.push(SipClientEvent(event)))
+        {
+            m_events_dropped.fetch_add(1, std::memory_order_relaxed);
+            ESP_LOGW(TAG, "Event queue full, event %d dropped", (int) event.event);
+            return;
+        }
+        m_events_queued.fetch_add(1, std::memory_order_relaxed);
+        xEventGroupSetBits(m_event_group, EVENT_QUEUED_BIT);
     }
 
-    void send_sip_invite()
+    /**
+     * Report the failure of an outgoing call
+     *
+     * The failure of a target of a ring group is only a failure of the call if no other target is left.
+     */
+    void report_call_failed(const SipDialog& dialog, SipClientEvent::CancelReason reason, uint16_t status_code)
     {
-        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+        SipClientEvent::Event event = SipClientEvent::Event::CALL_CANCELLED;
+        if (dialog.answered_elsewhere)
+        {
+            event = SipClientEvent::Event::TARGET_CANCELLED;
+            reason = SipClientEvent::CancelReason::ANSWERED_ELSEWHERE;
+        }
+        else if (is_ring_group_active(dialog))
+        {
+            event = SipClientEvent::Event::TARGET_CANCELLED;
+        }
+        report_event(SipClientEvent{event, ' ', 0, reason, status_code, dialog.id, dialog.target});
+    }
+
+    /**
+     * Render the Route header lines of the dialog once, they are reused by all in-dialog requests
+     *
+     * \param[in] reverse The UAC uses the Record-Route values in reverse order, the UAS in received order
+     */
+    void set_route_set(SipDialog& dialog, const SipPacket& packet, bool reverse)
+    {
+        SipPacket::Values record_routes = packet.get_record_routes();
+        dialog.route_set.clear();
+        for (size_t i = 0; i < record_routes.size(); i++)
+        {
+            StringView route = record_routes[reverse ? record_routes.size() - 1 - i : i];
+            dialog.route_set.append("Route: ").append(route.data(), route.size()).append("\r\n");
+        }
+    }
 
-        send_sip_header("INVITE", m_uri, m_to_uri, tx_buffer);
+    /**
+     * Handle a final non 2xx response to our INVITE
+     */
+    void call_failed(SipDialog& dialog, const SipPacket& packet)
+    {
+        send_sip_ack(dialog);
+        report_call_failed(dialog, cancel_reason(packet), packet.get_status_code());
+    }
 
-        tx_buffer << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
+    /**
+     * The INVITE transaction timed out, no final response arrived
+     */
+    void call_timeout(SipDialog& dialog)
+    {
+        bool cancelled = (dialog.state == SipDialog::State::CANCELLED);
+        ESP_LOGW(TAG, "INVITE timed out");
+        SipClientEvent::CancelReason reason = cancelled ? SipClientEvent::CancelReason::CALL_CANCELLED : SipClientEvent::CancelReason::TARGET_UNAVAILABLE;
+        uint16_t status_code = cancelled ? 0 : static_cast<uint16_t>(SipPacket::Status::REQUEST_TIMEOUT_408);
+        report_call_failed(dialog, reason, status_code);
+    }
 
-        if (!m_response.empty())
+    static SipClientEvent::CancelReason cancel_reason(const SipPacket& packet)
+    {
+        switch (packet.get_status())
         {
-            //tx_buffer << "Proxy-Authorization: Digest username=\"" << m_user << "\", realm=\"" << m_realm << "\", nonce=\"" << m_nonce << "\", uri=\"" << m_uri << "\", response=\"" << m_response << "\"\r\n";
-            tx_buffer << "Authorization: Digest username=\"" << m_user << "\", realm=\"" << m_realm << "\", nonce=\"" << m_nonce << "\", uri=\"" << m_uri << "\", response=\"" << m_response << "\"\r\n";
+        case SipPacket::Status::REQUEST_CANCELLED_487:
+            return SipClientEvent::CancelReason::CALL_CANCELLED;
+        case SipPacket::Status::DECLINE_603:
+            return SipClientEvent::CancelReason::CALL_DECLINED;
+        case SipPacket::Status::BUSY_HERE_486:
+        case SipPacket::Status::BUSY_EVERYWHERE_600:
+            return SipClientEvent::CancelReason::TARGET_BUSY;
+        case SipPacket::Status::NOT_FOUND_404:
+        case SipPacket::Status::REQUEST_TIMEOUT_408:
+        case SipPacket::Status::GONE_410:
+        case SipPacket::Status::TEMPORARILY_UNAVAILABLE_480:
+        case SipPacket::Status::ADDRESS_INCOMPLETE_484:
+        case SipPacket::Status::DOES_NOT_EXIST_ANYWHERE_604:
+            return SipClientEvent::CancelReason::TARGET_UNAVAILABLE;
+        case SipPacket::Status::NOT_ACCEPTABLE_406:
+        case SipPacket::Status::NOT_ACCEPTABLE_HERE_488:
+        case SipPacket::Status::NOT_ACCEPTABLE_606:
+            return SipClientEvent::CancelReason::MEDIA_NOT_ACCEPTABLE;
+        default:
+            break;
         }
-        tx_buffer << "Content-Type: application/sdp\r\n";
-        tx_buffer << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n";
-        m_tx_sdp_buffer.clear();
-        m_tx_sdp_buffer << "v=0\r\n"
-                << "o=" << m_user << " " << m_sdp_session_id << " " << m_sdp_session_id << " IN IP4 " << m_my_ip << "\r\n"
-                << "s=sip-client/0.0.1\r\n"
-                << "c=IN IP4 " << m_my_ip << "\r\n"
-                << "t=0 0\r\n"
-                << "m=audio "<< LOCAL_RTP_PORT << " RTP/AVP 0 8 101\r\n"
-                //<< "a=sendrecv\r\n"
-                << "a=recvonly\r\n"
-                << "a=rtpmap:101 telephone-event/8000\r\n"
-                << "a=fmtp:101 0-15\r\n"
-                << "a=ptime:20\r\n";
-
-        tx_buffer << "Content-Length: " << m_tx_sdp_buffer.size() << "\r\n";
-        tx_buffer << "\r\n";
-        tx_buffer << m_tx_sdp_buffer.data();
+        return SipClientEvent::CancelReason::UNKNOWN;
+    }
 
-        m_socket.send_buffered_data();
+
+    /**
+     * Render the REGISTER request, once per registration
+     */
+    void render_register_template()
+    {
+        Buffer<128> call_id;
+        call_id << m_call_id << "@" << m_my_ip;
+        m_register_template.clear();
+        render_request_header(SipPacket::Method::REGISTER, "sip:" + m_server_ip, "sip:" + m_user + "@" + m_server_ip, call_id.view(), m_user, m_register_template);
+        m_register_template << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
+        m_register_template << RequestTemplateT::Slot::AUTHORIZATION;
+        m_register_template << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n";
+        m_register_template << "Expires: " << m_registration.get_requested_expires() << "\r\n";
+        m_register_template << "Content-Length: 0\r\n";
+        m_register_template << "\r\n";
     }
 
     /**
-     * CANCEL a pending INVITE
+     * Render the requests of an outgoing call, once per call
      *
-     * To match the INVITE, the following parameter must not be changed:
-     * * CSeq
-     * * From tag value
+     * The ACK rendered here answers a non 2xx final response, it is replaced in call_start().
      */
-    void send_sip_cancel()
+    void render_call_templates(SipDialog& dialog)
     {
-        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
-
-        send_sip_header("CANCEL", m_uri, m_to_uri, tx_buffer);
-
-        if (!m_response.empty())
+        dialog.invite_template.clear();
+        render_request_header(SipPacket::Method::INVITE, dialog.uri, dialog.to_uri, dialog.call_id.view(), dialog.caller_display, dialog.invite_template);
+        dialog.invite_template << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
+        dialog.invite_template << RequestTemplateT::Slot::AUTHORIZATION;
+        dialog.invite_template << "Content-Type: application/sdp\r\n";
+        dialog.invite_template << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n";
+        if (m_session_expires_sec != 0)
         {
-            tx_buffer << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
-            tx_buffer << "Content-Type: application/sdp\r\n";
-            tx_buffer << "Authorization: Digest username=\"" << m_user << "\", realm=\"" << m_realm << "\", nonce=\"" << m_nonce << "\", uri=\"" << m_uri << "\", response=\"" << m_response << "\"\r\n";
+            dialog.invite_template << "Supported: timer\r\n";
+            dialog.invite_template << "Session-Expires: " << m_session_expires_sec << "\r\n";
         }
-        tx_buffer << "Content-Length: 0\r\n";
-        tx_buffer << "\r\n";
+        dialog.invite_template << "Content-Length: " << RequestTemplateT::Slot::CONTENT_LENGTH << "\r\n";
+        dialog.invite_template << "\r\n";
 
-        m_socket.send_buffered_data();
+        render_sdp(dialog, nullptr);
+        render_cancel_template(dialog);
+
+        dialog.ack_template.clear();
+        render_request_header(SipPacket::Method::ACK, dialog.uri, dialog.to_uri, dialog.call_id.view(), dialog.caller_display, dialog.ack_template);
+        dialog.ack_template << "Content-Length: 0\r\n";
+        dialog.ack_template << "\r\n";
     }
 
-    void send_sip_ack()
+    /**
+     * Render our offer with all supported codecs, or the answer with the codec selected from an offer
+     */
+    void render_sdp(SipDialog& dialog, const MediaParameters* answer)
     {
-        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
-        if (m_state == SipState::CALL_START)
-        {
-            send_sip_header("ACK", m_to_contact, m_to_uri, tx_buffer);
-            //std::string m_sdp_session_o;
-            //std::string m_sdp_session_s;
-            //std::string m_sdp_session_c;
-            //m_tx_sdp_buffer.clear();
-            //TODO: populate sdp body
-            //m_tx_sdp_buffer << "v=0\r\n"
-            //	              << m_sdp_session_o << "\r\n"
-            //	      << m_sdp_session_s << "\r\n"
-            //	      << m_sdp_session_c << "\r\n"
-            //	      << "t=0 0\r\n";
-            //TODO: copy each m line and select appropriate a line
-            //tx_buffer << "Content-Type: application/sdp\r\n";
-            //tx_buffer << "Content-Length: " << m_tx_sdp_buffer.size() << "\r\n";
-            //tx_buffer << "Allow-Events: telephone-event\r\n";
-            tx_buffer << "Content-Length: 0\r\n";
-            tx_buffer << "\r\n";
-            //tx_buffer << m_tx_sdp_buffer.data();
+        dialog.sdp.clear();
+        dialog.sdp << "v=0\r\n"
+                << "o=" << m_user << " " << dialog.sdp_session_id << " " << dialog.sdp_session_id << " IN IP4 " << m_my_ip << "\r\n"
+                << "s=sip-client/0.0.1\r\n"
+                << "c=IN IP4 " << m_my_ip << "\r\n"
+                << "t=0 0\r\n";
+        if (answer == nullptr)
+        {
+            dialog.sdp << "m=audio "<< LOCAL_RTP_PORT << " RTP/AVP 0 8 101\r\n"
+                    //<< "a=sendrecv\r\n"
+                    << "a=recvonly\r\n"
+                    << "a=rtpmap:101 telephone-event/8000\r\n"
+                    << "a=fmtp:101 0-15\r\n";
         }
         else
         {
-            send_sip_header("ACK", m_uri, m_to_uri, tx_buffer);
-            tx_buffer << "Content-Length: 0\r\n";
-            tx_buffer << "\r\n";
+            uint32_t telephone_event = static_cast<uint32_t>(answer->telephone_event_payload_type);
+            dialog.sdp << "m=audio "<< LOCAL_RTP_PORT << " RTP/AVP " << static_cast<uint32_t>(answer->payload_type);
+            if (answer->telephone_event_payload_type >= 0)
+            {
+                dialog.sdp << " " << telephone_event;
+            }
+            dialog.sdp << "\r\n";
+            //an offer to only receive can not be answered with recvonly (RFC 3264 section 6.1)
+            bool remote_receives_only = (answer->remote_direction == MediaParameters::Direction::RECVONLY)
+                                        || (answer->remote_direction == MediaParameters::Direction::INACTIVE);
+            dialog.sdp << (remote_receives_only ? "a=inactive\r\n" : "a=recvonly\r\n");
+            if (answer->telephone_event_payload_type >= 0)
+            {
+                dialog.sdp << "a=rtpmap:" << telephone_event << " telephone-event/8000\r\n"
+                        << "a=fmtp:" << telephone_event << " 0-15\r\n";
+            }
         }
-        m_socket.send_buffered_data();
+        dialog.sdp << "a=ptime:20\r\n";
     }
 
-    void send_sip_ok(const SipPacket& packet)
+    /**
+     * To match the INVITE, the CANCEL must use the same CSeq number, From tag and branch
+     */
+    void render_cancel_template(SipDialog& dialog)
     {
-        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+        dialog.request_template.clear();
+        render_request_header(SipPacket::Method::CANCEL, dialog.uri, dialog.to_uri, dialog.call_id.view(), dialog.caller_display, dialog.request_template);
+        dialog.request_template << RequestTemplateT::Slot::AUTHORIZATION;
+        if (dialog.answered_elsewhere)
+        {
+            //RFC 3326, phones do not list the call as missed
+            dialog.request_template << "Reason: SIP;cause=200;text=\"Call completed elsewhere\"\r\n";
+        }
+        dialog.request_template << "Content-Length: 0\r\n";
+        dialog.request_template << "\r\n";
+    }
+
+    /**
+     * Render a BYE or UPDATE, it is sent to the remote target along the route set
+     */
+    void render_in_dialog_template(SipDialog& dialog, SipPacket::Method method)
+    {
+        dialog.request_template.clear();
+        render_request_header(method, dialog.remote_contact, dialog.to_uri, dialog.call_id.view(), dialog.caller_display, dialog.request_template);
+        dialog.request_template << dialog.route_set;
+        if (method == SipPacket::Method::UPDATE)
+        {
+            dialog.request_template << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
+            dialog.request_template << "Supported: timer\r\n";
+            dialog.request_template << "Session-Expires: " << dialog.session_expires_sec << ";refresher=uac\r\n";
+        }
+        dialog.request_template << "Content-Length: 0\r\n";
+        dialog.request_template << "\r\n";
+    }
 
-        send_sip_reply_header("200 OK", packet, tx_buffer);
-        tx_buffer << "Content-Length: 0\r\n";
-        tx_buffer << "\r\n";
+    /**
+     * Render the ACK for the 2xx of the INVITE, it is sent to the remote target along the route set
+     */
+    void render_dialog_ack_template(SipDialog& dialog)
+    {
+        dialog.ack_template.clear();
+        render_request_header(SipPacket::Method::ACK, dialog.remote_contact, dialog.to_uri, dialog.call_id.view(), dialog.caller_display, dialog.ack_template);
+        dialog.ack_template << dialog.route_set;
+        //the offer was sent with the INVITE and answered by the 2xx, so the ACK has no body
+        dialog.ack_template << "Content-Length: 0\r\n";
+        dialog.ack_template << "\r\n";
+    }
 
-        m_socket.send_buffered_data();
+    /**
+     * Render the OPTIONS ping to the registrar, once per registration
+     */
+    void render_keep_alive_template()
+    {
+        Buffer<128> call_id;
+        call_id << m_keep_alive_call_id << "@" << m_my_ip;
+        m_keep_alive_template.clear();
+        render_request_header(SipPacket::Method::OPTIONS, "sip:" + m_server_ip, "sip:" + m_server_ip, call_id.view(), m_user, m_keep_alive_template);
+        m_keep_alive_template << "Accept: application/sdp\r\n";
+        m_keep_alive_template << "Content-Length: 0\r\n";
+        m_keep_alive_template << "\r\n";
     }
 
-    void send_sip_header(const std::string& command, const std::string& uri, const std::string& to_uri, TxBufferT& stream)
+    typename RequestTemplateT::SlotValues register_values() const
     {
-        stream << command << " " << uri << " SIP/2.0\r\n";
+        typename RequestTemplateT::SlotValues values;
+        values.cseq = m_sip_sequence_number;
+        values.branch = m_branch;
+        values.tag = m_tag;
+        values.authorization = m_authorization.view();
+        return values;
+    }
 
-        stream << "CSeq: " << m_sip_sequence_number << " " << command << "\r\n";
-        stream << "Call-ID: " << m_call_id << "@" << m_my_ip << "\r\n";
-        stream << "Max-Forwards: 70\r\n";
-        stream << "User-Agent: sip-client/0.0.1\r\n";
-        if (command == "REGISTER")
+    typename RequestTemplateT::SlotValues dialog_values(const SipDialog& dialog) const
+    {
+        typename RequestTemplateT::SlotValues values;
+        values.cseq = dialog.cseq;
+        values.branch = dialog.branch;
+        values.tag = dialog.tag;
+        values.to_tag = dialog.remote_tag.view();
+        values.authorization = dialog.authorization.view();
+        return values;
+    }
+
+    /**
+     * Render a request into the transmit buffer of the socket
+     *
+     * \return nullptr if the template can not be used
+     */
+    TxBufferT* render_request(const RequestTemplateT& request, typename RequestTemplateT::SlotValues values, StringView body)
+    {
+        if (request.empty() || request.is_overflow())
         {
-            stream << "From: <sip:" << m_user << "@" << m_server_ip << ">;tag=" << m_tag << "\r\n";
+            ESP_LOGE(TAG, "Request template is not rendered or too big, not sending it");
+            return nullptr;
         }
-        else if (command == "INVITE")
+        values.content_length = body.size();
+
+        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+        request.render(tx_buffer, values);
+        tx_buffer << body;
+        return &tx_buffer;
+    }
+
+    void send_request(const RequestTemplateT& request, const typename RequestTemplateT::SlotValues& values, StringView body = StringView())
+    {
+        if (render_request(request, values, body) != nullptr)
         {
-            stream << "From: \"" << m_caller_display << "\" <sip:" << m_user << "@" << m_server_ip << ">;tag=" << m_tag << "\r\n";
+            m_socket.send_buffered_data();
         }
-        else
+    }
+
+    /**
+     * Send a message stored by a transaction again
+     *
+     * Messages too long for the transaction are not stored, they are not retransmitted.
+     */
+    template<size_t SIZE>
+    void resend(const Buffer<SIZE>& message)
+    {
+        if (message.size() == 0)
         {
-            stream << "From: \"" << m_user << "\" <sip:" << m_user << "@" << m_server_ip << ">;tag=" << m_tag << "\r\n";
+            ESP_LOGD(TAG, "No stored message to retransmit");
+            return;
         }
-        stream << "Via: SIP/2.0/" << TRANSPORT_UPPER << " " << m_my_ip << ":" << LOCAL_PORT << ";branch=z9hG4bK-" << m_branch << ";rport\r\n";
+        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+        tx_buffer.append(message.data(), message.size());
+        m_socket.send_buffered_data();
+    }
 
-        if ((command == "ACK") && !m_to_tag.empty())
+    void send_sip_register()
+    {
+        if (m_register_template.empty())
         {
-            stream << "To: <" << to_uri << ">;tag=" << m_to_tag << "\r\n";
+            render_register_template();
         }
-        else
+        send_request(m_register_template, register_values());
+    }
+
+    void send_sip_options()
+    {
+        if (m_keep_alive_template.empty())
         {
-            stream << "To: <" << to_uri << ">\r\n";
+            render_keep_alive_template();
         }
+        typename RequestTemplateT::SlotValues values;
+        values.cseq = m_keep_alive_cseq;
+        values.branch = m_keep_alive_branch;
+        values.tag = m_keep_alive_call_id;
+        send_request(m_keep_alive_template, values);
     }
 
-    void send_sip_reply_header(const std::string& code, const SipPacket& packet, TxBufferT& stream)
+    void send_sip_invite(const SipDialog& dialog)
     {
-        stream << "SIP/2.0 " << code << "\r\n";
+        if (dialog.sdp.is_overflow())
+        {
+            ESP_LOGE(TAG, "SDP body exceeds its buffer, INVITE not sent");
+            return;
+        }
+        send_request(dialog.invite_template, dialog_values(dialog), dialog.sdp.view());
+    }
 
-        stream << "To: " << packet.get_to() << "\r\n";
-        stream << "From: " << packet.get_from() << "\r\n";
-        stream << "Via: " << packet.get_via() << "\r\n";
-        stream << "CSeq: " << packet.get_cseq() << "\r\n";
-        stream << "Call-ID: " << packet.get_call_id()  << "\r\n";
-        stream << "Max-Forwards: 70\r\n";
+    /**
+     * Send the CANCEL, BYE or UPDATE of the request template
+     */
+    void send_sip_request(const SipDialog& dialog)
+    {
+        typename RequestTemplateT::SlotValues values = dialog_values(dialog);
+        values.cseq = dialog.request_cseq;
+        values.branch = dialog.request_branch;
+        send_request(dialog.request_template, values);
     }
 
-    bool read_param(const std::string& line, const std::string& param_name, std::string& output)
+    void send_sip_ack(SipDialog& dialog)
     {
-        std::string param(param_name + "=\"");
-        size_t pos = line.find(param);
-        if (pos == std::string::npos)
+        TxBufferT* tx_buffer = render_request(dialog.ack_template, dialog_values(dialog), StringView());
+        if (tx_buffer == nullptr)
         {
-            return false;
+            return;
         }
-        pos += param.size();
-        size_t pos_end = line.find("\"", pos);
-        if (pos_end == std::string::npos)
+        m_socket.send_buffered_data();
+        if (dialog.invite_transaction.get_state() == SipTransaction::State::COMPLETED)
         {
-            return false;
+            //retransmissions of the final response are answered with this ACK
+            dialog.invite_transaction.store_message(tx_buffer->data(), tx_buffer->size());
         }
-        output = line.substr(pos, pos_end - pos);
-        return true;
     }
 
-    void compute_auth_response(const std::string& method, const std::string& uri)
+    /**
+     * Answer a request
+     *
+     * \param[in] dialog The dialog of the request, it provides the To tag if the request has none yet
+     * \param[in] sdp Body of a response to an INVITE, empty for none
+     */
+    void send_sip_reply(uint16_t code, const char* reason, const SipPacket& packet, const SipDialog* dialog, StringView sdp = StringView())
     {
-        std::string ha1_text;
-        std::string ha2_text;
-        unsigned char hash[16];
+        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
+
+        send_sip_reply_header(code, reason, packet, dialog, tx_buffer);
+        bool establishes_dialog = (packet.get_method() == SipPacket::Method::INVITE) || (packet.get_method() == SipPacket::Method::UPDATE);
+        render_reply_body(establishes_dialog ? dialog : nullptr, code, sdp, tx_buffer);
+
+        m_socket.send_buffered_data();
+        if (m_server_transaction != nullptr)
+        {
+            m_server_transaction->on_response_sent(code, tx_buffer.data(), tx_buffer.size(), xTaskGetTickCount());
+        }
+    }
 
-        m_response= "";
-        std::string data = m_user + ":" + m_realm + ":" + m_pwd;
+    /**
+     * Answer the INVITE of an incoming call, the request is gone, the rendered header lines of the dialog are used
+     */
+    void send_invite_response(SipDialog& dialog, uint16_t code, const char* reason, bool with_sdp)
+    {
+        if (dialog.response_header.is_overflow() || dialog.sdp.is_overflow())
+        {
+            ESP_LOGE(TAG, "Response exceeds its buffer, %d not sent", (int) code);
+            return;
+        }
+        TxBufferT& tx_buffer = m_socket.get_new_tx_buf();
 
-        m_md5.start();
-        m_md5.update(data);
-        m_md5.finish(hash);
-        to_hex(ha1_text, hash, 16);
-        ESP_LOGV(TAG, "Calculating md5 for : %s", data.c_str());
-        ESP_LOGV(TAG, "Hex ha1 is %s", ha1_text.c_str());
+        tx_buffer << "SIP/2.0 " << static_cast<uint32_t>(code) << " " << reason << "\r\n";
+        tx_buffer << dialog.response_header.view();
+        render_reply_body(&dialog, code, with_sdp ? dialog.sdp.view() : StringView(), tx_buffer);
 
-        data = method + ":" + uri;
+        m_socket.send_buffered_data();
+        dialog.invite_transaction.on_response_sent(code, tx_buffer.data(), tx_buffer.size(), xTaskGetTickCount());
+    }
 
-        m_md5.start();
-        m_md5.update(data);
-        m_md5.finish(hash);
-        to_hex(ha2_text, hash, 16);
-        ESP_LOGV(TAG, "Calculating md5 for : %s", data.c_str());
-        ESP_LOGV(TAG, "Hex ha2 is %s", ha2_text.c_str());
+    /**
+     * \param[in] dialog The dialog established or refreshed by the response, it adds our Contact and the session interval
+     */
+    void render_reply_body(const SipDialog* dialog, uint16_t code, StringView sdp, TxBufferT& stream)
+    {
+        if (dialog != nullptr)
+        {
+            stream << "Contact: \"" << m_user << "\" <sip:" << m_user << "@" << m_my_ip << ":" << LOCAL_PORT << ";transport=" << TRANSPORT_LOWER << ">\r\n";
+            stream << "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n";
+        }
+        if ((dialog != nullptr) && (code >= 200) && (code < 300) && (dialog->session_expires_sec != 0))
+        {
+            //the refresher is named from the view of the request, we are the UAS
+            stream << "Session-Expires: " << dialog->session_expires_sec << (dialog->session_refresher ? ";refresher=uas" : ";refresher=uac") << "\r\n";
+            if (!dialog->session_refresher)
+            {
+                stream << "Require: timer\r\n";
+            }
+        }
+        if (!sdp.empty())
+        {
+            stream << "Content-Type: application/sdp\r\n";
+        }
+        stream << "Content-Length: " << static_cast<uint32_t>(sdp.size()) << "\r\n";
+        stream << "\r\n";
+        stream << sdp;
+    }
 
-        data = ha1_text + ":" + m_nonce + ":" + ha2_text;
+    /**
+     * Render the header lines common to all requests, CSeq, branch and tags are slots
+     */
+    void render_request_header(SipPacket::Method method, const std::string& uri, const std::string& to_uri, StringView call_id,
+                               const std::string& display, RequestTemplateT& request)
+    {
+        StringView method_name = SipPacket::method_name(method);
+        request << method_name << " " << uri << " SIP/2.0\r\n";
+
+        request << "CSeq: " << RequestTemplateT::Slot::CSEQ << " " << method_name << "\r\n";
+        request << "Call-ID: " << call_id << "\r\n";
+        request << "Max-Forwards: 70\r\n";
+        request << "User-Agent: sip-client/0.0.1\r\n";
+        if ((method == SipPacket::Method::REGISTER) || display.empty())
+        {
+            request << "From: <sip:" << m_user << "@" << m_server_ip << ">;tag=" << RequestTemplateT::Slot::TAG << "\r\n";
+        }
+        else
+        {
+            request << "From: \"" << display << "\" <sip:" << m_user << "@" << m_server_ip << ">;tag=" << RequestTemplateT::Slot::TAG << "\r\n";
+        }
+        request << "Via: SIP/2.0/" << TRANSPORT_UPPER << " " << m_my_ip << ":" << LOCAL_PORT << ";branch=" << BRANCH_PREFIX << RequestTemplateT::Slot::BRANCH << ";rport\r\n";
 
-        m_md5.start();
-        m_md5.update(data);
-        m_md5.finish(hash);
-        to_hex(m_response, hash, 16);
-        ESP_LOGV(TAG, "Calculating md5 for : %s", data.c_str());
-        ESP_LOGV(TAG, "Hex response is %s", m_response.c_str());
+        if ((method == SipPacket::Method::ACK) || (method == SipPacket::Method::BYE) || (method == SipPacket::Method::UPDATE))
+        {
+            //requests within the dialog
+            request << "To: <" << to_uri << ">" << RequestTemplateT::Slot::TO_TAG << "\r\n";
+        }
+        else
+        {
+            request << "To: <" << to_uri << ">\r\n";
+        }
     }
 
-    void to_hex(std::string& dest, const unsigned char *data, int len)
+    void send_sip_reply_header(uint16_t code, const char* reason, const SipPacket& packet, const SipDialog* dialog, TxBufferT& stream)
     {
-        static const char hexits[17] = "0123456789abcdef";
+        stream << "SIP/2.0 " << static_cast<uint32_t>(code) << " " << reason << "\r\n";
+        render_reply_header(packet, dialog, stream);
+    }
 
-        dest = "";
-        dest.reserve(len * 2 + 1);
-        for (int i = 0; i < len; i++)
+    template<size_t SIZE>
+    void render_reply_header(const SipPacket& packet, const SipDialog* dialog, Buffer<SIZE>& stream)
+    {
+        stream << "To: " << packet.get_to();
+        if ((dialog != nullptr) && packet.get_to_tag().empty())
+        {
+            stream << ";tag=" << dialog->local_tag.view();
+        }
+        stream << "\r\n";
+        stream << "From: " << packet.get_from() << "\r\n";
+        //the whole Via stack must be returned in the same order
+        SipPacket::Values vias = packet.get_vias();
+        for (size_t i = 0; i < vias.size(); i++)
+        {
+            stream << "Via: " << vias[i] << "\r\n";
+        }
+        if (packet.get_method() == SipPacket::Method::INVITE)
         {
-            dest.push_back(hexits[data[i] >> 4]);
-            dest.push_back(hexits[data[i] &  0x0F]);
+            SipPacket::Values record_routes = packet.get_record_routes();
+            for (size_t i = 0; i < record_routes.size(); i++)
+            {
+                stream << "Record-Route: " << record_routes[i] << "\r\n";
+            }
         }
+        stream << "CSeq: " << packet.get_cseq() << "\r\n";
+        stream << "Call-ID: " << packet.get_call_id()  << "\r\n";
+        stream << "Max-Forwards: 70\r\n";
     }
 
-    void log_state_transition(SipState old_state, SipState new_state)
+    /**
+     * Called on entry of a state of the registration, m_state mirrors the state machine
+     */
+    void set_state(SipState new_state)
     {
-        char* state[12] = {
+        if (new_state == m_state)
+        {
+            return;
+        }
+        char* state[5] = {
             (char*)"IDLE",
             (char*)"REGISTER_UNAUTH",
             (char*)"REGISTER_AUTH",
             (char*)"REGISTERED",
+            (char*)"ERROR"
+        };
+        ESP_LOGI(TAG, "New state %s -> %s", state[(int) m_state], state[(int) new_state]);
+        m_state = new_state;
+    }
+
+    /**
+     * Called on entry of a state of the dialog, SipDialog::state mirrors the state machine for the lookups
+     */
+    void set_dialog_state(SipDialog& dialog, SipDialog::State new_state)
+    {
+        if (new_state == dialog.state)
+        {
+            return;
+        }
+        char* state[10] = {
+            (char*)"TERMINATED",
             (char*)"INVITE_UNAUTH",
             (char*)"INVITE_UNAUTH_SENT",
             (char*)"INVITE_AUTH",
@@ -746,103 +2060,86 @@ private:
             (char*)"CALL_START",
             (char*)"CALL_IN_PROGRESS",
             (char*)"CANCELLED",
-            (char*)"ERROR"
+            (char*)"ALERTING",
+            (char*)"HANGING_UP"
         };
-        ESP_LOGI(TAG, "New state %s -> %s", state[(int) old_state], state[(int) new_state]);
+        ESP_LOGI(TAG, "Dialog %d: new state %s -> %s", dialog.id, state[(int) dialog.state], state[(int) new_state]);
+        dialog.state = new_state;
     }
 
-    SipState m_state = SipState::IDLE;
+    SipState m_state = SipState::IDLE;     ///< only accessed by the SIP task, other tasks use the command queue
 
     SocketT m_socket;
     SocketT m_rtp_socket;
-    Md5T    m_md5;
+    SipDigest<HashT> m_digest;
     std::string m_server_ip;
 
     std::string m_user;
-    std::string m_pwd;
     std::string m_my_ip;
 
-    std::string m_uri;
-    std::string m_to_uri;
-    std::string m_to_contact;
-    std::string m_to_tag;
-
+    //registration
     uint32_t m_sip_sequence_number;
     uint32_t m_call_id;
 
-    //auth stuff
-    std::string m_response;
-    std::string m_realm;
-    std::string m_nonce;
+    Buffer<512> m_authorization;    ///< (Proxy-)Authorization line of the REGISTER, dialogs have their own
 
     uint32_t m_tag;
     uint32_t m_branch;
 
-    //misc stuff
-    std::string m_caller_display;
-
-    uint32_t m_sdp_session_id;
-    Buffer<1024> m_tx_sdp_buffer;
-
-    std::function<void(const SipClientEvent &)> m_event_handler;
-
-    /* FreeRTOS event group to signal commands from other tasks */
-    EventGroupHandle_t m_command_event_group;
-    static constexpr uint8_t COMMAND_DIAL_BIT = BIT0;
-    static constexpr uint8_t COMMAND_CANCEL_BIT = BIT1;
+    RequestTemplateT m_register_template;
+    SipTransaction m_request_transaction;   ///< client transaction of the REGISTER
+    SipRegistration m_registration;
+
+    //liveness of the registrar
+    SipKeepAlive m_keep_alive;
+    RequestTemplateT m_keep_alive_template;
+    SipTransaction m_keep_alive_transaction;    ///< client transaction of the OPTIONS ping
+    uint32_t m_keep_alive_call_id;              ///< used as From tag as well
+    uint32_t m_keep_alive_cseq = 0;
+    uint32_t m_keep_alive_branch = 0;
+
+    //calls
+    SipDialogTable<MAX_DIALOGS> m_dialogs;
+    uint8_t m_ring_group = 0;                   ///< id of the last ring group, 0 is no group
+    SipAnswerPolicy m_answer_policy;
+    uint32_t m_session_expires_sec = 1800;      ///< 0 disables the session timer
+
+    std::array<SipTransaction, MAX_DIALOGS> m_server_transactions;
+    size_t m_next_server_transaction = 0;
+    SipTransaction* m_server_transaction = nullptr;   ///< transaction of the request currently handled
+
+    /* events for the application, the SIP task is the only producer */
+    static constexpr size_t EVENT_QUEUE_SIZE = 16;
+    MpscQueue<SipClientEvent, EVENT_QUEUE_SIZE> m_events;
+    std::atomic<uint32_t> m_events_queued {0};
+    std::atomic<uint32_t> m_events_dropped {0};
+    EventGroupHandle_t m_event_group;   ///< wakes up wait_event()
+    static constexpr EventBits_t EVENT_QUEUED_BIT = BIT0;
+
+    std::unique_ptr<RegistrationStatesT> m_registration_states;
+    std::array<std::unique_ptr<DialogStatesT>, MAX_DIALOGS> m_dialog_states;
+
+    /* requests of other tasks, the only state that is shared with them */
+    static constexpr size_t COMMAND_QUEUE_SIZE = 8;
+    MpscQueue<Command, COMMAND_QUEUE_SIZE> m_commands;
 
     static constexpr const uint16_t LOCAL_PORT = 5060;
     static constexpr const char* TRANSPORT_LOWER= "udp";
     static constexpr const char* TRANSPORT_UPPER= "UDP";
+    static constexpr const char* BRANCH_PREFIX = "z9hG4bK-";
 
-    static constexpr uint32_t SOCKET_RX_TIMEOUT_MSEC = 200;
     static constexpr uint16_t LOCAL_RTP_PORT = 7078;
+    static constexpr uint32_t MIN_SESSION_EXPIRES_SEC = 90;     ///< RFC 4028 section 4
     static constexpr const char* TAG = "SipClient";
 };
 
 
-
-
-#ifdef USE_SML
-namespace sml = boost::sml;
-
-struct ev_start {};
-struct ev_2 {};
-struct ev_3 {};
-
-template <class SipClientT>
-struct sip_states {
-    auto operator()() const noexcept {
-        using namespace sml;
-
-        const auto idle = state<class idle>;
-
-        const auto action = [](SipClientT& sip, const auto& event) {  /// event is deduced, order is not important
-            (void) event;
-            sip.test();
-        };
-
-        return make_transition_table(
-                *idle + event<ev_start> = "s1"_s
-                , "s1"_s + sml::on_entry<_> / [] { ESP_LOGV("SIP SM", "s1 on entry"); }
-        , "s1"_s + sml::on_exit<_> / [] { ESP_LOGV("SIP SM", "s1 on exit"); }
-        , "s1"_s + event<ev_2> / action = state<class s2>
-        , state<class s2> + event<ev_3> = X
-        );
-    }
-};
-#endif //USE_SML
-
-
-template <class SocketT, class Md5T>
+template <class SocketT, class HashT>
 class SipClient
 {
 public:
     SipClient(const std::string& user, const std::string& pwd, const std::string& server_ip, const std::string& server_port, const std::string& my_ip)
     : m_sip{user, pwd, server_ip, server_port, my_ip}
-#ifdef USE_SML
-    , m_sm{m_sip}
-#endif
     {}
 
     bool init()
@@ -870,9 +2167,42 @@ public:
         m_sip.set_credentials(user, password);
     }
 
-    void set_event_handler(std::function<void(const SipClientEvent &)> handler)
+    void set_registration_timing(uint32_t expires_sec, uint32_t max_refresh_interval_sec)
+    {
+        m_sip.set_registration_timing(expires_sec, max_refresh_interval_sec);
+    }
+
+    void set_keep_alive(SipKeepAlive::Mode mode, uint32_t interval_sec, uint32_t max_lost)
+    {
+        m_sip.set_keep_alive(mode, interval_sec, max_lost);
+    }
+
+    SipKeepAliveStats get_keep_alive_stats() const
+    {
+        return m_sip.get_keep_alive_stats();
+    }
+
+    /**
+     * Take the next event, see SipClientInt::wait_event()
+     */
+    bool wait_event(SipClientEvent& event, TickType_t ticks_to_wait)
+    {
+        return m_sip.wait_event(event, ticks_to_wait);
+    }
+
+    SipEventStats get_event_stats() const
+    {
+        return m_sip.get_event_stats();
+    }
+
+    void set_answer_policy(const SipAnswerPolicy& policy)
+    {
+        m_sip.set_answer_policy(policy);
+    }
+
+    void set_session_timer(uint32_t session_expires_sec)
     {
-        m_sip.set_event_handler(handler);
+        m_sip.set_session_timer(session_expires_sec);
     }
 
     /**
@@ -886,26 +2216,29 @@ public:
         m_sip.request_ring(local_number, caller_display);
     }
 
+    /**
+     * Call several numbers in parallel async, see SipClientInt::request_ring_group()
+     */
+    void request_ring_group(const std::vector<std::string>& local_numbers, const std::string& caller_display)
+    {
+        m_sip.request_ring_group(local_numbers, caller_display);
+    }
+
     void request_cancel()
     {
         m_sip.request_cancel();
     }
 
-    void run()
+    void request_hang_up()
     {
-#ifdef USE_SML
-        m_sm.process_event(ev_start{});
-        //assert(sm.is(sml::X));
-#endif
+        m_sip.request_hang_up();
+    }
 
+    void run()
+    {
         m_sip.run();
     }
 
 private:
-    SipClientInt<SocketT, Md5T> m_sip;
-
-#ifdef USE_SML
-    sml::sm<sip_states<SipClientInt<SocketT, Md5T>>> m_sm;
-#endif
-
+    SipClientInt<SocketT, HashT> m_sip;
 };
@@ -0,0 +1,220 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "buffer.h"
+#include "sdp_packet.h"
+#include "sip_message_template.h"
+#include "sip_transaction.h"
+#include "string_view.h"
+
+#include <array>
+#include <string>
+
+/**
+ * State of one call, outgoing or incoming
+ *
+ * A dialog is identified by its Call-ID, the local and the remote tag (RFC 3261 section 12).
+ * The keys are stored in fixed size buffers, so a lookup does not allocate.
+ */
+struct SipDialog {
+    using RequestTemplateT = SipMessageTemplate<1024>;
+
+    enum class State {
+        TERMINATED,         ///< free for a new call once the transactions are terminated
+        INVITE_UNAUTH,
+        INVITE_UNAUTH_SENT,
+        INVITE_AUTH,
+        RINGING,
+        CALL_START,
+        CALL_IN_PROGRESS,
+        CANCELLED,
+        ALERTING,           ///< incoming call, waiting for the answer delay
+        HANGING_UP,         ///< our BYE was sent, waiting for its response
+    };
+
+    /**
+     * \return true if the dialog can be reused for a new call
+     */
+    bool is_free() const
+    {
+        return (state == State::TERMINATED) && !invite_transaction.is_active() && !request_transaction.is_active();
+    }
+
+    /**
+     * Reset all values of a previous call
+     */
+    void reset()
+    {
+        state = State::TERMINATED;
+        outgoing = false;
+        cancel_requested = false;
+        bye_requested = false;
+        answered_elsewhere = false;
+        group = 0;
+        target = 0;
+        caller_display.clear();
+        call_id.clear();
+        local_tag.clear();
+        remote_tag.clear();
+        remote_contact.clear();
+        route_set.clear();
+        authorization.clear();
+        media = MediaParameters();
+        invite_template.clear();
+        request_template.clear();
+        ack_template.clear();
+        sdp.clear();
+        response_header.clear();
+        session_expires_sec = 0;
+        session_refresher = false;
+    }
+
+    State state = State::TERMINATED;
+    uint8_t id = 0;                 ///< index in the dialog table, reported in the events
+    bool outgoing = false;
+    bool cancel_requested = false;
+    bool bye_requested = false;     ///< hang up once the call is in progress
+    bool answered_elsewhere = false;    ///< another dialog of the ring group answered, this one is cancelled
+    uint8_t group = 0;              ///< ring group of an outgoing call, 0 if the call is not part of one
+    uint8_t target = 0;             ///< index of the called number in the ring group
+
+    Buffer<128> call_id;
+    uint32_t tag = 0;               ///< our tag, From of our requests and To of our responses
+    Buffer<48> local_tag;           ///< tag as text
+    Buffer<48> remote_tag;
+    uint32_t cseq = 0;              ///< CSeq of the INVITE, also used by its ACK and CANCEL
+    uint32_t branch = 0;
+    uint32_t request_cseq = 0;      ///< CSeq of the request template, the CANCEL uses the one of the INVITE
+    uint32_t request_branch = 0;
+
+    std::string uri;
+    std::string to_uri;
+    std::string caller_display;
+    std::string remote_contact;
+    std::string route_set;          ///< rendered Route header lines
+
+    Buffer<512> authorization;      ///< rendered (Proxy-)Authorization header line, empty if not challenged
+
+    uint32_t sdp_session_id = 0;
+    MediaParameters media;
+
+    RequestTemplateT invite_template;
+    RequestTemplateT request_template;     ///< CANCEL, BYE or UPDATE, only one of them is sent at a time
+    RequestTemplateT ack_template;
+    Buffer<1024> sdp;               ///< our offer or our answer
+    Buffer<1024> response_header;   ///< header lines of the responses to an incoming INVITE
+    TickType_t answer_deadline = 0; ///< an incoming call is answered at this tick count
+
+    uint32_t session_expires_sec = 0;   ///< session interval of RFC 4028, 0 without session timer
+    bool session_refresher = false;     ///< we refresh the session, otherwise the other side does
+    TickType_t session_deadline = 0;    ///< next refresh, or the expiry if the other side refreshes
+
+    SipTransaction invite_transaction;
+    SipTransaction request_transaction;     ///< client transaction of the request template
+};
+
+/**
+ * Fixed pool of dialogs
+ */
+template<std::size_t N>
+class SipDialogTable
+{
+public:
+    SipDialogTable()
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            m_dialogs[i].id = i;
+        }
+    }
+
+    /**
+     * \return a reset dialog or nullptr if all are in use
+     */
+    SipDialog* allocate()
+    {
+        for (SipDialog& dialog : m_dialogs)
+        {
+            if (dialog.is_free())
+            {
+                dialog.reset();
+                return &dialog;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Find the dialog of a message
+     *
+     * The remote tag is only compared if it is known on both sides, the responses of an
+     * early dialog may not carry one yet.
+     *
+     * \param[in] local_tag From tag of a response or To tag of a request
+     * \param[in] remote_tag To tag of a response or From tag of a request
+     * \return nullptr if the message does not belong to a dialog
+     */
+    SipDialog* find(StringView call_id, StringView local_tag, StringView remote_tag)
+    {
+        for (SipDialog& dialog : m_dialogs)
+        {
+            if (dialog.is_free() || (dialog.call_id.view() != call_id) || (dialog.local_tag.view() != local_tag))
+            {
+                continue;
+            }
+            if (remote_tag.empty() || (dialog.remote_tag.size() == 0) || (dialog.remote_tag.view() == remote_tag))
+            {
+                return &dialog;
+            }
+        }
+        return nullptr;
+    }
+
+    SipDialog& operator[](size_t index)
+    {
+        return m_dialogs[index];
+    }
+
+    const SipDialog& operator[](size_t index) const
+    {
+        return m_dialogs[index];
+    }
+
+    typename std::array<SipDialog, N>::iterator begin()
+    {
+        return m_dialogs.begin();
+    }
+
+    typename std::array<SipDialog, N>::iterator end()
+    {
+        return m_dialogs.end();
+    }
+
+    typename std::array<SipDialog, N>::const_iterator begin() const
+    {
+        return m_dialogs.begin();
+    }
+
+    typename std::array<SipDialog, N>::const_iterator end() const
+    {
+        return m_dialogs.end();
+    }
+
+private:
+    std::array<SipDialog, N> m_dialogs;
+};
@@ -0,0 +1,413 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_log.h"
+#include "buffer.h"
+#include "sip_packet.h"
+#include "string_view.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+/**
+ * Digest credentials (RFC 2617, RFC 3261 section 22.4) that are kept across requests
+ *
+ * HA1 = H(user:realm:password) only depends on the realm and the hash function, it is computed
+ * once per realm. The nonce of the last challenge is kept after the request succeeded, so the
+ * next request carries its credentials at once instead of waiting for a 401 or 407 first. If the
+ * server offers a qop, every request uses the next nonce count and a new cnonce. A server that
+ * does not accept the nonce anymore sends a new challenge, which replaces the cached one.
+ *
+ * The algorithms MD5 and SHA-256 are supported, each also in the -sess variant (RFC 8760).
+ * HashT names the classes of both hash functions, e.g. MbedtlsHash.
+ *
+ * Computing a response does not allocate: the parts of each hash input are fed into the hash
+ * function one after the other and the hex digits are kept in fixed arrays.
+ */
+template<class HashT>
+class SipDigest
+{
+public:
+    /**
+     * Algorithms in the order of their names, see algorithm_name()
+     */
+    enum class Algorithm {
+        MD5,
+        MD5_SESS,
+        SHA256,
+        SHA256_SESS,
+        UNKNOWN
+    };
+
+    enum class Qop {
+        NONE,       ///< RFC 2069 compatible response without nonce count
+        AUTH,
+        AUTH_INT,   ///< the body is protected, too
+    };
+
+    static constexpr size_t MAX_REALMS = 2;
+    static constexpr size_t MAX_DIGEST_SIZE = 32;   ///< SHA-256
+
+    static_assert((HashT::Md5::SIZE <= MAX_DIGEST_SIZE) && (HashT::Sha256::SIZE <= MAX_DIGEST_SIZE), "Digest too long");
+
+    SipDigest(const std::string& user, const std::string& password)
+    : m_user(user)
+    , m_password(password)
+    {
+    }
+
+    void set_credentials(const std::string& user, const std::string& password)
+    {
+        m_user = user;
+        m_password = password;
+        clear();
+    }
+
+    /**
+     * Forget all realms and nonces, e.g. for another server
+     */
+    void clear()
+    {
+        for (Realm& realm : m_realms)
+        {
+            realm.name.clear();
+            realm.ha1.length = 0;
+            realm.nonce.clear();
+        }
+        m_current = nullptr;
+    }
+
+    /**
+     * Take the challenge of a 401 or 407
+     *
+     * A server may offer several algorithms, each in its own header line. The topmost challenge
+     * with a supported algorithm is used (RFC 8760 section 2.4).
+     *
+     * \return false if no challenge can be answered
+     */
+    bool on_challenge(const SipPacket& packet)
+    {
+        const bool proxy = (packet.get_status() == SipPacket::Status::PROXY_AUTH_REQ_407);
+        const SipPacket::Values challenges = proxy ? packet.get_proxy_authenticates() : packet.get_www_authenticates();
+        for (size_t i = 0; i < challenges.size(); i++)
+        {
+            StringView challenge = challenges[i];
+            if (!challenge.substr(0, challenge.find(' ')).equals_ignore_case("Digest"))
+            {
+                continue;
+            }
+            StringView algorithm_param = SipPacket::get_auth_param(challenge, "algorithm");
+            Algorithm algorithm = convert_algorithm(algorithm_param);
+            if (algorithm == Algorithm::UNKNOWN)
+            {
+                ESP_LOGD(TAG, "Skipping challenge with algorithm %.*s", (int) algorithm_param.size(), algorithm_param.data());
+                continue;
+            }
+            StringView nonce = SipPacket::get_auth_param(challenge, "nonce");
+            if (nonce.empty())
+            {
+                ESP_LOGW(TAG, "Skipping challenge without nonce");
+                continue;
+            }
+
+            Realm& realm = find_realm(SipPacket::get_auth_param(challenge, "realm"), algorithm);
+            realm.proxy = proxy;
+            realm.nonce.assign(nonce.data(), nonce.size());
+            StringView opaque = SipPacket::get_auth_param(challenge, "opaque");
+            realm.opaque.assign(opaque.data(), opaque.size());
+            realm.qop = select_qop(SipPacket::get_auth_param(challenge, "qop"));
+            realm.nonce_count = 0;
+            if (is_session(algorithm))
+            {
+                //the session key is built with the cnonce of the first request and kept for this nonce
+                random_cnonce(realm.cnonce);
+                hash(algorithm, {realm.ha1.view(), ":", realm.nonce, ":", realm.cnonce}, realm.session_ha1);
+            }
+            if (SipPacket::get_auth_param(challenge, "stale").equals_ignore_case("true"))
+            {
+                ESP_LOGD(TAG, "Nonce of realm %s expired, the credentials are still valid", realm.name.c_str());
+            }
+            StringView name = algorithm_name(algorithm);
+            ESP_LOGI(TAG, "Realm is %s, algorithm %.*s", realm.name.c_str(), (int) name.size(), name.data());
+            m_current = &realm;
+            return true;
+        }
+        ESP_LOGW(TAG, "No challenge with a supported algorithm");
+        return false;
+    }
+
+    /**
+     * Render the Authorization or Proxy-Authorization header line with the nonce of the last challenge
+     *
+     * \param[in] body Body of the request, only used with qop=auth-int
+     * \return false if there was no challenge yet, authorization is empty then
+     */
+    bool authorize(SipPacket::Method method, StringView uri, StringView body, Buffer<512>& authorization)
+    {
+        authorization.clear();
+        if ((m_current == nullptr) || m_current->nonce.empty())
+        {
+            return false;
+        }
+        Realm& realm = *m_current;
+
+        const StringView method_name = SipPacket::method_name(method);
+        Hex ha2;
+        if (realm.qop == Qop::AUTH_INT)
+        {
+            Hex body_hash;
+            hash(realm.algorithm, {body}, body_hash);
+            hash(realm.algorithm, {method_name, ":", uri, ":", body_hash.view()}, ha2);
+        }
+        else
+        {
+            hash(realm.algorithm, {method_name, ":", uri}, ha2);
+        }
+
+        const Hex& ha1 = is_session(realm.algorithm) ? realm.session_ha1 : realm.ha1;
+        const char* qop = (realm.qop == Qop::AUTH_INT) ? "auth-int" : "auth";
+        Hex response;
+        char nonce_count[9];
+        char cnonce[9];
+        if (realm.qop != Qop::NONE)
+        {
+            realm.nonce_count++;
+            snprintf(nonce_count, sizeof(nonce_count), "%08x", static_cast<unsigned int>(realm.nonce_count));
+            if (is_session(realm.algorithm))
+            {
+                memcpy(cnonce, realm.cnonce, sizeof(cnonce));
+            }
+            else
+            {
+                random_cnonce(cnonce);
+            }
+            hash(realm.algorithm, {ha1.view(), ":", realm.nonce, ":", nonce_count, ":", cnonce, ":", qop, ":", ha2.view()}, response);
+        }
+        else
+        {
+            hash(realm.algorithm, {ha1.view(), ":", realm.nonce, ":", ha2.view()}, response);
+        }
+        ESP_LOGV(TAG, "Hex ha2 is %.*s, response is %.*s", (int) ha2.length, ha2.digits, (int) response.length, response.digits);
+
+        //a 407 is answered with Proxy-Authorization (RFC 3261 section 22.3)
+        authorization << (realm.proxy ? "Proxy-Authorization" : "Authorization") << ": Digest username=\"" << m_user
+                      << "\", realm=\"" << realm.name << "\", nonce=\"" << realm.nonce << "\", uri=\"" << uri
+                      << "\", algorithm=" << algorithm_name(realm.algorithm) << ", response=\"" << response.view() << "\"";
+        if (realm.qop != Qop::NONE)
+        {
+            authorization << ", qop=" << qop << ", nc=" << nonce_count << ", cnonce=\"" << cnonce << "\"";
+        }
+        if (!realm.opaque.empty())
+        {
+            authorization << ", opaque=\"" << realm.opaque << "\"";
+        }
+        authorization << "\r\n";
+        return true;
+    }
+
+    /**
+     * \return the token of the algorithm parameter, empty for UNKNOWN
+     */
+    static StringView algorithm_name(Algorithm algorithm)
+    {
+        static constexpr const char* NAMES[] = {"MD5", "MD5-sess", "SHA-256", "SHA-256-sess", ""};
+        static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == static_cast<size_t>(Algorithm::UNKNOWN) + 1, "Algorithm name missing");
+        return NAMES[static_cast<size_t>(algorithm)];
+    }
+
+private:
+    /**
+     * Lower case hex digits of a digest
+     */
+    struct Hex {
+        char digits[2 * MAX_DIGEST_SIZE];
+        size_t length = 0;
+
+        StringView view() const
+        {
+            return StringView(digits, length);
+        }
+    };
+
+    struct Realm {
+        std::string name;
+        Algorithm algorithm = Algorithm::MD5;
+        Hex ha1;                    ///< H(user:realm:password)
+        Hex session_ha1;            ///< H(ha1:nonce:cnonce) of the -sess algorithms
+        std::string nonce;
+        char cnonce[9] = "";        ///< cnonce of the session key
+        std::string opaque;
+        Qop qop = Qop::NONE;
+        bool proxy = false;         ///< challenged by a 407
+        uint32_t nonce_count = 0;
+    };
+
+    /**
+     * \return the entry of the realm, a new one replaces the oldest entry
+     */
+    Realm& find_realm(StringView name, Algorithm algorithm)
+    {
+        Realm* found = nullptr;
+        for (Realm& realm : m_realms)
+        {
+            if (!realm.name.empty() && (name == realm.name))
+            {
+                found = &realm;
+                break;
+            }
+        }
+        if (found == nullptr)
+        {
+            found = &m_realms[m_next_realm];
+            m_next_realm = (m_next_realm + 1) % MAX_REALMS;
+            found->name.assign(name.data(), name.size());
+            found->ha1.length = 0;
+        }
+        //HA1 only has to be computed again if the server switches to another hash function
+        if ((found->ha1.length == 0) || (is_sha256(found->algorithm) != is_sha256(algorithm)))
+        {
+            hash(algorithm, {m_user, ":", found->name, ":", m_password}, found->ha1);
+            ESP_LOGV(TAG, "Hex ha1 of realm %s is %.*s", found->name.c_str(), (int) found->ha1.length, found->ha1.digits);
+        }
+        found->algorithm = algorithm;
+        return *found;
+    }
+
+    static Algorithm convert_algorithm(StringView name)
+    {
+        //a challenge without algorithm uses MD5 (RFC 2617 section 3.2.1)
+        if (name.empty())
+        {
+            return Algorithm::MD5;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(Algorithm::UNKNOWN); i++)
+        {
+            if (name.equals_ignore_case(algorithm_name(static_cast<Algorithm>(i))))
+            {
+                return static_cast<Algorithm>(i);
+            }
+        }
+        return Algorithm::UNKNOWN;
+    }
+
+    /**
+     * auth is preferred, auth-int is only used if the server requires it
+     */
+    static Qop select_qop(StringView options)
+    {
+        if (has_token(options, "auth"))
+        {
+            return Qop::AUTH;
+        }
+        if (has_token(options, "auth-int"))
+        {
+            return Qop::AUTH_INT;
+        }
+        return Qop::NONE;
+    }
+
+    static bool is_session(Algorithm algorithm)
+    {
+        return (algorithm == Algorithm::MD5_SESS) || (algorithm == Algorithm::SHA256_SESS);
+    }
+
+    static bool is_sha256(Algorithm algorithm)
+    {
+        return (algorithm == Algorithm::SHA256) || (algorithm == Algorithm::SHA256_SESS);
+    }
+
+    static void random_cnonce(char (&cnonce)[9])
+    {
+        snprintf(cnonce, sizeof(cnonce), "%08x", static_cast<unsigned int>(std::rand()));
+    }
+
+    /**
+     * \return true if the comma separated list contains the token, e.g. qop="auth,auth-int"
+     */
+    static bool has_token(StringView list, StringView token)
+    {
+        while (!list.empty())
+        {
+            size_t comma = list.find(',');
+            if (list.substr(0, comma).trim() == token)
+            {
+                return true;
+            }
+            if (comma == StringView::npos)
+            {
+                break;
+            }
+            list = list.substr(comma + 1);
+        }
+        return false;
+    }
+
+    /**
+     * Hash the concatenation of the parts without building it
+     */
+    void hash(Algorithm algorithm, std::initializer_list<StringView> parts, Hex& hex)
+    {
+        if (is_sha256(algorithm))
+        {
+            digest(m_sha256, parts, hex);
+        }
+        else
+        {
+            digest(m_md5, parts, hex);
+        }
+    }
+
+    template<class HashFunctionT>
+    static void digest(HashFunctionT& hash_function, std::initializer_list<StringView> parts, Hex& hex)
+    {
+        unsigned char result[HashFunctionT::SIZE];
+        hash_function.start();
+        for (StringView part : parts)
+        {
+            hash_function.update(part.data(), part.size());
+        }
+        hash_function.finish(result);
+        to_hex(result, sizeof(result), hex);
+    }
+
+    static void to_hex(const unsigned char* data, size_t len, Hex& hex)
+    {
+        static const char hexits[17] = "0123456789abcdef";
+
+        for (size_t i = 0; i < len; i++)
+        {
+            hex.digits[2 * i] = hexits[data[i] >> 4];
+            hex.digits[2 * i + 1] = hexits[data[i] & 0x0F];
+        }
+        hex.length = 2 * len;
+    }
+
+    typename HashT::Md5 m_md5;
+    typename HashT::Sha256 m_sha256;
+    std::string m_user;
+    std::string m_password;
+    std::array<Realm, MAX_REALMS> m_realms;
+    size_t m_next_realm = 0;
+    Realm* m_current = nullptr;     ///< realm of the last challenge, used for the next requests
+
+    static constexpr const char* TAG = "SipDigest";
+};
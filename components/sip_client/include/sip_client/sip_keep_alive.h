@@ -0,0 +1,220 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Counters of the keep-alive, see SipKeepAlive::get_stats()
+ */
+struct SipKeepAliveStats {
+        uint32_t sent = 0;
+        uint32_t answered = 0;
+        uint32_t lost = 0;              ///< pings without answer until the next ping or the transaction timeout
+        uint32_t rtt_msec = 0;          ///< round trip time of the last answered ping
+        uint32_t smoothed_rtt_msec = 0; ///< moving average with weight 1/8 for the last value, like TCP
+};
+
+/**
+ * Liveness check of the registrar while registered
+ *
+ * A ping is sent every interval, either an OPTIONS request or a double CRLF (RFC 5626
+ * section 4.4.1). Both keep the NAT binding to the registrar open. The OPTIONS is answered
+ * by every SIP server, a single CRLF pong only by servers that support RFC 5626.
+ *
+ * A ping is lost if it is not answered before the next one is due. After max_lost pings in a
+ * row are lost, the registrar is considered dead and the client registers again at once,
+ * instead of noticing the lost binding with the next call.
+ *
+ * The counters may be read by other tasks.
+ */
+class SipKeepAlive
+{
+public:
+    enum class Mode {
+        OFF,
+        OPTIONS,
+        CRLF,
+    };
+
+    static constexpr uint32_t DEFAULT_INTERVAL_SEC = 30;
+    static constexpr uint32_t DEFAULT_MAX_LOST = 2;
+
+    SipKeepAlive()
+    : m_mode(Mode::OFF)
+    , m_interval(DEFAULT_INTERVAL_SEC)
+    , m_max_lost(DEFAULT_MAX_LOST)
+    , m_timer_active(false)
+    , m_deadline(0)
+    , m_pending(false)
+    , m_sent_tick(0)
+    , m_lost_in_row(0)
+    {
+    }
+
+    /**
+     * \param[in] interval_sec Time between two pings
+     * \param[in] max_lost Pings lost in a row until the registrar is considered dead, 0 only keeps the NAT binding open
+     */
+    void set_timing(Mode mode, uint32_t interval_sec, uint32_t max_lost)
+    {
+        m_mode = (interval_sec != 0) ? mode : Mode::OFF;
+        m_interval = interval_sec;
+        m_max_lost = max_lost;
+    }
+
+    Mode get_mode() const
+    {
+        return m_mode;
+    }
+
+    /**
+     * Schedule the first ping after a successful registration
+     */
+    void start(TickType_t now)
+    {
+        m_pending = false;
+        m_lost_in_row = 0;
+        if (m_mode == Mode::OFF)
+        {
+            m_timer_active = false;
+            return;
+        }
+        start_timer(now);
+    }
+
+    void stop()
+    {
+        m_timer_active = false;
+        m_pending = false;
+    }
+
+    /**
+     * \return true if the next ping is due, the timer is stopped then
+     */
+    bool check_timer(TickType_t now)
+    {
+        if (!m_timer_active || (static_cast<int32_t>(now - m_deadline) < 0))
+        {
+            return false;
+        }
+        m_timer_active = false;
+        return true;
+    }
+
+    /**
+     * \return false if no timer is running
+     */
+    bool get_next_deadline(TickType_t& deadline) const
+    {
+        deadline = m_deadline;
+        return m_timer_active;
+    }
+
+    /**
+     * \return true if the last ping is not answered yet
+     */
+    bool is_pending() const
+    {
+        return m_pending;
+    }
+
+    void on_sent(TickType_t now)
+    {
+        m_pending = true;
+        m_sent_tick = now;
+        m_sent++;
+        start_timer(now);
+    }
+
+    void on_answered(TickType_t now)
+    {
+        if (!m_pending)
+        {
+            //a late answer of a ping that was already counted as lost
+            return;
+        }
+        m_pending = false;
+        m_lost_in_row = 0;
+        uint32_t rtt = (now - m_sent_tick) * portTICK_RATE_MS;
+        uint32_t smoothed = m_smoothed_rtt.load(std::memory_order_relaxed);
+        smoothed = (m_answered.load(std::memory_order_relaxed) == 0) ? rtt : (7 * smoothed + rtt) / 8;
+        m_rtt.store(rtt, std::memory_order_relaxed);
+        m_smoothed_rtt.store(smoothed, std::memory_order_relaxed);
+        m_answered++;
+        ESP_LOGV(TAG, "Ping answered after %d msec", (int) rtt);
+    }
+
+    /**
+     * Count the pending ping as lost
+     *
+     * \return true if the registrar is considered dead
+     */
+    bool on_lost()
+    {
+        if (!m_pending)
+        {
+            return false;
+        }
+        m_pending = false;
+        m_lost++;
+        m_lost_in_row++;
+        ESP_LOGW(TAG, "Ping lost, %d in a row", (int) m_lost_in_row);
+        return (m_max_lost != 0) && (m_lost_in_row >= m_max_lost);
+    }
+
+    SipKeepAliveStats get_stats() const
+    {
+        SipKeepAliveStats stats;
+        stats.sent = m_sent.load(std::memory_order_relaxed);
+        stats.answered = m_answered.load(std::memory_order_relaxed);
+        stats.lost = m_lost.load(std::memory_order_relaxed);
+        stats.rtt_msec = m_rtt.load(std::memory_order_relaxed);
+        stats.smoothed_rtt_msec = m_smoothed_rtt.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    void start_timer(TickType_t now)
+    {
+        m_deadline = now + m_interval * 1000 / portTICK_RATE_MS;
+        m_timer_active = true;
+    }
+
+    Mode m_mode;
+    uint32_t m_interval;
+    uint32_t m_max_lost;
+    bool m_timer_active;
+    TickType_t m_deadline;
+    bool m_pending;
+    TickType_t m_sent_tick;
+    uint32_t m_lost_in_row;
+
+    std::atomic<uint32_t> m_sent {0};
+    std::atomic<uint32_t> m_answered {0};
+    std::atomic<uint32_t> m_lost {0};
+    std::atomic<uint32_t> m_rtt {0};
+    std::atomic<uint32_t> m_smoothed_rtt {0};
+
+    static constexpr const char* TAG = "SipKeepAlive";
+};
@@ -0,0 +1,167 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "buffer.h"
+#include "string_view.h"
+
+#include <array>
+
+/**
+ * Pre-rendered request with slots for the values that change between transmissions
+ *
+ * The invariant text of a request is rendered once per registration or dialog with the
+ * same operator<< as Buffer. A Slot streamed into the template marks the position of a
+ * mutable value. render() copies the text and fills in the slot values, which is a few
+ * memcpy instead of formatting every header line again.
+ */
+template<std::size_t SIZE>
+class SipMessageTemplate
+{
+public:
+    enum class Slot : uint8_t {
+        CSEQ,
+        BRANCH,
+        TAG,
+        TO_TAG,         ///< rendered with the ";tag=" prefix, nothing if the value is empty
+        AUTHORIZATION,  ///< complete header line(s) including CRLF, may be empty
+        CONTENT_LENGTH,
+    };
+
+    struct SlotValues {
+        uint32_t cseq = 0;
+        uint32_t branch = 0;
+        uint32_t tag = 0;
+        StringView to_tag;
+        StringView authorization;
+        uint32_t content_length = 0;
+    };
+
+    static constexpr size_t MAX_SLOTS = 8;
+
+    SipMessageTemplate()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_text.clear();
+        m_slot_count = 0;
+        m_overflow = false;
+    }
+
+    SipMessageTemplate<SIZE>& operator<<(const char* str)
+    {
+        m_text << str;
+        return *this;
+    }
+    SipMessageTemplate<SIZE>& operator<<(const std::string& str)
+    {
+        m_text << str;
+        return *this;
+    }
+    SipMessageTemplate<SIZE>& operator<<(StringView str)
+    {
+        m_text << str;
+        return *this;
+    }
+    SipMessageTemplate<SIZE>& operator<<(uint32_t i)
+    {
+        m_text << i;
+        return *this;
+    }
+
+    SipMessageTemplate<SIZE>& operator<<(Slot slot)
+    {
+        if (m_slot_count >= MAX_SLOTS)
+        {
+            m_overflow = true;
+            return *this;
+        }
+        m_slots[m_slot_count].offset = m_text.size();
+        m_slots[m_slot_count].slot = slot;
+        m_slot_count++;
+        return *this;
+    }
+
+    /**
+     * \return true if the template was not rendered yet
+     */
+    bool empty() const
+    {
+        return m_text.size() == 0;
+    }
+
+    /**
+     * \return true if the template text or its slots did not fit, it must not be used then
+     */
+    bool is_overflow() const
+    {
+        return m_overflow || m_text.is_overflow();
+    }
+
+    /**
+     * Write the message with the given slot values to buffer
+     */
+    template<std::size_t BUFFER_SIZE>
+    void render(Buffer<BUFFER_SIZE>& buffer, const SlotValues& values) const
+    {
+        size_t position = 0;
+        for (size_t i = 0; i < m_slot_count; i++)
+        {
+            buffer.append(m_text.data() + position, m_slots[i].offset - position);
+            position = m_slots[i].offset;
+            switch (m_slots[i].slot)
+            {
+            case Slot::CSEQ:
+                buffer << values.cseq;
+                break;
+            case Slot::BRANCH:
+                buffer << values.branch;
+                break;
+            case Slot::TAG:
+                buffer << values.tag;
+                break;
+            case Slot::TO_TAG:
+                if (!values.to_tag.empty())
+                {
+                    buffer << ";tag=" << values.to_tag;
+                }
+                break;
+            case Slot::AUTHORIZATION:
+                buffer << values.authorization;
+                break;
+            case Slot::CONTENT_LENGTH:
+                buffer << values.content_length;
+                break;
+            }
+        }
+        buffer.append(m_text.data() + position, m_text.size() - position);
+    }
+
+private:
+    struct SlotPosition {
+        size_t offset;
+        Slot slot;
+    };
+
+    Buffer<SIZE> m_text;
+    std::array<SlotPosition, MAX_SLOTS> m_slots;
+    size_t m_slot_count;
+    bool m_overflow;
+};
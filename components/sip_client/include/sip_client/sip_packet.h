@@ -17,53 +17,189 @@
 #pragma once
 
 #include "esp_log.h"
+#include "string_view.h"
+#include "token_table.h"
+
 #include <cstring>
 
+/**
+ * Parser for a single received SIP message
+ *
+ * The message is tokenized in one forward pass. The input buffer is not modified and
+ * not copied, all header values are stored as (offset, length) pairs into it.
+ * So the input buffer must outlive the SipPacket object.
+ */
 class SipPacket
 {
 public:
 
-    enum class Status {
-        TRYING_100,
-        SESSION_PROGRESS_183,
-        OK_200,
-        UNAUTHORIZED_401,
-        PROXY_AUTH_REQ_407,
-        BUSY_HERE_486,
-        REQUEST_CANCELLED_487,
-        SERVER_ERROR_500,
-        DECLINE_603,
-        UNKNOWN,
+    /**
+     * Response status codes of RFC 3261 and its extensions
+     *
+     * The value of each entry is the numeric status code.
+     */
+    enum class Status : uint16_t {
+        UNKNOWN = 0,
+        TRYING_100 = 100,
+        RINGING_180 = 180,
+        CALL_IS_BEING_FORWARDED_181 = 181,
+        QUEUED_182 = 182,
+        SESSION_PROGRESS_183 = 183,
+        OK_200 = 200,
+        ACCEPTED_202 = 202,
+        MULTIPLE_CHOICES_300 = 300,
+        MOVED_PERMANENTLY_301 = 301,
+        MOVED_TEMPORARILY_302 = 302,
+        USE_PROXY_305 = 305,
+        ALTERNATIVE_SERVICE_380 = 380,
+        BAD_REQUEST_400 = 400,
+        UNAUTHORIZED_401 = 401,
+        PAYMENT_REQUIRED_402 = 402,
+        FORBIDDEN_403 = 403,
+        NOT_FOUND_404 = 404,
+        METHOD_NOT_ALLOWED_405 = 405,
+        NOT_ACCEPTABLE_406 = 406,
+        PROXY_AUTH_REQ_407 = 407,
+        REQUEST_TIMEOUT_408 = 408,
+        GONE_410 = 410,
+        REQUEST_ENTITY_TOO_LARGE_413 = 413,
+        REQUEST_URI_TOO_LONG_414 = 414,
+        UNSUPPORTED_MEDIA_TYPE_415 = 415,
+        UNSUPPORTED_URI_SCHEME_416 = 416,
+        BAD_EXTENSION_420 = 420,
+        EXTENSION_REQUIRED_421 = 421,
+        SESSION_INTERVAL_TOO_SMALL_422 = 422,
+        INTERVAL_TOO_BRIEF_423 = 423,
+        TEMPORARILY_UNAVAILABLE_480 = 480,
+        CALL_DOES_NOT_EXIST_481 = 481,
+        LOOP_DETECTED_482 = 482,
+        TOO_MANY_HOPS_483 = 483,
+        ADDRESS_INCOMPLETE_484 = 484,
+        AMBIGUOUS_485 = 485,
+        BUSY_HERE_486 = 486,
+        REQUEST_CANCELLED_487 = 487,
+        NOT_ACCEPTABLE_HERE_488 = 488,
+        REQUEST_PENDING_491 = 491,
+        UNDECIPHERABLE_493 = 493,
+        SERVER_ERROR_500 = 500,
+        NOT_IMPLEMENTED_501 = 501,
+        BAD_GATEWAY_502 = 502,
+        SERVICE_UNAVAILABLE_503 = 503,
+        SERVER_TIMEOUT_504 = 504,
+        VERSION_NOT_SUPPORTED_505 = 505,
+        MESSAGE_TOO_LARGE_513 = 513,
+        BUSY_EVERYWHERE_600 = 600,
+        DECLINE_603 = 603,
+        DOES_NOT_EXIST_ANYWHERE_604 = 604,
+        NOT_ACCEPTABLE_606 = 606,
+    };
+
+    enum class StatusClass {
+        UNKNOWN = 0,
+        PROVISIONAL_1XX = 1,
+        SUCCESS_2XX = 2,
+        REDIRECTION_3XX = 3,
+        CLIENT_ERROR_4XX = 4,
+        SERVER_ERROR_5XX = 5,
+        GLOBAL_FAILURE_6XX = 6,
     };
 
     enum class Method {
-        NOTIFY,
+        INVITE,
+        ACK,
         BYE,
+        CANCEL,
+        OPTIONS,
+        REGISTER,
         INFO,
-        INVITE,
+        NOTIFY,
+        UPDATE,
+        PRACK,
+        MESSAGE,
+        SUBSCRIBE,
+        REFER,
+        PUBLISH,
+        UNKNOWN
+    };
+
+    enum class Header {
+        VIA,
+        FROM,
+        TO,
+        CALL_ID,
+        C_SEQ,
+        CONTACT,
+        CONTENT_TYPE,
+        CONTENT_LENGTH,
+        CONTENT_ENCODING,
+        WWW_AUTHENTICATE,
+        PROXY_AUTHENTICATE,
+        AUTHORIZATION,
+        PROXY_AUTHORIZATION,
+        RECORD_ROUTE,
+        ROUTE,
+        EXPIRES,
+        MAX_FORWARDS,
+        USER_AGENT,
+        SERVER,
+        ALLOW,
+        ALLOW_EVENTS,
+        SUPPORTED,
+        REQUIRE,
+        SESSION_EXPIRES,
+        MIN_SE,
+        EVENT,
+        REFER_TO,
+        REFERRED_BY,
+        SUBJECT,
+        ACCEPT,
+        DATE,
         UNKNOWN
     };
 
     enum class ContentType {
 	    APPLICATION_DTMF_RELAY,
+	    APPLICATION_SDP,
 	    UNKNOWN
     };
 
 
+    /**
+     * Maximum number of stored values of a header that may occur several times, e.g. Via
+     */
+    static constexpr size_t MAX_HEADER_VALUES = 8;
+
+    /**
+     * Longest message that can be parsed, the values are stored as 16 bit offsets
+     */
+    static constexpr size_t MAX_MESSAGE_SIZE = UINT16_MAX;
+
+    class Values;
+
     SipPacket(const char* input_buffer, size_t input_buffer_length)
     : m_buffer(input_buffer)
     , m_buffer_length(input_buffer_length)
     , m_status(Status::UNKNOWN)
+    , m_status_code(0)
     , m_method(Method::UNKNOWN)
+    , m_cseq_method(Method::UNKNOWN)
     , m_content_type(ContentType::UNKNOWN)
     , m_content_length(0)
-    , m_realm()
-    , m_nonce()
+    , m_has_content_length(false)
+    , m_expires(0)
+    , m_has_expires(false)
+    , m_dtmf_signal(' ')
+    , m_dtmf_duration(0)
     {
     }
 
     bool parse()
     {
+        if (m_buffer_length > MAX_MESSAGE_SIZE)
+        {
+            ESP_LOGW(TAG, "Message of %d byte is too long", (int) m_buffer_length);
+            return false;
+        }
         bool result = parse_header();
         if (!result)
         {
@@ -78,11 +214,40 @@ public:
         return m_status;
     }
 
+    /**
+     * Numeric status code as received, even if it is not known by Status
+     */
+    uint16_t get_status_code() const
+    {
+        return m_status_code;
+    }
+
+    StatusClass get_status_class() const
+    {
+        return static_cast<StatusClass>(m_status_code / 100);
+    }
+
+    /**
+     * Final responses are all responses except the provisional 1xx ones
+     */
+    bool is_final_response() const
+    {
+        return m_status_code >= 200;
+    }
+
     Method get_method() const
     {
         return m_method;
     }
 
+    /**
+     * Method in the CSeq header, this identifies the request a response belongs to
+     */
+    Method get_cseq_method() const
+    {
+        return m_cseq_method;
+    }
+
     ContentType get_content_type() const
     {
         return m_content_type;
@@ -93,49 +258,134 @@ public:
 	return m_content_length;
     }
 
-    std::string get_nonce() const
+    /**
+     * \return false if there is no valid Expires header
+     */
+    bool get_expires(uint32_t& expires) const
+    {
+        expires = m_expires;
+        return m_has_expires;
+    }
+
+    /**
+     * Session interval and refresher of the Session-Expires header (RFC 4028)
+     *
+     * \param[out] refresher "uac", "uas" or empty if the parameter is missing
+     * \return false if there is no valid Session-Expires header
+     */
+    bool get_session_expires(uint32_t& interval, StringView& refresher) const
+    {
+        StringView value = view(m_session_expires);
+        refresher = get_param(value, "refresher");
+        return value.trim().to_uint(interval);
+    }
+
+    StringView get_contact() const
     {
-        return m_nonce;
+        return view(m_contact);
     }
 
-    std::string get_realm() const
+    StringView get_to_tag() const
     {
-        return m_realm;
+        return view(m_to_tag);
     }
 
-    std::string get_contact() const
+    StringView get_from_tag() const
     {
-        return m_contact;
+        return view(m_from_tag);
     }
 
-    std::string get_to_tag() const
+    StringView get_cseq() const
     {
-        return m_to_tag;
+        return view(m_cseq);
     }
 
-    std::string get_cseq() const
+    /**
+     * Sequence number of the CSeq header, 0 if it is missing
+     */
+    uint32_t get_cseq_number() const
     {
-        return m_cseq;
+        uint32_t number = 0;
+        get_cseq().to_uint(number);
+        return number;
     }
 
-    std::string get_call_id() const
+    /**
+     * Branch parameter of the topmost Via, it identifies the transaction
+     */
+    StringView get_branch() const
     {
-        return m_call_id;
+        StringView via = get_via();
+        size_t pos = via.find(BRANCH_PARAM);
+        if (pos == StringView::npos)
+        {
+            return StringView();
+        }
+        StringView branch = via.substr(pos + strlen(BRANCH_PARAM));
+        size_t end = 0;
+        while ((end < branch.size()) && (branch[end] != ';') && (branch[end] != ',') && !StringView::is_space(branch[end]))
+        {
+            end++;
+        }
+        return branch.substr(0, end);
+    }
+
+    StringView get_call_id() const
+    {
+        return view(m_call_id);
+    }
+
+    StringView get_to() const
+    {
+        return view(m_to);
     }
 
-    std::string get_to() const
+    StringView get_from() const
     {
-        return m_to;
+        return view(m_from);
     }
 
-    std::string get_from() const
+    /**
+     * Topmost Via header value
+     */
+    StringView get_via() const
     {
-        return m_from;
+        return m_vias.empty() ? StringView() : view(m_vias[0]);
     }
 
-    std::string get_via() const
+    /**
+     * All Via values in the order they were received
+     */
+    Values get_vias() const;
+
+    /**
+     * All Record-Route values in the order they were received
+     */
+    Values get_record_routes() const;
+
+    /**
+     * All Route values in the order they were received
+     */
+    Values get_routes() const;
+
+    /**
+     * All Contact values, each including display name and parameters
+     */
+    Values get_contacts() const;
+
+    /**
+     * All challenges of a 401, in the order of preference of the server (RFC 8760 section 2.4)
+     */
+    Values get_www_authenticates() const;
+
+    /**
+     * All challenges of a 407, in the order of preference of the proxy
+     */
+    Values get_proxy_authenticates() const;
+
+    StringView get_body() const
     {
-        return m_via;
+        return view(m_body);
     }
 
     char get_dtmf_signal() const
@@ -148,277 +398,646 @@ public:
         return m_dtmf_duration;
     }
 
-private:
-
-    bool parse_header()
+    /**
+     * Value of a header parameter, e.g. the expires of a Contact value
+     *
+     * Parameters of an URI in angle brackets belong to the URI and are not returned.
+     *
+     * \return an empty view if the parameter is missing or has no value
+     */
+    static StringView get_param(StringView value, StringView name)
     {
-        const char* start_position = m_buffer;
-        char* end_position = strstr(start_position, LINE_ENDING);
-
-        m_method = Method::UNKNOWN;
-        m_status = Status::UNKNOWN;
-        m_content_type = ContentType::UNKNOWN;
-        m_content_length = 0;
-        m_cseq = "";
-        m_call_id = "";
-        m_to = "";
-        m_from = "";
-        m_via = "";
-        m_dtmf_signal = ' ';
-        m_dtmf_duration = 0;
-        m_body = nullptr;
-
-        if (end_position == nullptr)
-        {
-            ESP_LOGW(TAG, "No line ending found in %s", m_buffer);
-            return false;
-        }
-
-        uint32_t line_number = 0;
-        do
+        size_t bracket = value.find('>');
+        size_t pos = (bracket == StringView::npos) ? 0 : bracket;
+        while ((pos = value.find(';', pos)) != StringView::npos)
         {
-            size_t length = end_position - start_position;
-            if (length == 0) //line only contains the line ending
+            pos++;
+            StringView param = value.substr(pos).trim();
+            if ((param.size() <= name.size()) || (param[name.size()] != '=') || !param.substr(0, name.size()).equals_ignore_case(name))
             {
-                ESP_LOGV(TAG, "Valid end of header detected");
-                if (end_position + LINE_ENDING_LEN >= m_buffer + m_buffer_length)
-                {
-                    // no remaining data in buffer, so no body
-                    m_body = nullptr;
-                }
-                else
-                {
-                    m_body = end_position + LINE_ENDING_LEN;
-                }
-                return true;
+                continue;
             }
-            const char* next_start_position = end_position + LINE_ENDING_LEN;
-            line_number++;
-
-            //create a proper null terminated c string
-            //from here on string functions may be used!
-            memset(end_position, 0, LINE_ENDING_LEN);
-            ESP_LOGV(TAG, "Parsing line: %s", start_position);
+            param = param.substr(name.size() + 1);
+            size_t end = 0;
+            while ((end < param.size()) && (param[end] != ';') && !StringView::is_space(param[end]))
+            {
+                end++;
+            }
+            return param.substr(0, end);
+        }
+        return StringView();
+    }
 
-            if (strstr(start_position, SIP_2_0_SPACE) == start_position)
+    /**
+     * Value of a parameter of an authentication challenge, e.g. the nonce of
+     * Digest realm="fritz.box", nonce="2EA1C6F5", algorithm=MD5
+     *
+     * The parameter name is case insensitive. Quoted values are returned without the quotes.
+     *
+     * \return an empty view if the parameter is missing
+     */
+    static StringView get_auth_param(StringView challenge, StringView name)
+    {
+        //the parameters follow the scheme and are separated by commas
+        StringView params = challenge.substr(challenge.find(' '));
+        while (!params.empty())
+        {
+            size_t equals = params.find('=');
+            if (equals == StringView::npos)
             {
-                long code = strtol(start_position + strlen(SIP_2_0_SPACE), nullptr, 10);
-                ESP_LOGV(TAG, "Detect status %ld", code);
-                m_status = convert_status(code);
+                break;
             }
-            else if ((strncmp(WWW_AUTHENTICATE, start_position, strlen(WWW_AUTHENTICATE)) == 0)
-                    || (strncmp(PROXY_AUTHENTICATE, start_position, strlen(PROXY_AUTHENTICATE)) == 0))
+            StringView param_name = params.substr(0, equals).trim();
+            StringView value = params.substr(equals + 1).trim();
+            StringView result;
+            size_t end = 0;
+            if (!value.empty() && (value[0] == '"'))
             {
-                ESP_LOGV(TAG, "Detect authenticate line");
-                //read realm and nonce from authentication line
-                if (!read_param(start_position, REALM, m_realm))
-                {
-                    ESP_LOGW(TAG, "Failed to read realm in authenticate line");
-                }
-                if (!read_param(start_position, NONCE, m_nonce))
+                end = 1;
+                while ((end < value.size()) && (value[end] != '"'))
                 {
-                    ESP_LOGW(TAG, "Failed to read nonce in authenticate line");
+                    end += (value[end] == '\\') ? 2 : 1;
                 }
-                ESP_LOGI(TAG, "Realm is %s and nonce is %s", m_realm.c_str(), m_nonce.c_str());
+                result = value.substr(1, end - 1);
+                end = value.find(',', end);
             }
-            else if (strncmp(CONTACT, start_position, strlen(CONTACT)) == 0)
+            else
             {
-                ESP_LOGV(TAG, "Detect contact line");
-                const char* last_pos = strstr(start_position, ">");
-                if (last_pos == nullptr)
-                {
-                    ESP_LOGW(TAG, "Failed to read content of contact line");
-                }
-                else
-                {
-                    m_contact = std::string(start_position + strlen(CONTACT), last_pos);
-                }
+                end = value.find(',');
+                result = value.substr(0, end).trim();
             }
-            else if (strncmp(TO, start_position, strlen(TO)) == 0)
+            if (param_name.equals_ignore_case(name))
             {
-                ESP_LOGV(TAG, "Detect to line");
-                const char* tag_pos = strstr(start_position, ">;tag=");
-                if (tag_pos != nullptr)
-                {
-                    m_to_tag = std::string(tag_pos + strlen(">;tag="));
-                }
-                m_to = std::string(start_position + strlen(TO));
+                return result;
             }
-            else if (strstr(start_position, FROM) == start_position)
+            if (end == StringView::npos)
             {
-                m_from = std::string(start_position + strlen(FROM));
+                break;
             }
-            else if (strstr(start_position, VIA) == start_position)
+            params = value.substr(end + 1);
+        }
+        return StringView();
+    }
+
+    /**
+     * URI of a header value without display name and header parameters, e.g. sip:**611@fritz.box
+     */
+    static StringView get_uri(StringView value)
+    {
+        size_t first_pos = value.find('<');
+        if (first_pos == StringView::npos)
+        {
+            return value.substr(0, value.find(';')).trim();
+        }
+        size_t last_pos = value.find('>', first_pos);
+        if (last_pos == StringView::npos)
+        {
+            return StringView();
+        }
+        return value.substr(first_pos + 1, last_pos - first_pos - 1);
+    }
+
+    /**
+     * User part of the SIP URI of a header value, e.g. "**611" of "Door" <sip:**611@fritz.box>;tag=1
+     *
+     * \return an empty view if the URI has no user part
+     */
+    static StringView get_user(StringView value)
+    {
+        size_t pos = value.find("sip:");
+        if (pos == StringView::npos)
+        {
+            return StringView();
+        }
+        StringView user = value.substr(pos + 4);
+        size_t end = 0;
+        while ((end < user.size()) && (user[end] != '@'))
+        {
+            if ((user[end] == '>') || (user[end] == ';') || StringView::is_space(user[end]))
             {
-                m_via = std::string(start_position + strlen(VIA));
+                return StringView();
             }
-            else if (strstr(start_position, C_SEQ) == start_position)
+            end++;
+        }
+        return (end < user.size()) ? user.substr(0, end) : StringView();
+    }
+
+    /**
+     * Classify a header name, compact forms are accepted and the comparison is case insensitive
+     */
+    static Header convert_header(StringView name)
+    {
+        static constexpr Token<Header> HEADERS[] = {
+            {"Via", Header::VIA},                 {"v", Header::VIA},
+            {"From", Header::FROM},               {"f", Header::FROM},
+            {"To", Header::TO},                   {"t", Header::TO},
+            {"Call-ID", Header::CALL_ID},         {"i", Header::CALL_ID},
+            {"CSeq", Header::C_SEQ},
+            {"Contact", Header::CONTACT},         {"m", Header::CONTACT},
+            {"Content-Type", Header::CONTENT_TYPE},     {"c", Header::CONTENT_TYPE},
+            {"Content-Length", Header::CONTENT_LENGTH}, {"l", Header::CONTENT_LENGTH},
+            {"Content-Encoding", Header::CONTENT_ENCODING}, {"e", Header::CONTENT_ENCODING},
+            {"WWW-Authenticate", Header::WWW_AUTHENTICATE},
+            {"Proxy-Authenticate", Header::PROXY_AUTHENTICATE},
+            {"Authorization", Header::AUTHORIZATION},
+            {"Proxy-Authorization", Header::PROXY_AUTHORIZATION},
+            {"Record-Route", Header::RECORD_ROUTE},
+            {"Route", Header::ROUTE},
+            {"Expires", Header::EXPIRES},
+            {"Max-Forwards", Header::MAX_FORWARDS},
+            {"User-Agent", Header::USER_AGENT},
+            {"Server", Header::SERVER},
+            {"Allow", Header::ALLOW},
+            {"Allow-Events", Header::ALLOW_EVENTS}, {"u", Header::ALLOW_EVENTS},
+            {"Supported", Header::SUPPORTED},     {"k", Header::SUPPORTED},
+            {"Require", Header::REQUIRE},
+            {"Session-Expires", Header::SESSION_EXPIRES}, {"x", Header::SESSION_EXPIRES},
+            {"Min-SE", Header::MIN_SE},
+            {"Event", Header::EVENT},             {"o", Header::EVENT},
+            {"Refer-To", Header::REFER_TO},       {"r", Header::REFER_TO},
+            {"Referred-By", Header::REFERRED_BY}, {"b", Header::REFERRED_BY},
+            {"Subject", Header::SUBJECT},         {"s", Header::SUBJECT},
+            {"Accept", Header::ACCEPT},
+            {"Date", Header::DATE},
+        };
+        static constexpr TokenTable<Header, 128, 464177, true> HEADER_TABLE{HEADERS};
+        static_assert(HEADER_TABLE.is_perfect(), "Header name hash has collisions, choose another seed");
+
+        return HEADER_TABLE.find(name, Header::UNKNOWN);
+    }
+
+    /**
+     * \return the token of a method as used in the request line and CSeq, empty for UNKNOWN
+     */
+    static StringView method_name(Method method)
+    {
+        static constexpr const char* NAMES[] = {
+            "INVITE", "ACK", "BYE", "CANCEL", "OPTIONS", "REGISTER", "INFO", "NOTIFY",
+            "UPDATE", "PRACK", "MESSAGE", "SUBSCRIBE", "REFER", "PUBLISH", "",
+        };
+        static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == static_cast<size_t>(Method::UNKNOWN) + 1, "Method name missing");
+        return NAMES[static_cast<size_t>(method)];
+    }
+
+private:
+
+    /**
+     * Location of a value inside the input buffer, see MAX_MESSAGE_SIZE
+     */
+    struct Field {
+        uint16_t offset = 0;
+        uint16_t length = 0;
+    };
+
+    /**
+     * Fixed capacity list of values of a header that may occur several times
+     */
+    template <size_t N>
+    class FieldList
+    {
+    public:
+        bool push_back(Field value)
+        {
+            if (m_count >= N)
             {
-                m_cseq = std::string(start_position + strlen(C_SEQ));
+                return false;
             }
-            else if (strstr(start_position, CALL_ID) == start_position)
+            m_fields[m_count++] = value;
+            return true;
+        }
+
+        size_t size() const
+        {
+            return m_count;
+        }
+
+        bool empty() const
+        {
+            return m_count == 0;
+        }
+
+        Field operator[](size_t index) const
+        {
+            return m_fields[index];
+        }
+
+    private:
+        Field m_fields[N];
+        size_t m_count = 0;
+    };
+
+    using HeaderValues = FieldList<MAX_HEADER_VALUES>;
+
+    StringView view(Field field) const
+    {
+        return StringView(m_buffer + field.offset, field.length);
+    }
+
+    Field field(StringView value) const
+    {
+        Field result;
+        result.offset = static_cast<uint16_t>(value.data() - m_buffer);
+        result.length = static_cast<uint16_t>(value.size());
+        return result;
+    }
+
+    /**
+     * Get the next line of text and advance position behind its line ending
+     *
+     * \return false if no complete line is left in text
+     */
+    static bool next_line(StringView text, size_t& position, StringView& line)
+    {
+        StringView remaining = text.substr(position);
+        size_t end = remaining.find('\n');
+        if (end == StringView::npos)
+        {
+            return false;
+        }
+        position += end + 1;
+        if ((end > 0) && (remaining[end - 1] == '\r'))
+        {
+            end--;
+        }
+        line = remaining.substr(0, end);
+        return true;
+    }
+
+    bool parse_header()
+    {
+        const StringView message(m_buffer, m_buffer_length);
+        size_t position = 0;
+        StringView line;
+
+        if (!next_line(message, position, line))
+        {
+            ESP_LOGW(TAG, "No line ending found in %.*s", (int) m_buffer_length, m_buffer);
+            return false;
+        }
+        ESP_LOGV(TAG, "Parsing line: %.*s", (int) line.size(), line.data());
+
+        if (line.starts_with(SIP_2_0_SPACE))
+        {
+            uint32_t code = 0;
+            line.substr(strlen(SIP_2_0_SPACE)).to_uint(code);
+            ESP_LOGV(TAG, "Detect status %d", (int) code);
+            if ((code < 100) || (code > 699))
             {
-                m_call_id = std::string(start_position + strlen(CALL_ID));
+                ESP_LOGW(TAG, "Invalid status code %d", (int) code);
+                return false;
             }
-            else if (strstr(start_position, CONTENT_TYPE) == start_position)
+            m_status_code = code;
+            m_status = convert_status(code);
+        }
+        else
+        {
+            m_method = convert_method(line.substr(0, line.find(' ')));
+        }
+
+        //a header may be folded over several lines, so a line is parsed once the next one is known
+        StringView pending;
+        while (next_line(message, position, line))
+        {
+            if (!line.empty() && StringView::is_space(line[0]) && !pending.empty())
             {
-                m_content_type = convert_content_type(start_position + strlen(CONTENT_TYPE));
+                //continuation of the previous line
+                pending = StringView(pending.data(), line.end() - pending.data());
+                continue;
             }
-            else if (strstr(start_position, CONTENT_LENGTH) == start_position)
+            if (!pending.empty())
             {
-                long length = strtol(start_position + strlen(CONTENT_LENGTH), nullptr, 10);
-                if (length < 0)
-                {
-                    ESP_LOGW(TAG, "Invalid content length %ld", length);
-                }
-                else
-                {
-                    m_content_length = length;
-                }
+                parse_header_line(pending);
             }
+            pending = line;
 
-            else if (line_number == 1)
+            if (line.empty()) //line only contains the line ending
             {
-                //first line, but no response
-                m_method = convert_method(start_position);
+                ESP_LOGV(TAG, "Valid end of header detected");
+                size_t body_length = m_buffer_length - position;
+                if (m_has_content_length)
+                {
+                    if (m_content_length > body_length)
+                    {
+                        ESP_LOGW(TAG, "Message truncated, Content-Length is %d but only %d bytes follow", (int) m_content_length, (int) body_length);
+                        return false;
+                    }
+                    body_length = m_content_length;
+                }
+                m_body = field(StringView(m_buffer + position, body_length));
+                return true;
             }
-
-            //go to next line
-            start_position = next_start_position;
-            end_position = strstr(start_position, LINE_ENDING);
-        } while(end_position);
+        }
 
         //no line only containing the line ending found :(
         return false;
     }
 
-    bool parse_body()
+    void parse_header_line(StringView line)
     {
-        if (m_body == nullptr)
+        ESP_LOGV(TAG, "Parsing line: %.*s", (int) line.size(), line.data());
+
+        size_t colon = line.find(':');
+        if (colon == StringView::npos)
         {
-            return true;
+            ESP_LOGW(TAG, "Ignoring malformed header line %.*s", (int) line.size(), line.data());
+            return;
         }
-
-        const char* start_position = m_body;
-        char* end_position = strstr(start_position, LINE_ENDING);
-
-        if (end_position == nullptr)
+        StringView value = line.substr(colon + 1).trim();
+        switch (convert_header(line.substr(0, colon).trim()))
         {
-            ESP_LOGW(TAG, "No line ending found in %s", m_body);
-            return false;
+        case Header::WWW_AUTHENTICATE:
+            //a server may offer several algorithms, one challenge per header line
+            if (!m_www_authenticates.push_back(field(value)))
+            {
+                ESP_LOGW(TAG, "Too many challenges, ignoring %.*s", (int) value.size(), value.data());
+            }
+            break;
+        case Header::PROXY_AUTHENTICATE:
+            if (!m_proxy_authenticates.push_back(field(value)))
+            {
+                ESP_LOGW(TAG, "Too many challenges, ignoring %.*s", (int) value.size(), value.data());
+            }
+            break;
+        case Header::CONTACT:
+        {
+            ESP_LOGV(TAG, "Detect contact line");
+            bool first_contact = m_contacts.empty();
+            split_values(value, m_contacts);
+            if (!first_contact || m_contacts.empty())
+            {
+                break;
+            }
+            StringView contact = view(m_contacts[0]);
+            size_t first_pos = contact.find('<');
+            size_t last_pos = contact.find('>');
+            if ((first_pos == StringView::npos) || (last_pos == StringView::npos) || (last_pos < first_pos))
+            {
+                ESP_LOGW(TAG, "Failed to read content of contact line");
+            }
+            else
+            {
+                m_contact = field(contact.substr(first_pos + 1, last_pos - first_pos - 1));
+            }
+            break;
         }
-
-        do
+        case Header::TO:
         {
-            size_t length = end_position - start_position;
-            if (length == 0) //line only contains the line ending
+            ESP_LOGV(TAG, "Detect to line");
+            size_t tag_pos = value.find(TAG_PARAM);
+            if (tag_pos != StringView::npos)
             {
-                return true;
+                StringView tag = value.substr(tag_pos + strlen(TAG_PARAM));
+                m_to_tag = field(tag.substr(0, tag.find(';')));
+            }
+            m_to = field(value);
+            break;
+        }
+        case Header::FROM:
+        {
+            size_t tag_pos = value.find(TAG_PARAM);
+            if (tag_pos != StringView::npos)
+            {
+                StringView tag = value.substr(tag_pos + strlen(TAG_PARAM));
+                m_from_tag = field(tag.substr(0, tag.find(';')));
             }
+            m_from = field(value);
+            break;
+        }
+        case Header::VIA:
+            split_values(value, m_vias);
+            break;
+        case Header::RECORD_ROUTE:
+            split_values(value, m_record_routes);
+            break;
+        case Header::ROUTE:
+            split_values(value, m_routes);
+            break;
+        case Header::C_SEQ:
+        {
+            m_cseq = field(value);
+            size_t method_pos = value.find(' ');
+            if (method_pos != StringView::npos)
+            {
+                m_cseq_method = convert_method(value.substr(method_pos).trim());
+            }
+            break;
+        }
+        case Header::CALL_ID:
+            m_call_id = field(value);
+            break;
+        case Header::EXPIRES:
+            m_has_expires = value.to_uint(m_expires);
+            break;
+        case Header::SESSION_EXPIRES:
+            m_session_expires = field(value);
+            break;
+        case Header::CONTENT_TYPE:
+            m_content_type = convert_content_type(value);
+            break;
+        case Header::CONTENT_LENGTH:
+            m_has_content_length = value.to_uint(m_content_length);
+            if (!m_has_content_length)
+            {
+                ESP_LOGW(TAG, "Invalid content length %.*s", (int) value.size(), value.data());
+            }
+            break;
+        default:
+            break;
+        }
+    }
 
-            const char* next_start_position = end_position + LINE_ENDING_LEN;
+    bool parse_body()
+    {
+        StringView body = view(m_body);
+        if (body.empty())
+        {
+            return true;
+        }
 
-            //create a proper null terminated c string
-            //from here on string functions may be used!
-            memset(end_position, 0, LINE_ENDING_LEN);
-            ESP_LOGV(TAG, "Parsing line: %s", start_position);
+        size_t position = 0;
+        StringView line;
+        while (next_line(body, position, line) && !line.empty())
+        {
+            ESP_LOGV(TAG, "Parsing line: %.*s", (int) line.size(), line.data());
 
-            if (strstr(start_position, SIGNAL) == start_position)
+            if (line.starts_with(SIGNAL))
             {
-                m_dtmf_signal = *(start_position + strlen(SIGNAL));
+                StringView signal = line.substr(strlen(SIGNAL));
+                if (!signal.empty())
+                {
+                    m_dtmf_signal = signal[0];
+                }
             }
-            else if (strstr(start_position, DURATION) == start_position)
+            else if (line.starts_with(DURATION))
             {
-                long duration = strtol(start_position + strlen(DURATION), nullptr, 10);
-                if (duration < 0)
+                uint32_t duration = 0;
+                if (!line.substr(strlen(DURATION)).to_uint(duration))
                 {
-                    ESP_LOGW(TAG, "Invalid duration %ld", duration);
+                    ESP_LOGW(TAG, "Invalid duration %.*s", (int) line.size(), line.data());
                 }
                 else
                 {
                     m_dtmf_duration = duration;
                 }
             }
-
-            //go to next line
-            start_position = next_start_position;
-            end_position = strstr(start_position, LINE_ENDING);
-        } while(end_position);
+        }
 
         return true;
     }
 
-    bool read_param(const char* line, const char* param_name, std::string& output)
+    /**
+     * Split a comma separated header value into its elements
+     *
+     * Commas inside quoted strings and inside angle brackets do not separate elements.
+     */
+    template <size_t N>
+    void split_values(StringView value, FieldList<N>& output) const
     {
-        const char* pos = strstr(line, param_name);
-        if (pos == nullptr)
+        bool quoted = false;
+        bool bracket = false;
+        size_t start = 0;
+        for (size_t i = 0; i <= value.size(); i++)
         {
-            return false;
-        }
-        if (*(pos + strlen(param_name)) != '=')
-        {
-            return false;
+            if (i < value.size())
+            {
+                char c = value[i];
+                if (quoted)
+                {
+                    if (c == '\\')
+                    {
+                        i++;
+                    }
+                    else if (c == '"')
+                    {
+                        quoted = false;
+                    }
+                    continue;
+                }
+                if (c == '"')
+                {
+                    quoted = true;
+                    continue;
+                }
+                if (c == '<')
+                {
+                    bracket = true;
+                }
+                else if (c == '>')
+                {
+                    bracket = false;
+                }
+                if (bracket || (c != ','))
+                {
+                    continue;
+                }
+            }
+            StringView element = value.substr(start, i - start).trim();
+            start = i + 1;
+            if (element.empty())
+            {
+                continue;
+            }
+            if (!output.push_back(field(element)))
+            {
+                ESP_LOGW(TAG, "Too many header values, ignoring %.*s", (int) element.size(), element.data());
+            }
         }
+    }
 
-        if (*(pos + strlen(param_name) + 1) != '"')
+    /**
+     * Bit set of all status codes that are known by the Status enum, built at compile time
+     */
+    struct StatusCodeSet {
+        template <size_t N>
+        constexpr StatusCodeSet(const Status (&codes)[N])
+        : words()
         {
-            return false;
+            for (size_t i = 0; i < N; i++)
+            {
+                uint16_t code = static_cast<uint16_t>(codes[i]);
+                words[code / 32] |= 1u << (code % 32);
+            }
         }
 
-        pos += strlen(param_name) + 2;
-        const char* pos_end = strchr(pos, '"');
-        if (pos_end == nullptr)
+        constexpr bool contains(uint16_t code) const
         {
-            return false;
+            return (words[code / 32] & (1u << (code % 32))) != 0;
         }
-        output = std::string(pos, pos_end);
-        return true;
-    }
 
-    Status convert_status(uint32_t code) const
+        uint32_t words[700 / 32 + 1];
+    };
+
+    /**
+     * Convert a status code in the range 100..699
+     *
+     * Codes unknown to this implementation are mapped to the x00 code of their class,
+     * as required by RFC 3261 section 8.1.3.2.
+     */
+    static Status convert_status(uint32_t code)
     {
-        switch (code)
+        static constexpr Status KNOWN[] = {
+            Status::TRYING_100, Status::RINGING_180, Status::CALL_IS_BEING_FORWARDED_181, Status::QUEUED_182,
+            Status::SESSION_PROGRESS_183, Status::OK_200, Status::ACCEPTED_202, Status::MULTIPLE_CHOICES_300,
+            Status::MOVED_PERMANENTLY_301, Status::MOVED_TEMPORARILY_302, Status::USE_PROXY_305,
+            Status::ALTERNATIVE_SERVICE_380, Status::BAD_REQUEST_400, Status::UNAUTHORIZED_401,
+            Status::PAYMENT_REQUIRED_402, Status::FORBIDDEN_403, Status::NOT_FOUND_404,
+            Status::METHOD_NOT_ALLOWED_405, Status::NOT_ACCEPTABLE_406, Status::PROXY_AUTH_REQ_407,
+            Status::REQUEST_TIMEOUT_408, Status::GONE_410, Status::REQUEST_ENTITY_TOO_LARGE_413,
+            Status::REQUEST_URI_TOO_LONG_414, Status::UNSUPPORTED_MEDIA_TYPE_415, Status::UNSUPPORTED_URI_SCHEME_416,
+            Status::BAD_EXTENSION_420, Status::EXTENSION_REQUIRED_421, Status::SESSION_INTERVAL_TOO_SMALL_422,
+            Status::INTERVAL_TOO_BRIEF_423, Status::TEMPORARILY_UNAVAILABLE_480, Status::CALL_DOES_NOT_EXIST_481,
+            Status::LOOP_DETECTED_482, Status::TOO_MANY_HOPS_483, Status::ADDRESS_INCOMPLETE_484,
+            Status::AMBIGUOUS_485, Status::BUSY_HERE_486, Status::REQUEST_CANCELLED_487,
+            Status::NOT_ACCEPTABLE_HERE_488, Status::REQUEST_PENDING_491, Status::UNDECIPHERABLE_493,
+            Status::SERVER_ERROR_500, Status::NOT_IMPLEMENTED_501, Status::BAD_GATEWAY_502,
+            Status::SERVICE_UNAVAILABLE_503, Status::SERVER_TIMEOUT_504, Status::VERSION_NOT_SUPPORTED_505,
+            Status::MESSAGE_TOO_LARGE_513, Status::BUSY_EVERYWHERE_600, Status::DECLINE_603,
+            Status::DOES_NOT_EXIST_ANYWHERE_604, Status::NOT_ACCEPTABLE_606,
+        };
+        static constexpr StatusCodeSet KNOWN_SET{KNOWN};
+
+        if (KNOWN_SET.contains(code))
         {
-        case 200: return Status::OK_200;
-        case 401: return Status::UNAUTHORIZED_401;
-        case 100: return Status::TRYING_100;
-        case 183: return Status::SESSION_PROGRESS_183;
-        case 500: return Status::SERVER_ERROR_500;
-        case 486: return Status::BUSY_HERE_486;
-        case 487: return Status::REQUEST_CANCELLED_487;
-        case 407: return Status::PROXY_AUTH_REQ_407;
-        case 603: return Status::DECLINE_603;
+            return static_cast<Status>(code);
         }
-        return Status::UNKNOWN;
+        return static_cast<Status>(code - (code % 100));
     }
 
-    Method convert_method(const char* input) const
+    static Method convert_method(StringView input)
     {
-        if (strstr(input, NOTIFY) == input)
-        {
-            return Method::NOTIFY;
-        }
-        if (strstr(input, BYE) == input)
-        {
-            return Method::BYE;
-        }
-        if (strstr(input, INFO) == input)
-        {
-            return Method::INFO;
-        }
-        if (strstr(input, INVITE) == input)
-        {
-            return Method::INVITE;
-        }
-        return Method::UNKNOWN;
+        static constexpr Token<Method> METHODS[] = {
+            {"INVITE", Method::INVITE},
+            {"ACK", Method::ACK},
+            {"BYE", Method::BYE},
+            {"CANCEL", Method::CANCEL},
+            {"OPTIONS", Method::OPTIONS},
+            {"REGISTER", Method::REGISTER},
+            {"INFO", Method::INFO},
+            {"NOTIFY", Method::NOTIFY},
+            {"UPDATE", Method::UPDATE},
+            {"PRACK", Method::PRACK},
+            {"MESSAGE", Method::MESSAGE},
+            {"SUBSCRIBE", Method::SUBSCRIBE},
+            {"REFER", Method::REFER},
+            {"PUBLISH", Method::PUBLISH},
+        };
+        //method names are case sensitive
+        static constexpr TokenTable<Method, 32, 395, false> METHOD_TABLE{METHODS};
+        static_assert(METHOD_TABLE.is_perfect(), "Method name hash has collisions, choose another seed");
+
+        return METHOD_TABLE.find(input, Method::UNKNOWN);
     }
 
-    ContentType convert_content_type(const char* input) const
+    ContentType convert_content_type(StringView input) const
     {
-	if (strstr(input, APPLICATION_DTMF_RELAY) == input)
+	if (input.starts_with(APPLICATION_DTMF_RELAY))
 	{
 	    return ContentType::APPLICATION_DTMF_RELAY;
 	}
+        if (input.starts_with(APPLICATION_SDP))
+        {
+            return ContentType::APPLICATION_SDP;
+        }
         return ContentType::UNKNOWN;
     }
 
@@ -426,46 +1045,101 @@ private:
     const size_t m_buffer_length;
 
     Status m_status;
+    uint16_t m_status_code;
     Method m_method;
+    Method m_cseq_method;
     ContentType m_content_type;
     uint32_t m_content_length;
+    bool m_has_content_length;
+    uint32_t m_expires;
+    bool m_has_expires;
 
-    std::string m_realm;
-    std::string m_nonce;
-    std::string m_contact;
-    std::string m_to_tag;
-    std::string m_cseq;
-    std::string m_call_id;
-    std::string m_to;
-    std::string m_from;
-    std::string m_via;
+    Field m_contact;
+    Field m_to_tag;
+    Field m_from_tag;
+    Field m_cseq;
+    Field m_call_id;
+    Field m_session_expires;
+    Field m_to;
+    Field m_from;
+    HeaderValues m_vias;
+    HeaderValues m_record_routes;
+    HeaderValues m_routes;
+    HeaderValues m_contacts;
+    HeaderValues m_www_authenticates;
+    HeaderValues m_proxy_authenticates;
     char m_dtmf_signal;
     uint16_t m_dtmf_duration;
-    const char* m_body;
-
-    static constexpr const char* LINE_ENDING = "\r\n";
-    static constexpr size_t LINE_ENDING_LEN = 2;
-
+    Field m_body;
 
     static constexpr const char* TAG = "SipPacket";
     static constexpr const char* SIP_2_0_SPACE = "SIP/2.0 ";
-    static constexpr const char* WWW_AUTHENTICATE = "WWW-Authenticate";
-    static constexpr const char* PROXY_AUTHENTICATE = "Proxy-Authenticate";
-    static constexpr const char* CONTACT = "Contact: <";
-    static constexpr const char* TO = "To: ";
-    static constexpr const char* FROM = "From: ";
-    static constexpr const char* VIA = "Via: ";
-    static constexpr const char* C_SEQ = "CSeq: ";
-    static constexpr const char* CALL_ID = "Call-ID: ";
-    static constexpr const char* CONTENT_TYPE = "Content-Type: ";
-    static constexpr const char* CONTENT_LENGTH = "Content-Length: ";
-    static constexpr const char* REALM = "realm";
-    static constexpr const char* NONCE = "nonce";
-    static constexpr const char* NOTIFY = "NOTIFY ";
-    static constexpr const char* BYE = "BYE ";
-    static constexpr const char* INFO = "INFO ";
-    static constexpr const char* INVITE = "INVITE ";
+    static constexpr const char* TAG_PARAM = ";tag=";
+    static constexpr const char* BRANCH_PARAM = ";branch=";
     static constexpr const char* APPLICATION_DTMF_RELAY = "application/dtmf-relay";
+    static constexpr const char* APPLICATION_SDP = "application/sdp";
     static constexpr const char* SIGNAL = "Signal=";
     static constexpr const char* DURATION = "Duration=";
 };
+
+/**
+ * View of all values of a header that may occur several times
+ */
+class SipPacket::Values
+{
+public:
+    Values(const SipPacket& packet, const HeaderValues& values)
+    : m_packet(packet)
+    , m_values(values)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_values.size();
+    }
+
+    bool empty() const
+    {
+        return m_values.empty();
+    }
+
+    StringView operator[](size_t index) const
+    {
+        return m_packet.view(m_values[index]);
+    }
+
+private:
+    const SipPacket& m_packet;
+    const HeaderValues& m_values;
+};
+
+inline SipPacket::Values SipPacket::get_vias() const
+{
+    return Values(*this, m_vias);
+}
+
+inline SipPacket::Values SipPacket::get_record_routes() const
+{
+    return Values(*this, m_record_routes);
+}
+
+inline SipPacket::Values SipPacket::get_routes() const
+{
+    return Values(*this, m_routes);
+}
+
+inline SipPacket::Values SipPacket::get_contacts() const
+{
+    return Values(*this, m_contacts);
+}
+
+inline SipPacket::Values SipPacket::get_www_authenticates() const
+{
+    return Values(*this, m_www_authenticates);
+}
+
+inline SipPacket::Values SipPacket::get_proxy_authenticates() const
+{
+    return Values(*this, m_proxy_authenticates);
+}
@@ -0,0 +1,204 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "sip_packet.h"
+#include "string_view.h"
+
+/**
+ * Lifetime of the binding at the registrar (RFC 3261 section 10)
+ *
+ * The registrar may grant a shorter expiry than requested, in the expires parameter of our
+ * Contact or in the Expires header of the 2xx. The refresh is scheduled at half of the
+ * granted time, but not later than the maximum refresh interval. A short interval keeps the
+ * NAT binding to the registrar open, a long one saves traffic.
+ *
+ * After a failed REGISTER the next attempt is delayed, the delay doubles with every failure
+ * up to MAX_RETRY_MSEC.
+ */
+class SipRegistration
+{
+public:
+    static constexpr uint32_t DEFAULT_EXPIRES_SEC = 3600;
+    static constexpr uint32_t DEFAULT_MAX_REFRESH_INTERVAL_SEC = 1800;
+    static constexpr uint32_t MIN_RETRY_MSEC = 2000;
+    static constexpr uint32_t MAX_RETRY_MSEC = 64000;
+
+    SipRegistration()
+    : m_expires(DEFAULT_EXPIRES_SEC)
+    , m_max_refresh_interval(DEFAULT_MAX_REFRESH_INTERVAL_SEC)
+    , m_registered(false)
+    , m_retry_delay(0)
+    , m_timer_active(false)
+    , m_deadline(0)
+    {
+    }
+
+    /**
+     * \param[in] expires_sec Expiry requested in the REGISTER
+     * \param[in] max_refresh_interval_sec Upper limit of the time between two REGISTER
+     */
+    void set_timing(uint32_t expires_sec, uint32_t max_refresh_interval_sec)
+    {
+        m_expires = expires_sec;
+        m_max_refresh_interval = (max_refresh_interval_sec != 0) ? max_refresh_interval_sec : expires_sec;
+    }
+
+    uint32_t get_requested_expires() const
+    {
+        return m_expires;
+    }
+
+    bool is_registered() const
+    {
+        return m_registered;
+    }
+
+    /**
+     * Evaluate the 2xx to our REGISTER and schedule the refresh
+     *
+     * \param[in] contact_uri Our Contact URI without parameters, to find our binding among all bindings of the AOR
+     * \return the granted expiry in seconds
+     */
+    uint32_t on_registered(const SipPacket& response, StringView contact_uri, TickType_t now)
+    {
+        uint32_t granted = granted_expires(response, contact_uri);
+        uint32_t refresh = granted / 2;
+        if (refresh > m_max_refresh_interval)
+        {
+            refresh = m_max_refresh_interval;
+        }
+        if (refresh == 0)
+        {
+            refresh = 1;
+        }
+        ESP_LOGI(TAG, "Registered for %d sec, refresh in %d sec", (int) granted, (int) refresh);
+
+        m_registered = true;
+        m_retry_delay = 0;
+        start_timer(now, refresh * 1000);
+        return granted;
+    }
+
+    /**
+     * Schedule the next attempt after a failed REGISTER
+     *
+     * \return the delay until the next attempt in msec
+     */
+    uint32_t on_failed(TickType_t now)
+    {
+        if (m_retry_delay == 0)
+        {
+            m_retry_delay = MIN_RETRY_MSEC;
+        }
+        else if (m_retry_delay < MAX_RETRY_MSEC / 2)
+        {
+            m_retry_delay *= 2;
+        }
+        else
+        {
+            m_retry_delay = MAX_RETRY_MSEC;
+        }
+        ESP_LOGW(TAG, "Registration failed, next attempt in %d msec", (int) m_retry_delay);
+
+        m_registered = false;
+        start_timer(now, m_retry_delay);
+        return m_retry_delay;
+    }
+
+    /**
+     * \return true if the refresh or retry timer is running
+     */
+    bool is_timer_active() const
+    {
+        return m_timer_active;
+    }
+
+    /**
+     * \return true if the refresh or retry timer expired, it is stopped then
+     */
+    bool check_timer(TickType_t now)
+    {
+        if (!m_timer_active || (static_cast<int32_t>(now - m_deadline) < 0))
+        {
+            return false;
+        }
+        m_timer_active = false;
+        return true;
+    }
+
+    void stop_timer()
+    {
+        m_timer_active = false;
+    }
+
+    /**
+     * \return false if no timer is running
+     */
+    bool get_next_deadline(TickType_t& deadline) const
+    {
+        deadline = m_deadline;
+        return m_timer_active;
+    }
+
+private:
+    uint32_t granted_expires(const SipPacket& response, StringView contact_uri) const
+    {
+        uint32_t expires = 0;
+        SipPacket::Values contacts = response.get_contacts();
+        for (size_t i = 0; i < contacts.size(); i++)
+        {
+            StringView contact = contacts[i];
+            size_t first_pos = contact.find('<');
+            size_t last_pos = contact.find('>');
+            if ((first_pos == StringView::npos) || (last_pos == StringView::npos) || (last_pos < first_pos))
+            {
+                continue;
+            }
+            StringView uri = contact.substr(first_pos + 1, last_pos - first_pos - 1);
+            uri = uri.substr(0, uri.find(';'));
+            if (uri.equals_ignore_case(contact_uri) && SipPacket::get_param(contact, "expires").to_uint(expires))
+            {
+                return expires;
+            }
+        }
+        if (response.get_expires(expires) && (expires != 0))
+        {
+            return expires;
+        }
+        return m_expires;
+    }
+
+    void start_timer(TickType_t now, uint32_t msec)
+    {
+        m_deadline = now + msec / portTICK_RATE_MS;
+        m_timer_active = true;
+    }
+
+    uint32_t m_expires;
+    uint32_t m_max_refresh_interval;
+    bool m_registered;
+    uint32_t m_retry_delay;
+    bool m_timer_active;
+    TickType_t m_deadline;
+
+    static constexpr const char* TAG = "SipRegistration";
+};
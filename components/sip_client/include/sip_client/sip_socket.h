@@ -0,0 +1,72 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "buffer.h"
+#include "rx_buffer_pool.h"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Compile time check of the SocketT parameter of SipClient
+ *
+ * C++14 has no concepts, so the interface is spelled out here and checked with a static_assert.
+ * A SocketT is one UDP socket towards the SIP server, e.g. LwipUdpClient on the ESP32 or
+ * PosixUdpClient and EpollUdpClient on a host:
+ *
+ *     static constexpr uint32_t RECEIVE_FOREVER;
+ *     SocketT(const std::string& server_ip, const std::string& server_port, uint16_t local_port);
+ *     bool init();                     //resolve the server and bind the local port
+ *     void deinit();
+ *     bool is_initialized() const;
+ *     void set_server_ip(const std::string& server_ip);    //takes effect with the next init()
+ *     RxDatagram receive(uint32_t timeout_msec);           //empty on timeout and after wake()
+ *     void wake();                     //may be called by other tasks, a wake-up must not be lost
+ *     TxBufferT& get_new_tx_buf();     //empty buffer for the next datagram
+ *     bool send_buffered_data();       //send the datagram of the last get_new_tx_buf()
+ *
+ * The socket is used by one task, except for wake() and releasing received datagrams. A datagram
+ * borrows a receive buffer of the socket until it is released, see RxBufferPool. A socket may defer
+ * sending until its next receive(), e.g. to send several datagrams with one system call, but it
+ * must not block before.
+ */
+template <class SocketT, class = void>
+struct IsSipSocket : std::false_type {
+};
+
+template <class...>
+struct MakeVoid {
+    using type = void;
+};
+
+template <class SocketT>
+struct IsSipSocket<SocketT, typename MakeVoid<
+        decltype(SocketT::RECEIVE_FOREVER),
+        decltype(std::declval<SocketT&>().deinit()),
+        decltype(std::declval<SocketT&>().set_server_ip(std::declval<const std::string&>())),
+        decltype(std::declval<SocketT&>().wake()),
+        typename std::enable_if<std::is_convertible<decltype(std::declval<SocketT&>().init()), bool>::value>::type,
+        typename std::enable_if<std::is_convertible<decltype(std::declval<const SocketT&>().is_initialized()), bool>::value>::type,
+        typename std::enable_if<std::is_same<decltype(std::declval<SocketT&>().receive(uint32_t())), RxDatagram>::value>::type,
+        typename std::enable_if<std::is_same<decltype(std::declval<SocketT&>().get_new_tx_buf()), TxBufferT&>::value>::type,
+        typename std::enable_if<std::is_convertible<decltype(std::declval<SocketT&>().send_buffered_data()), bool>::value>::type,
+        typename std::enable_if<std::is_constructible<SocketT, const std::string&, const std::string&, uint16_t>::value>::type
+    >::type> : std::true_type {
+};
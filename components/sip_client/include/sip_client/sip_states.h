@@ -0,0 +1,305 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "sip_dialog.h"
+#include "sip_packet.h"
+
+#include "boost/sml.hpp"
+
+namespace sml = boost::sml;
+
+/**
+ * Events of the state machines of SipClientInt
+ *
+ * Responses are split by their status class, so the transition tables only need guards for
+ * the few status codes with a special meaning (100 Trying, 401/407 challenges).
+ */
+
+/** The client may send a request, raised once per run() */
+struct ev_send {};
+
+/** The refresh or retry timer of the registration expired */
+struct ev_registration_timer {};
+
+/** A client transaction of the registration or the dialog timed out without a final response */
+struct ev_timeout {};
+
+/** An outgoing call was requested */
+struct ev_dial {};
+
+/** An incoming INVITE was accepted, it is answered after the answer delay */
+struct ev_accept {};
+
+/** The caller cancelled an incoming INVITE before it was answered */
+struct ev_rx_cancel {};
+
+/** The ACK of our 2xx to an incoming INVITE arrived */
+struct ev_rx_ack {};
+
+struct ev_rx_provisional {
+    const SipPacket& packet;    ///< 1xx response
+};
+
+struct ev_rx_success {
+    const SipPacket& packet;    ///< 2xx response
+};
+
+struct ev_rx_failure {
+    const SipPacket& packet;    ///< 3xx-6xx response
+};
+
+struct ev_rx_bye {
+    const SipPacket& packet;
+};
+
+struct ev_rx_info {
+    const SipPacket& packet;
+};
+
+/**
+ * Raise the event of the status class of a response
+ */
+template<class SmT>
+void process_response(SmT& sm, const SipPacket& packet)
+{
+    switch (packet.get_status_class())
+    {
+    case SipPacket::StatusClass::PROVISIONAL_1XX:
+        sm.process_event(ev_rx_provisional{packet});
+        break;
+    case SipPacket::StatusClass::SUCCESS_2XX:
+        sm.process_event(ev_rx_success{packet});
+        break;
+    case SipPacket::StatusClass::REDIRECTION_3XX:
+    case SipPacket::StatusClass::CLIENT_ERROR_4XX:
+    case SipPacket::StatusClass::SERVER_ERROR_5XX:
+    case SipPacket::StatusClass::GLOBAL_FAILURE_6XX:
+        sm.process_event(ev_rx_failure{packet});
+        break;
+    case SipPacket::StatusClass::UNKNOWN:
+        break;
+    }
+}
+
+namespace sip_guards {
+
+inline bool is_auth_challenge(const SipPacket& packet)
+{
+    return (packet.get_status() == SipPacket::Status::UNAUTHORIZED_401) || (packet.get_status() == SipPacket::Status::PROXY_AUTH_REQ_407);
+}
+
+inline bool is_invite_response(const SipPacket& packet)
+{
+    return packet.get_cseq_method() == SipPacket::Method::INVITE;
+}
+
+}
+
+/**
+ * Registration of the client at the server, see the state diagram in README.rst
+ */
+template <class SipClientT>
+struct sip_registration_states {
+    auto operator()() const noexcept {
+        using namespace sml;
+        using SipState = typename SipClientT::SipState;
+
+        const auto idle = state<class idle>;
+        const auto register_unauth = state<class register_unauth>;
+        const auto register_auth = state<class register_auth>;
+        const auto registered = state<class registered>;
+        const auto error = state<class error>;
+
+        //retransmissions are done by the transaction, a new REGISTER is sent once it is terminated
+        const auto request_idle = [](SipClientT& sip) { return !sip.m_request_transaction.is_pending(); };
+        const auto challenge = [](const ev_rx_failure& event) { return sip_guards::is_auth_challenge(event.packet); };
+
+        const auto send_register_unauth = [](SipClientT& sip) { sip.send_register(false); };
+        const auto send_register_auth = [](SipClientT& sip) { sip.send_register(true); };
+        const auto on_registered = [](SipClientT& sip, const ev_rx_success& event) { sip.registered(event.packet); };
+        const auto on_failed = [](SipClientT& sip) { sip.registration_failed(); };
+        const auto next_sequence = [](SipClientT& sip) { sip.m_sip_sequence_number++; };
+        const auto restart = [](SipClientT& sip) {
+            sip.m_registration.stop_timer();
+            sip.m_sip_sequence_number++;
+        };
+        const auto enter = [](SipState new_state) {
+            return [new_state](SipClientT& sip) { sip.set_state(new_state); };
+        };
+
+        return make_transition_table(
+            *idle + event<ev_send> [request_idle] / send_register_unauth = register_unauth
+            , register_unauth + event<ev_send> [request_idle] / send_register_unauth
+            , register_unauth + event<ev_rx_success> / on_registered = registered
+            , register_unauth + event<ev_rx_failure> [challenge] / next_sequence = register_auth
+            , register_unauth + event<ev_rx_failure> [!challenge] = error
+            , register_unauth + event<ev_timeout> = error
+            , register_auth + event<ev_send> [request_idle] / send_register_auth
+            , register_auth + event<ev_rx_success> / on_registered = registered
+            , register_auth + event<ev_rx_failure> = error
+            , register_auth + event<ev_timeout> = error
+            , registered + event<ev_registration_timer> = register_unauth
+            , error + event<ev_registration_timer> / next_sequence = idle
+            , error + event<ev_rx_success> / restart = idle
+            , error + event<ev_rx_failure> / restart = idle
+
+            , idle + on_entry<_> / enter(SipState::IDLE)
+            , register_unauth + on_entry<_> / enter(SipState::REGISTER_UNAUTH)
+            , register_auth + on_entry<_> / enter(SipState::REGISTER_AUTH)
+            , registered + on_entry<_> / enter(SipState::REGISTERED)
+            , error + on_entry<_> / (enter(SipState::ERROR), on_failed)
+        );
+    }
+};
+
+/**
+ * One call, see the state diagram in README.rst
+ *
+ * Each dialog has a state machine of its own, the dialog is passed as dependency.
+ */
+template <class SipClientT>
+struct sip_dialog_states {
+    auto operator()() const noexcept {
+        using namespace sml;
+        using State = SipDialog::State;
+
+        const auto terminated = state<class terminated>;
+        const auto invite_unauth = state<class invite_unauth>;
+        const auto invite_unauth_sent = state<class invite_unauth_sent>;
+        const auto invite_auth = state<class invite_auth>;
+        const auto ringing = state<class ringing>;
+        const auto call_start = state<class call_start>;
+        const auto call_in_progress = state<class call_in_progress>;
+        const auto cancelled = state<class cancelled>;
+        const auto alerting = state<class alerting>;
+        const auto hanging_up = state<class hanging_up>;
+
+        const auto invite_idle = [](SipDialog& dialog) { return !dialog.invite_transaction.is_pending(); };
+        const auto answered_elsewhere = [](SipDialog& dialog) { return dialog.answered_elsewhere; };
+        const auto cancel_requested = [](SipDialog& dialog) { return dialog.cancel_requested; };
+        const auto bye_requested = [](SipDialog& dialog) { return dialog.bye_requested; };
+        const auto request_idle = [](SipDialog& dialog) { return !dialog.request_transaction.is_pending(); };
+        const auto session_due = [](SipClientT& sip, SipDialog& dialog) { return sip.is_session_timer_due(dialog); };
+        const auto refresher = [](SipDialog& dialog) { return dialog.session_refresher; };
+        const auto outgoing = [](SipDialog& dialog) { return dialog.outgoing; };
+        const auto answer_due = [](SipClientT& sip, SipDialog& dialog) { return sip.is_answer_due(dialog); };
+        const auto trying = [](const ev_rx_provisional& event) { return event.packet.get_status() == SipPacket::Status::TRYING_100; };
+        const auto challenge = [](const ev_rx_failure& event) { return sip_guards::is_auth_challenge(event.packet); };
+        const auto invite_success = [](const ev_rx_success& event) { return sip_guards::is_invite_response(event.packet); };
+        const auto invite_failure = [](const ev_rx_failure& event) { return sip_guards::is_invite_response(event.packet); };
+        const auto update_success = [](const ev_rx_success& event) { return event.packet.get_cseq_method() == SipPacket::Method::UPDATE; };
+        const auto update_failure = [](const ev_rx_failure& event) { return event.packet.get_cseq_method() == SipPacket::Method::UPDATE; };
+        //RFC 4028 section 10, the other side lost the dialog
+        const auto dialog_gone = [](const ev_rx_failure& event) {
+            return (event.packet.get_status() == SipPacket::Status::REQUEST_TIMEOUT_408)
+                   || (event.packet.get_status() == SipPacket::Status::CALL_DOES_NOT_EXIST_481);
+        };
+        const auto dtmf = [](const ev_rx_info& event) {
+            return event.packet.get_content_type() == SipPacket::ContentType::APPLICATION_DTMF_RELAY;
+        };
+
+        const auto send_invite_unauth = [](SipClientT& sip, SipDialog& dialog) { sip.send_invite(dialog, false); };
+        const auto send_invite_auth = [](SipClientT& sip, SipDialog& dialog) { sip.send_invite(dialog, true); };
+        const auto send_cancel = [](SipClientT& sip, SipDialog& dialog) { sip.send_cancel(dialog); };
+        const auto send_ack = [](SipClientT& sip, SipDialog& dialog) { sip.send_sip_ack(dialog); };
+        const auto send_bye = [](SipClientT& sip, SipDialog& dialog) { sip.send_bye(dialog); };
+        const auto send_update = [](SipClientT& sip, SipDialog& dialog) { sip.send_update(dialog); };
+        const auto session_refreshed = [](SipClientT& sip, SipDialog& dialog, const ev_rx_success& event) { sip.session_refreshed(dialog, event.packet); };
+        const auto refresh_rejected = [](SipClientT& sip, SipDialog& dialog) { sip.refresh_rejected(dialog); };
+        const auto session_expired = [](SipClientT& sip, SipDialog& dialog) { sip.session_expired(dialog); };
+        const auto start_ringing = [](SipClientT& sip, SipDialog& dialog) { sip.start_ringing(dialog); };
+        const auto challenged = [](SipClientT& sip, SipDialog& dialog) { sip.invite_challenged(dialog); };
+        const auto call_started = [](SipClientT& sip, SipDialog& dialog, const ev_rx_success& event) { sip.call_start(dialog, event.packet); };
+        const auto call_failed = [](SipClientT& sip, SipDialog& dialog, const ev_rx_failure& event) { sip.call_failed(dialog, event.packet); };
+        const auto call_timeout = [](SipClientT& sip, SipDialog& dialog) { sip.call_timeout(dialog); };
+        //challenged after another target answered, no need to authenticate
+        const auto dropped = [](SipClientT& sip, SipDialog& dialog) { sip.drop_call(dialog); };
+        const auto call_end = [](SipClientT& sip, SipDialog& dialog) { sip.call_end(dialog); };
+        const auto alert = [](SipClientT& sip, SipDialog& dialog) { sip.alert(dialog); };
+        const auto answer = [](SipClientT& sip, SipDialog& dialog) { sip.answer_call(dialog); };
+        const auto caller_cancelled = [](SipClientT& sip, SipDialog& dialog) { sip.caller_cancelled(dialog); };
+        const auto button_press = [](SipClientT& sip, SipDialog& dialog, const ev_rx_info& event) { sip.button_press(dialog, event.packet); };
+        const auto enter = [](State new_state) {
+            return [new_state](SipClientT& sip, SipDialog& dialog) { sip.set_dialog_state(dialog, new_state); };
+        };
+
+        return make_transition_table(
+            *terminated + event<ev_dial> = invite_unauth
+            , terminated + event<ev_accept> / alert = alerting
+            , alerting + event<ev_send> [answer_due] / answer = call_start
+            , alerting + event<ev_rx_cancel> / caller_cancelled = terminated
+            , invite_unauth + event<ev_send> / send_invite_unauth = invite_unauth_sent
+            , invite_unauth_sent + event<ev_rx_provisional> [!trying] / start_ringing = ringing
+            , invite_unauth_sent + event<ev_rx_success> / call_started = call_start
+            , invite_unauth_sent + event<ev_rx_failure> [challenge] / challenged = invite_auth
+            , invite_unauth_sent + event<ev_rx_failure> [!challenge] / call_failed = terminated
+            , invite_unauth_sent + event<ev_timeout> / call_timeout = terminated
+            //an INVITE in flight is cancelled after its first provisional response instead
+            , invite_auth + event<ev_send> [answered_elsewhere && invite_idle] / dropped = terminated
+            , invite_auth + event<ev_send> [invite_idle] / send_invite_auth
+            //trying is not yet ringing, but change state to not send invite again
+            , invite_auth + event<ev_rx_provisional> / start_ringing = ringing
+            , invite_auth + event<ev_rx_success> / call_started = call_start
+            //a second challenge means the credentials are not accepted
+            , invite_auth + event<ev_rx_failure> / call_failed = terminated
+            , invite_auth + event<ev_timeout> / call_timeout = terminated
+            //a CANCEL must not be sent before a provisional response
+            , ringing + event<ev_send> [cancel_requested] / send_cancel = cancelled
+            , ringing + event<ev_rx_success> [invite_success] / call_started = call_start
+            , ringing + event<ev_rx_failure> [invite_failure && challenge] / challenged = invite_auth
+            , ringing + event<ev_rx_failure> [invite_failure && !challenge] / call_failed = terminated
+            , ringing + event<ev_timeout> / call_timeout = terminated
+            , call_start + event<ev_send> [outgoing] / send_ack = call_in_progress
+            , call_start + event<ev_rx_ack> = call_in_progress
+            //Timer H, the ACK of our 2xx did not arrive
+            , call_start + event<ev_timeout> / call_end = terminated
+            , call_start + event<ev_rx_bye> / call_end = terminated
+            , call_start + event<ev_rx_info> [dtmf] / button_press
+            , call_in_progress + event<ev_send> [bye_requested] / send_bye = hanging_up
+            , call_in_progress + event<ev_send> [session_due && refresher && request_idle] / send_update
+            , call_in_progress + event<ev_send> [session_due && !refresher] / session_expired = hanging_up
+            , call_in_progress + event<ev_rx_success> [update_success] / session_refreshed
+            , call_in_progress + event<ev_rx_failure> [update_failure && dialog_gone] / send_bye = hanging_up
+            , call_in_progress + event<ev_rx_failure> [update_failure && !dialog_gone] / refresh_rejected
+            //the UPDATE timed out, the other side is not reachable anymore
+            , call_in_progress + event<ev_timeout> / send_bye = hanging_up
+            , call_in_progress + event<ev_rx_bye> / call_end = terminated
+            , call_in_progress + event<ev_rx_info> [dtmf] / button_press
+            , hanging_up + event<ev_rx_success> = terminated
+            , hanging_up + event<ev_rx_failure> = terminated
+            , hanging_up + event<ev_timeout> = terminated
+            //the BYE of the other side crossed ours
+            , hanging_up + event<ev_rx_bye> = terminated
+            //the other side picked up before the CANCEL arrived
+            , cancelled + event<ev_rx_success> [invite_success] / call_started = call_start
+            , cancelled + event<ev_rx_failure> [invite_failure] / call_failed = terminated
+            , cancelled + event<ev_timeout> / call_timeout = terminated
+
+            , terminated + on_entry<_> / enter(State::TERMINATED)
+            , invite_unauth + on_entry<_> / enter(State::INVITE_UNAUTH)
+            , invite_unauth_sent + on_entry<_> / enter(State::INVITE_UNAUTH_SENT)
+            , invite_auth + on_entry<_> / enter(State::INVITE_AUTH)
+            , ringing + on_entry<_> / enter(State::RINGING)
+            , call_start + on_entry<_> / enter(State::CALL_START)
+            , call_in_progress + on_entry<_> / enter(State::CALL_IN_PROGRESS)
+            , cancelled + on_entry<_> / enter(State::CANCELLED)
+            , alerting + on_entry<_> / enter(State::ALERTING)
+            , hanging_up + on_entry<_> / enter(State::HANGING_UP)
+        );
+    }
+};
@@ -0,0 +1,257 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_log.h"
+#include "sip_packet.h"
+#include "string_view.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+/**
+ * Incremental framer for SIP messages on a byte stream, e.g. TCP or TLS
+ *
+ * The transport receives directly into the buffer returned by prepare() and reports the
+ * number of received byte with commit(). Each chunk is scanned once, the scan resumes where
+ * the previous chunk ended. A message is complete when its header is terminated by an empty
+ * line and Content-Length byte of body have arrived. Complete messages are handed out as a
+ * view into the internal buffer, which can be parsed with SipPacket without copying.
+ *
+ * Empty lines between messages (RFC 5626 keep-alive) are skipped.
+ */
+template <size_t SIZE>
+class SipStreamParser
+{
+    static_assert(SIZE <= SipPacket::MAX_MESSAGE_SIZE, "SipPacket can not parse messages of SIZE byte");
+
+public:
+    SipStreamParser()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        m_length = 0;
+        m_begin = 0;
+        m_scan = 0;
+        m_line_start = 0;
+        m_header_length = 0;
+        m_content_length = 0;
+        m_start_line_seen = false;
+        m_error = false;
+    }
+
+    /**
+     * Get the free space for the next chunk
+     *
+     * Consumed messages are dropped from the buffer first. A complete message that is not
+     * consumed yet is not moved, so there may be no space until it is consumed.
+     *
+     * \param[out] available Number of byte that may be written
+     * \return pointer to the free space, nullptr if the buffer is full
+     */
+    char* prepare(size_t& available)
+    {
+        if (!is_complete())
+        {
+            compact();
+        }
+        available = SIZE - m_length;
+        return (available > 0) ? m_buffer.data() + m_length : nullptr;
+    }
+
+    /**
+     * Mark length byte written into the space returned by prepare() as received
+     */
+    void commit(size_t length)
+    {
+        m_length += std::min(length, SIZE - m_length);
+    }
+
+    /**
+     * Copy a chunk into the buffer, for transports that can not receive into prepare()
+     *
+     * \return false if the chunk does not fit, it may fit after the pending message is consumed
+     */
+    bool feed(const char* data, size_t length)
+    {
+        size_t available = 0;
+        char* dest = prepare(available);
+        if (length > available)
+        {
+            ESP_LOGW(TAG, "Chunk of %d byte does not fit into %d free byte", (int) length, (int) available);
+            if (!is_complete())
+            {
+                m_error = true;
+            }
+            return false;
+        }
+        memcpy(dest, data, length);
+        commit(length);
+        return true;
+    }
+
+    /**
+     * Get the next complete message
+     *
+     * The view stays valid until consume() is called. The same message is returned
+     * again until it is consumed.
+     *
+     * \return false if more data is needed
+     */
+    bool next(StringView& message)
+    {
+        if (m_error)
+        {
+            return false;
+        }
+        if (m_header_length == 0)
+        {
+            scan_header();
+        }
+        if (!is_complete())
+        {
+            if ((m_begin == 0) && (m_length == SIZE))
+            {
+                ESP_LOGW(TAG, "Message does not fit into %d byte", (int) SIZE);
+                m_error = true;
+            }
+            return false;
+        }
+        message = StringView(m_buffer.data() + m_begin, m_header_length + m_content_length);
+        return true;
+    }
+
+    /**
+     * Drop the message returned by next()
+     */
+    void consume()
+    {
+        if (m_header_length == 0)
+        {
+            return;
+        }
+        m_begin += m_header_length + m_content_length;
+        m_scan = m_begin;
+        m_line_start = m_begin;
+        m_header_length = 0;
+        m_content_length = 0;
+        m_start_line_seen = false;
+    }
+
+    /**
+     * The stream can not be framed anymore (message too big or invalid), it must be reset
+     */
+    bool is_error() const
+    {
+        return m_error;
+    }
+
+private:
+    /**
+     * The current message was received completely, next() hands it out
+     */
+    bool is_complete() const
+    {
+        return (m_header_length != 0) && (m_length - m_begin >= m_header_length + m_content_length);
+    }
+
+    /**
+     * Move the unconsumed data to the start of the buffer
+     */
+    void compact()
+    {
+        if (m_begin == 0)
+        {
+            return;
+        }
+        memmove(m_buffer.data(), m_buffer.data() + m_begin, m_length - m_begin);
+        m_length -= m_begin;
+        m_scan -= m_begin;
+        m_line_start -= m_begin;
+        m_begin = 0;
+    }
+
+    void scan_header()
+    {
+        while (m_scan < m_length)
+        {
+            const void* found = memchr(m_buffer.data() + m_scan, '\n', m_length - m_scan);
+            if (found == nullptr)
+            {
+                m_scan = m_length;
+                return;
+            }
+            size_t line_end = static_cast<const char*>(found) - m_buffer.data();
+            StringView line(m_buffer.data() + m_line_start, line_end - m_line_start);
+            if (!line.empty() && (line[line.size() - 1] == '\r'))
+            {
+                line = line.substr(0, line.size() - 1);
+            }
+            m_scan = line_end + 1;
+            m_line_start = m_scan;
+
+            if (line.empty())
+            {
+                if (!m_start_line_seen)
+                {
+                    //keep-alive between messages
+                    m_begin = m_scan;
+                    continue;
+                }
+                m_header_length = m_scan - m_begin;
+                return;
+            }
+
+            if (!m_start_line_seen)
+            {
+                m_start_line_seen = true;
+                continue;
+            }
+
+            size_t colon = line.find(':');
+            if ((colon != StringView::npos)
+                && (SipPacket::convert_header(line.substr(0, colon).trim()) == SipPacket::Header::CONTENT_LENGTH))
+            {
+                uint32_t content_length = 0;
+                if (!line.substr(colon + 1).trim().to_uint(content_length))
+                {
+                    //without a valid length the stream can not be framed
+                    ESP_LOGW(TAG, "Invalid Content-Length %.*s", (int) line.size(), line.data());
+                    m_error = true;
+                    return;
+                }
+                m_content_length = content_length;
+            }
+        }
+    }
+
+    std::array<char, SIZE> m_buffer;
+    size_t m_length;            ///< number of valid byte in m_buffer
+    size_t m_begin;             ///< start of the current message
+    size_t m_scan;              ///< next byte to scan
+    size_t m_line_start;        ///< start of the currently scanned line
+    size_t m_header_length;     ///< length of the header including the empty line, 0 if not complete yet
+    uint32_t m_content_length;
+    bool m_start_line_seen;
+    bool m_error;
+
+    static constexpr const char* TAG = "SipStreamParser";
+};
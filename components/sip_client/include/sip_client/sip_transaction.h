@@ -0,0 +1,442 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "buffer.h"
+#include "esp_log.h"
+#include "sip_packet.h"
+#include "string_view.h"
+
+#include <array>
+#include <cstring>
+
+/**
+ * Transaction state machine of RFC 3261 section 17 for an unreliable transport
+ *
+ * A transaction is identified by the branch parameter of the topmost Via and the method.
+ * It does not send anything itself, the owner calls poll() regularly and retransmits the
+ * request (client transactions) or the stored message (server transactions) when asked to.
+ *
+ * * Client INVITE: Timer A retransmits with T1, 2*T1, 4*T1, ... until a response arrives,
+ *   Timer B gives up after 64*T1. After a non 2xx final response Timer D absorbs
+ *   retransmissions of it, each one is answered with the stored ACK.
+ * * Client non-INVITE: Timer E retransmits with T1, 2*T1, ... capped at T2, Timer F gives up
+ *   after 64*T1, Timer K absorbs response retransmissions.
+ * * Server INVITE: a retransmitted INVITE is answered with the last response. A final
+ *   response is retransmitted (Timer G, and RFC 6026 for 2xx) until the ACK arrives or
+ *   Timer H (64*T1) fires.
+ * * Server non-INVITE: a retransmitted request is answered with the last response until
+ *   Timer J (64*T1) fires.
+ */
+class SipTransaction
+{
+public:
+    enum class Type {
+        CLIENT_INVITE,
+        CLIENT_NON_INVITE,
+        SERVER_INVITE,
+        SERVER_NON_INVITE,
+    };
+
+    enum class State {
+        TERMINATED,
+        CALLING,
+        TRYING,
+        PROCEEDING,
+        COMPLETED,
+        ACCEPTED,
+        CONFIRMED,
+    };
+
+    /**
+     * What to do with a message matched to the transaction
+     */
+    enum class Result {
+        PASS,       ///< hand the message to the transaction user
+        ABSORB,     ///< retransmission, drop it
+        RESEND,     ///< retransmission, answer it with the stored message
+    };
+
+    /**
+     * What to do after poll()
+     */
+    enum class Action {
+        NONE,
+        RETRANSMIT, ///< send the request again (client) or the stored message (server)
+        TIMEOUT,    ///< the transaction failed, inform the transaction user
+    };
+
+    static constexpr uint32_t T1_MSEC = 500;
+    static constexpr uint32_t T2_MSEC = 4000;
+    static constexpr uint32_t T4_MSEC = 5000;
+    static constexpr uint32_t TIMER_D_MSEC = 32000;
+    static constexpr size_t MAX_BRANCH_LENGTH = 64;
+    static constexpr size_t MESSAGE_SIZE = 1024;
+
+    SipTransaction()
+    : m_type(Type::CLIENT_NON_INVITE)
+    , m_state(State::TERMINATED)
+    , m_method(SipPacket::Method::UNKNOWN)
+    , m_branch_length(0)
+    , m_cseq(0)
+    , m_retransmit_active(false)
+    , m_retransmit_deadline(0)
+    , m_retransmit_interval(0)
+    , m_timeout_active(false)
+    , m_timeout_deadline(0)
+    {
+    }
+
+    /**
+     * Start a client transaction, the request must have been sent just before
+     */
+    void start_client(SipPacket::Method method, StringView branch, uint32_t cseq, TickType_t now)
+    {
+        bool invite = (method == SipPacket::Method::INVITE);
+        init(invite ? Type::CLIENT_INVITE : Type::CLIENT_NON_INVITE, method, branch, cseq);
+        m_state = invite ? State::CALLING : State::TRYING;
+        start_retransmit(now, T1_MSEC);
+        //Timer B or Timer F
+        start_timeout(now, 64 * T1_MSEC);
+    }
+
+    /**
+     * Start a server transaction for a received request that matched no other transaction
+     */
+    void start_server(const SipPacket& request)
+    {
+        bool invite = (request.get_method() == SipPacket::Method::INVITE);
+        init(invite ? Type::SERVER_INVITE : Type::SERVER_NON_INVITE, request.get_method(), request.get_branch(), request.get_cseq_number());
+        m_state = invite ? State::PROCEEDING : State::TRYING;
+    }
+
+    bool is_active() const
+    {
+        return m_state != State::TERMINATED;
+    }
+
+    /**
+     * A client transaction is waiting for its final response
+     */
+    bool is_pending() const
+    {
+        return (m_state == State::CALLING) || (m_state == State::TRYING) || (m_state == State::PROCEEDING);
+    }
+
+    Type get_type() const
+    {
+        return m_type;
+    }
+
+    State get_state() const
+    {
+        return m_state;
+    }
+
+    SipPacket::Method get_method() const
+    {
+        return m_method;
+    }
+
+    /**
+     * Stop the transaction without informing anybody, e.g. when the transaction user gives up
+     */
+    void terminate()
+    {
+        m_state = State::TERMINATED;
+        m_retransmit_active = false;
+        m_timeout_active = false;
+    }
+
+    bool matches_response(const SipPacket& response) const
+    {
+        return is_client() && is_active() && (response.get_cseq_method() == m_method) && (response.get_branch() == branch());
+    }
+
+    bool matches_request(const SipPacket& request) const
+    {
+        if (is_client() || !is_active())
+        {
+            return false;
+        }
+        SipPacket::Method method = request.get_method();
+        if ((method == SipPacket::Method::ACK) && (m_type == Type::SERVER_INVITE))
+        {
+            //the ACK of a non 2xx response has the branch of the INVITE, the ACK of a 2xx is a new
+            //transaction, it is matched by the CSeq number
+            return (request.get_branch() == branch())
+                   || ((m_state == State::ACCEPTED) && (request.get_cseq_number() == m_cseq));
+        }
+        return (method == m_method) && (request.get_branch() == branch());
+    }
+
+    /**
+     * A CANCEL has the branch of the INVITE it cancels, but is a transaction of its own (RFC 3261 section 9.2)
+     */
+    bool matches_cancel(const SipPacket& cancel) const
+    {
+        return (m_type == Type::SERVER_INVITE) && is_active() && (cancel.get_branch() == branch());
+    }
+
+    /**
+     * Give up if no final response arrives within 64*T1, e.g. after a CANCEL (RFC 3261 section 9.1)
+     */
+    void expect_final_response(TickType_t now)
+    {
+        if (is_pending())
+        {
+            start_timeout(now, 64 * T1_MSEC);
+        }
+    }
+
+    /**
+     * Feed a response matched by matches_response()
+     */
+    Result on_response(const SipPacket& response, TickType_t now)
+    {
+        bool provisional = !response.is_final_response();
+        switch (m_state)
+        {
+        case State::CALLING:
+        case State::TRYING:
+        case State::PROCEEDING:
+            if (provisional)
+            {
+                if (m_type == Type::CLIENT_INVITE)
+                {
+                    //a provisional response stops Timer A and Timer B
+                    m_retransmit_active = false;
+                    m_timeout_active = false;
+                }
+                else if (m_state == State::TRYING)
+                {
+                    //Timer E continues with T2
+                    m_retransmit_interval = T2_MSEC;
+                }
+                m_state = State::PROCEEDING;
+                return Result::PASS;
+            }
+            m_retransmit_active = false;
+            if ((m_type == Type::CLIENT_INVITE) && (response.get_status_class() == SipPacket::StatusClass::SUCCESS_2XX))
+            {
+                //the ACK of a 2xx is not part of the transaction
+                terminate();
+            }
+            else
+            {
+                m_state = State::COMPLETED;
+                m_message.clear();
+                //Timer D or Timer K
+                start_timeout(now, (m_type == Type::CLIENT_INVITE) ? TIMER_D_MSEC : T4_MSEC);
+            }
+            return Result::PASS;
+        case State::COMPLETED:
+            if ((m_type == Type::CLIENT_INVITE) && !provisional && (m_message.size() > 0))
+            {
+                return Result::RESEND;
+            }
+            return Result::ABSORB;
+        default:
+            return Result::ABSORB;
+        }
+    }
+
+    /**
+     * Feed a request matched by matches_request()
+     */
+    Result on_request(const SipPacket& request, TickType_t now)
+    {
+        if (request.get_method() == SipPacket::Method::ACK)
+        {
+            if (m_state == State::COMPLETED)
+            {
+                //Timer I absorbs ACK retransmissions
+                m_state = State::CONFIRMED;
+                m_retransmit_active = false;
+                start_timeout(now, T4_MSEC);
+                return Result::ABSORB;
+            }
+            if (m_state == State::ACCEPTED)
+            {
+                //the 2xx was received, the ACK is passed to the dialog
+                terminate();
+                return Result::PASS;
+            }
+            return Result::ABSORB;
+        }
+        return (m_message.size() > 0) ? Result::RESEND : Result::ABSORB;
+    }
+
+    /**
+     * Store a response sent by the server transaction, it is retransmitted if required
+     */
+    void on_response_sent(uint16_t status_code, const char* data, size_t length, TickType_t now)
+    {
+        store_message(data, length);
+        if (status_code < 200)
+        {
+            m_state = State::PROCEEDING;
+            return;
+        }
+        if (m_type == Type::SERVER_INVITE)
+        {
+            //Timer G retransmits the final response until the ACK arrives, Timer H gives up
+            m_state = (status_code < 300) ? State::ACCEPTED : State::COMPLETED;
+            start_retransmit(now, T1_MSEC);
+            start_timeout(now, 64 * T1_MSEC);
+        }
+        else
+        {
+            //Timer J
+            m_state = State::COMPLETED;
+            start_timeout(now, 64 * T1_MSEC);
+        }
+    }
+
+    /**
+     * Store the ACK of a non 2xx final response of a client INVITE transaction
+     */
+    void store_message(const char* data, size_t length)
+    {
+        m_message.clear();
+        m_message.append(data, length);
+        if (m_message.is_overflow())
+        {
+            ESP_LOGW(TAG, "Message of %d byte can not be stored for retransmission", (int) length);
+            m_message.clear();
+        }
+    }
+
+    const Buffer<MESSAGE_SIZE>& get_message() const
+    {
+        return m_message;
+    }
+
+    /**
+     * Evaluate the timers
+     */
+    Action poll(TickType_t now)
+    {
+        if (!is_active())
+        {
+            return Action::NONE;
+        }
+        if (m_timeout_active && expired(now, m_timeout_deadline))
+        {
+            bool failed = (m_state == State::CALLING) || (m_state == State::TRYING) || (m_state == State::PROCEEDING)
+                          || (m_state == State::ACCEPTED) || ((m_state == State::COMPLETED) && (m_type == Type::SERVER_INVITE));
+            ESP_LOGD(TAG, "Transaction %.*s timed out", (int) m_branch_length, m_branch.data());
+            terminate();
+            return failed ? Action::TIMEOUT : Action::NONE;
+        }
+        if (m_retransmit_active && expired(now, m_retransmit_deadline))
+        {
+            //Timer A doubles without limit, Timer E and G are capped at T2
+            uint32_t interval = 2 * m_retransmit_interval;
+            if ((m_type != Type::CLIENT_INVITE) && (interval > T2_MSEC))
+            {
+                interval = T2_MSEC;
+            }
+            start_retransmit(now, interval);
+            return Action::RETRANSMIT;
+        }
+        return Action::NONE;
+    }
+
+    /**
+     * \return true if a timer is running, the next deadline is returned in deadline
+     */
+    bool get_next_deadline(TickType_t& deadline) const
+    {
+        if (!is_active() || (!m_retransmit_active && !m_timeout_active))
+        {
+            return false;
+        }
+        if (m_retransmit_active && (!m_timeout_active || expired(m_timeout_deadline, m_retransmit_deadline)))
+        {
+            deadline = m_retransmit_deadline;
+        }
+        else
+        {
+            deadline = m_timeout_deadline;
+        }
+        return true;
+    }
+
+private:
+    void init(Type type, SipPacket::Method method, StringView branch, uint32_t cseq)
+    {
+        terminate();
+        m_type = type;
+        m_method = method;
+        m_cseq = cseq;
+        m_branch_length = (branch.size() < MAX_BRANCH_LENGTH) ? branch.size() : MAX_BRANCH_LENGTH;
+        memcpy(m_branch.data(), branch.data(), m_branch_length);
+        m_message.clear();
+    }
+
+    bool is_client() const
+    {
+        return (m_type == Type::CLIENT_INVITE) || (m_type == Type::CLIENT_NON_INVITE);
+    }
+
+    StringView branch() const
+    {
+        return StringView(m_branch.data(), m_branch_length);
+    }
+
+    void start_retransmit(TickType_t now, uint32_t interval_msec)
+    {
+        m_retransmit_active = true;
+        m_retransmit_interval = interval_msec;
+        m_retransmit_deadline = now + interval_msec / portTICK_RATE_MS;
+    }
+
+    void start_timeout(TickType_t now, uint32_t timeout_msec)
+    {
+        m_timeout_active = true;
+        m_timeout_deadline = now + timeout_msec / portTICK_RATE_MS;
+    }
+
+    /**
+     * Compare tick counts, robust against the wrap around of the tick counter
+     */
+    static bool expired(TickType_t now, TickType_t deadline)
+    {
+        return static_cast<int32_t>(now - deadline) >= 0;
+    }
+
+    Type m_type;
+    State m_state;
+    SipPacket::Method m_method;
+    std::array<char, MAX_BRANCH_LENGTH> m_branch;
+    size_t m_branch_length;
+    uint32_t m_cseq;
+
+    bool m_retransmit_active;
+    TickType_t m_retransmit_deadline;
+    uint32_t m_retransmit_interval;
+    bool m_timeout_active;
+    TickType_t m_timeout_deadline;
+
+    Buffer<MESSAGE_SIZE> m_message;
+
+    static constexpr const char* TAG = "SipTransaction";
+};
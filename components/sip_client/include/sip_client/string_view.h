@@ -0,0 +1,230 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Non owning, length delimited view into a character buffer
+ *
+ * The referenced data is not null terminated, so c string functions must not be used on it.
+ * The component is compiled with C++14, so std::string_view is not available.
+ */
+class StringView
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    constexpr StringView()
+    : m_data(nullptr)
+    , m_size(0)
+    {
+    }
+
+    constexpr StringView(const char* data, size_t size)
+    : m_data(data)
+    , m_size(size)
+    {
+    }
+
+    constexpr StringView(const char* str)
+    : m_data(str)
+    , m_size(length(str))
+    {
+    }
+
+    StringView(const std::string& str)
+    : m_data(str.data())
+    , m_size(str.size())
+    {
+    }
+
+    constexpr const char* data() const
+    {
+        return m_data;
+    }
+
+    constexpr size_t size() const
+    {
+        return m_size;
+    }
+
+    constexpr bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    constexpr char operator[](size_t pos) const
+    {
+        return m_data[pos];
+    }
+
+    constexpr const char* begin() const
+    {
+        return m_data;
+    }
+
+    constexpr const char* end() const
+    {
+        return m_data + m_size;
+    }
+
+    constexpr StringView substr(size_t pos, size_t len = npos) const
+    {
+        return (pos >= m_size) ? StringView(m_data + m_size, 0)
+                               : StringView(m_data + pos, (len > m_size - pos) ? m_size - pos : len);
+    }
+
+    size_t find(char c, size_t pos = 0) const
+    {
+        if (pos >= m_size)
+        {
+            return npos;
+        }
+        const void* found = memchr(m_data + pos, c, m_size - pos);
+        return (found == nullptr) ? npos : static_cast<const char*>(found) - m_data;
+    }
+
+    size_t find(StringView needle, size_t pos = 0) const
+    {
+        if (needle.empty())
+        {
+            return (pos <= m_size) ? pos : npos;
+        }
+        while ((pos = find(needle[0], pos)) != npos)
+        {
+            if (substr(pos).starts_with(needle))
+            {
+                return pos;
+            }
+            pos++;
+        }
+        return npos;
+    }
+
+    bool starts_with(StringView prefix) const
+    {
+        return (prefix.size() <= m_size) && (memcmp(m_data, prefix.data(), prefix.size()) == 0);
+    }
+
+    bool equals_ignore_case(StringView other) const
+    {
+        if (other.size() != m_size)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < m_size; i++)
+        {
+            if (to_lower(m_data[i]) != to_lower(other[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Remove leading and trailing white space, including the line endings of folded header lines
+     */
+    StringView trim() const
+    {
+        size_t first = 0;
+        size_t last = m_size;
+        while ((first < last) && is_white_space(m_data[first]))
+        {
+            first++;
+        }
+        while ((last > first) && is_white_space(m_data[last - 1]))
+        {
+            last--;
+        }
+        return StringView(m_data + first, last - first);
+    }
+
+    /**
+     * Parse a leading decimal number, returns false if the view does not start with a digit
+     * or the number exceeds UINT32_MAX
+     */
+    bool to_uint(uint32_t& output) const
+    {
+        size_t pos = 0;
+        uint32_t value = 0;
+        while ((pos < m_size) && (m_data[pos] >= '0') && (m_data[pos] <= '9'))
+        {
+            uint32_t digit = m_data[pos] - '0';
+            if (value > (UINT32_MAX - digit) / 10)
+            {
+                return false;
+            }
+            value = value * 10 + digit;
+            pos++;
+        }
+        if (pos == 0)
+        {
+            return false;
+        }
+        output = value;
+        return true;
+    }
+
+    std::string to_string() const
+    {
+        return std::string(m_data, m_size);
+    }
+
+    static constexpr char to_lower(char c)
+    {
+        return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    static constexpr bool is_space(char c)
+    {
+        return (c == ' ') || (c == '\t');
+    }
+
+private:
+    static constexpr bool is_white_space(char c)
+    {
+        return is_space(c) || (c == '\r') || (c == '\n');
+    }
+
+    static constexpr size_t length(const char* str)
+    {
+        size_t len = 0;
+        while (str[len] != '\0')
+        {
+            len++;
+        }
+        return len;
+    }
+
+    const char* m_data;
+    size_t m_size;
+};
+
+inline bool operator==(StringView lhs, StringView rhs)
+{
+    return (lhs.size() == rhs.size()) && (memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+}
+
+inline bool operator!=(StringView lhs, StringView rhs)
+{
+    return !(lhs == rhs);
+}
@@ -0,0 +1,109 @@
+/*
+   Copyright 2017 Christian Taedcke <hacking@taedcke.com>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "string_view.h"
+
+#include <cstddef>
+#include <cstdint>
+
+template <class IdT>
+struct Token {
+    StringView name;
+    IdT id;
+};
+
+/**
+ * Perfect hash table mapping a fixed set of tokens to ids
+ *
+ * The table is built at compile time from a static constexpr token array. A lookup costs one
+ * hash and one compare. The SEED must be chosen so that no two tokens end up in the same slot,
+ * which is checked with is_perfect() in a static_assert next to the table definition.
+ * The hash is case insensitive, so the same table can be used for case insensitive lookups.
+ */
+template <class IdT, size_t SIZE, uint32_t SEED, bool IGNORE_CASE>
+class TokenTable
+{
+public:
+    template <size_t N>
+    constexpr TokenTable(const Token<IdT> (&tokens)[N])
+    : m_tokens(tokens)
+    , m_slots()
+    , m_perfect(N < EMPTY)
+    {
+        static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+        for (size_t i = 0; i < SIZE; i++)
+        {
+            m_slots[i] = EMPTY;
+        }
+        for (size_t i = 0; i < N; i++)
+        {
+            size_t slot = hash(tokens[i].name);
+            if (m_slots[slot] != EMPTY)
+            {
+                m_perfect = false;
+            }
+            m_slots[slot] = static_cast<uint8_t>(i);
+        }
+    }
+
+    constexpr bool is_perfect() const
+    {
+        return m_perfect;
+    }
+
+    IdT find(StringView name, IdT unknown) const
+    {
+        uint8_t index = m_slots[hash(name)];
+        if (index == EMPTY)
+        {
+            return unknown;
+        }
+        const Token<IdT>& token = m_tokens[index];
+        bool match = (name == token.name) || (IGNORE_CASE && name.equals_ignore_case(token.name));
+        return match ? token.id : unknown;
+    }
+
+    static constexpr size_t hash(StringView name)
+    {
+        //multiplicative hash over the length and the lower case first, middle and last character,
+        //so the cost does not depend on the token length
+        if (name.empty())
+        {
+            return 0;
+        }
+        const size_t length = name.size();
+        uint32_t value = static_cast<uint32_t>(length)
+                ^ (static_cast<uint32_t>(static_cast<uint8_t>(StringView::to_lower(name[0]))) << 8)
+                ^ (static_cast<uint32_t>(static_cast<uint8_t>(StringView::to_lower(name[length / 2]))) << 16)
+                ^ (static_cast<uint32_t>(static_cast<uint8_t>(StringView::to_lower(name[length - 1]))) << 24);
+        return static_cast<uint32_t>(value * SEED) >> (32 - SIZE_BITS);
+    }
+
+private:
+    static constexpr uint8_t EMPTY = 0xff;
+
+    static constexpr uint32_t bits(size_t size)
+    {
+        return (size > 1) ? 1 + bits(size / 2) : 0;
+    }
+    static constexpr uint32_t SIZE_BITS = bits(SIZE);
+
+    const Token<IdT>* m_tokens;
+    uint8_t m_slots[SIZE];
+    bool m_perfect;
+};
@@ -25,8 +25,34 @@
 
 #include "main.h"
 
+#include <string>
+#include <vector>
+
 namespace sml = boost::sml;
 
+/**
+ * Split the comma separated list of numbers of CONFIG_CALL_TARGET_USER
+ */
+static std::vector<std::string> call_targets(const std::string& config)
+{
+    std::vector<std::string> targets;
+    size_t start = 0;
+    while (start <= config.size())
+    {
+        size_t end = config.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = config.size();
+        }
+        if (end > start)
+        {
+            targets.push_back(config.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return targets;
+}
+
 struct e_btn {};
 struct e_call_end {};
 struct e_timeout {};
@@ -37,7 +63,7 @@ struct dependencies {
         using namespace sml;
 
         const auto action_call = [](SipClientT& d, const auto& event) {
-            d.request_ring(CONFIG_CALL_TARGET_USER, CONFIG_CALLER_DISPLAY_MESSAGE);
+            d.request_ring_group(call_targets(CONFIG_CALL_TARGET_USER), CONFIG_CALLER_DISPLAY_MESSAGE);
         };
 
         const auto action_cancel = [](SipClientT& d, const auto& event) {
@@ -35,7 +35,7 @@
 #include "app_camera.h"
 #include "http_server.h"
 #include "sip_client/lwip_udp_client.h"
-#include "sip_client/mbedtls_md5.h"
+#include "sip_client/mbedtls_hash.h"
 #include "sip_client/sip_client.h"
 #include "button_handler.h"
 
@@ -45,7 +45,7 @@ static const char *TAG = "main";
 
 static void handle_jpg(http_context_t http_ctx, void* ctx);
 
-using SipClientT = SipClient<LwipUdpClient, MbedtlsMd5>;
+using SipClientT = SipClient<LwipUdpClient, MbedtlsHash>;
 SipClientT s_client{CONFIG_SIP_USER, CONFIG_SIP_PASSWORD, CONFIG_SIP_SERVER_IP, CONFIG_SIP_SERVER_PORT, CONFIG_LOCAL_IP};
 
 const int CONNECTED_BIT = BIT0;
@@ -180,38 +180,76 @@ static void sip_task(void *pvParameters) {
                 vTaskDelay(2000 / portTICK_RATE_MS);
                 continue;
             }
-            s_client.set_event_handler([](const SipClientEvent& event) {
-                uint32_t data = 0;
-                switch (event.event) {
-                    case SipClientEvent::Event::CALL_START:
-                        ESP_LOGI(TAG, "Call start");
-                        CODE_POS = 0;
-                    break;
-                    case SipClientEvent::Event::CALL_END:
-                        ESP_LOGI(TAG, "Call end");
-                        button_input_handler.call_end();
-                        CODE_POS = 0;
-                    break;
-                    case SipClientEvent::Event::CALL_CANCELLED:
-                        ESP_LOGI(TAG, "Call cancelled, reason %d", (int) event.cancel_reason);
-                        button_input_handler.call_end();
-                        break;
-                    case SipClientEvent::Event::BUTTON_PRESS:
-                        ESP_LOGI(TAG, "Got button press: %c for %d milliseconds", event.button_signal, event.button_duration);
-                        if(event.button_signal == DOORCODE[CODE_POS]) CODE_POS++; else CODE_POS=0;
-                        if (CODE_POS==4) {
-                            CODE_POS = 0;
-                            xQueueSendToBack(door_opener_queue, &data, (TickType_t) 10);
-                        }
-                    break;
-                }
-            });
+            s_client.set_registration_timing(CONFIG_SIP_REGISTER_EXPIRES, CONFIG_SIP_REGISTER_REFRESH_INTERVAL);
+#if CONFIG_SIP_KEEP_ALIVE_OPTIONS
+            s_client.set_keep_alive(SipKeepAlive::Mode::OPTIONS, CONFIG_SIP_KEEP_ALIVE_INTERVAL, CONFIG_SIP_KEEP_ALIVE_MAX_LOST);
+#elif CONFIG_SIP_KEEP_ALIVE_CRLF
+            s_client.set_keep_alive(SipKeepAlive::Mode::CRLF, CONFIG_SIP_KEEP_ALIVE_INTERVAL, CONFIG_SIP_KEEP_ALIVE_MAX_LOST);
+#endif
+            SipAnswerPolicy answer_policy;
+            answer_policy.answer_delay_msec = CONFIG_SIP_ANSWER_DELAY;
+#if CONFIG_SIP_ALERTING_EARLY_MEDIA
+            answer_policy.alerting = SipAnswerPolicy::Alerting::EARLY_MEDIA;
+#elif CONFIG_SIP_ALERTING_RINGING
+            answer_policy.alerting = SipAnswerPolicy::Alerting::RINGING;
+#endif
+            answer_policy.allowed_callers = call_targets(CONFIG_SIP_ALLOWED_CALLERS);
+            s_client.set_answer_policy(answer_policy);
+            s_client.set_session_timer(CONFIG_SIP_SESSION_EXPIRES);
         }
 
         s_client.run();
     }
 }
 
+static void sip_event_task(void* arg) {
+    SipClientEvent event;
+    uint32_t dropped = 0;
+    for(;;) {
+        if (!s_client.wait_event(event, portMAX_DELAY)) {
+            continue;
+        }
+        SipEventStats stats = s_client.get_event_stats();
+        if (stats.dropped != dropped) {
+            ESP_LOGW(TAG, "%d SIP events dropped", (int) (stats.dropped - dropped));
+            dropped = stats.dropped;
+        }
+        uint32_t data = 0;
+        switch (event.event) {
+            case SipClientEvent::Event::CALL_START:
+                ESP_LOGI(TAG, "Call start");
+                CODE_POS = 0;
+            break;
+            case SipClientEvent::Event::CALL_END:
+                ESP_LOGI(TAG, "Call end");
+                button_input_handler.call_end();
+                CODE_POS = 0;
+            break;
+            case SipClientEvent::Event::CALL_CANCELLED:
+                ESP_LOGI(TAG, "Call cancelled, reason %d", (int) event.cancel_reason);
+                button_input_handler.call_end();
+                break;
+            case SipClientEvent::Event::TARGET_CANCELLED:
+                ESP_LOGI(TAG, "Call target %d cancelled, reason %d", (int) event.target, (int) event.cancel_reason);
+                break;
+            case SipClientEvent::Event::REGISTERED:
+                ESP_LOGI(TAG, "Registered");
+            break;
+            case SipClientEvent::Event::REGISTRATION_FAILED:
+                ESP_LOGW(TAG, "Registration failed");
+            break;
+            case SipClientEvent::Event::BUTTON_PRESS:
+                ESP_LOGI(TAG, "Got button press: %c for %d milliseconds", event.button_signal, event.button_duration);
+                if(event.button_signal == DOORCODE[CODE_POS]) CODE_POS++; else CODE_POS=0;
+                if (CODE_POS==4) {
+                    CODE_POS = 0;
+                    xQueueSendToBack(door_opener_queue, &data, (TickType_t) 10);
+                }
+            break;
+        }
+    }
+}
+
 static void door_opener_task(void* arg) {
     gpio_pad_select_gpio(DOOR_GPIO_PIN);
     gpio_set_direction(DOOR_GPIO_PIN, GPIO_MODE_OUTPUT);
@@ -308,6 +346,7 @@ extern "C" void app_main(void) {
     ESP_LOGD(TAG, "initialize door opener");
     door_opener_queue = xQueueCreate(1, sizeof(uint32_t));
     xTaskCreate(&door_opener_task, "door_opener_task", 4096, NULL, 5, NULL);
+    xTaskCreate(&sip_event_task, "sip_event_task", 4096, NULL, 5, NULL);
 
     ESP_LOGD(TAG, "initialize HTTP server");
     http_server_t server;